@@ -0,0 +1,526 @@
+// helmholtz_bench: timings for the simulation hot paths (OBJ parsing, mesh
+// cache, BVH, ray casting, propagation, voxelization and CPU FDTD) on a
+// synthetic city or a given model. Results are printed and optionally written
+// as JSON for bench/compare.py.
+
+#include "cpu_fdtd_solver.h"
+#include "image_method_solver.h"
+#include "mesh_cache.h"
+#include "model_loader.h"
+#include "radio_system.h"
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+struct BenchOptions {
+  std::string modelPath; // Empty = generate a synthetic city
+  std::string jsonPath;
+  std::string filter;    // Substring of benchmark names to run
+  int citySize = 40;     // Buildings per side of the synthetic city
+  int repetitions = 5;
+  int rayCount = 200000;
+  std::vector<int> fdtdGridSizes = {32, 64, 96, 128};
+  int fdtdSteps = 50;
+};
+
+struct BenchResult {
+  std::string name;
+  std::string unit; // What the work count measures, per second
+  int repetitions = 0;
+  double minSeconds = 0.0;
+  double medianSeconds = 0.0;
+  double work = 0.0;
+
+  double throughput() const {
+    return medianSeconds > 0.0 ? work / medianSeconds : 0.0;
+  }
+};
+
+void printUsage(const char *program) {
+  std::cout
+      << "Usage: " << program << " [options]\n"
+      << "\n"
+      << "Options:\n"
+      << "  --model <file.obj>      Benchmark on a model instead of the\n"
+      << "                          synthetic city\n"
+      << "  --city <n>              Synthetic city size, n x n buildings\n"
+      << "                          (default: 40)\n"
+      << "  --json <file>           Write results as JSON\n"
+      << "  --filter <text>         Only run benchmarks whose name contains\n"
+      << "                          text\n"
+      << "  --repetitions <n>       Timed runs per benchmark (default: 5)\n"
+      << "  --rays <n>              Rays per ray benchmark (default: 200000)\n"
+      << "  --fdtd-steps <n>        Steps per FDTD run (default: 50)\n";
+}
+
+bool parseArguments(int argc, char **argv, BenchOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      return false;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--model") {
+      options.modelPath = value;
+    } else if (arg == "--city") {
+      options.citySize = std::max(1, std::atoi(value.c_str()));
+    } else if (arg == "--json") {
+      options.jsonPath = value;
+    } else if (arg == "--filter") {
+      options.filter = value;
+    } else if (arg == "--repetitions") {
+      options.repetitions = std::max(1, std::atoi(value.c_str()));
+    } else if (arg == "--rays") {
+      options.rayCount = std::max(1, std::atoi(value.c_str()));
+    } else if (arg == "--fdtd-steps") {
+      options.fdtdSteps = std::max(1, std::atoi(value.c_str()));
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// The core logs progress to stdout; keep it out of the timing output
+class QuietStdout {
+public:
+  QuietStdout() : previous(std::cout.rdbuf(nullptr)) {}
+  ~QuietStdout() {
+    std::cout.rdbuf(previous);
+    std::cout.clear();
+  }
+
+private:
+  std::streambuf *previous;
+};
+
+// Grid of box buildings with seeded random footprints and heights on a
+// ground plane; same OBJ layout as exported city models (v, vn, f v//vn)
+bool writeSyntheticCity(const std::string &path, int citySize) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+
+  const float blockSize = 40.0f;
+  const float half = citySize * blockSize * 0.5f;
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> footprint(8.0f, 16.0f);
+  std::uniform_real_distribution<float> height(10.0f, 120.0f);
+
+  file << "# Synthetic city, " << citySize << "x" << citySize
+       << " buildings\n";
+  file << "vn 0 1 0\nvn 1 0 0\nvn -1 0 0\nvn 0 0 1\nvn 0 0 -1\n";
+  file << "v " << -half << " 0 " << -half << "\n";
+  file << "v " << half << " 0 " << -half << "\n";
+  file << "v " << half << " 0 " << half << "\n";
+  file << "v " << -half << " 0 " << half << "\n";
+  file << "f 1//1 3//1 2//1\nf 1//1 4//1 3//1\n";
+
+  int base = 5;
+  for (int bz = 0; bz < citySize; bz++) {
+    for (int bx = 0; bx < citySize; bx++) {
+      float cx = -half + (bx + 0.5f) * blockSize;
+      float cz = -half + (bz + 0.5f) * blockSize;
+      float w = footprint(rng);
+      float d = footprint(rng);
+      float h = height(rng);
+
+      // Bottom ring 0-3, top ring 4-7
+      for (float y : {0.0f, h}) {
+        file << "v " << cx - w << " " << y << " " << cz - d << "\n";
+        file << "v " << cx + w << " " << y << " " << cz - d << "\n";
+        file << "v " << cx + w << " " << y << " " << cz + d << "\n";
+        file << "v " << cx - w << " " << y << " " << cz + d << "\n";
+      }
+
+      auto quad = [&](int a, int b, int c, int e, int n) {
+        file << "f " << base + a << "//" << n << " " << base + b << "//" << n
+             << " " << base + c << "//" << n << "\n";
+        file << "f " << base + a << "//" << n << " " << base + c << "//" << n
+             << " " << base + e << "//" << n << "\n";
+      };
+      quad(4, 7, 6, 5, 1); // Roof
+      quad(1, 2, 6, 5, 2); // +x
+      quad(3, 0, 4, 7, 3); // -x
+      quad(2, 3, 7, 6, 4); // +z
+      quad(0, 1, 5, 4, 5); // -z
+      base += 8;
+    }
+  }
+  return file.good();
+}
+
+// Times `run` (which returns the amount of work it did) and records the
+// median and best of several repetitions after one warm-up run
+BenchResult measure(const std::string &name, const std::string &unit,
+                    int repetitions, const std::function<double()> &run) {
+  BenchResult result;
+  result.name = name;
+  result.unit = unit;
+  result.repetitions = repetitions;
+
+  {
+    QuietStdout quiet;
+    run();
+  }
+
+  std::vector<double> times;
+  for (int r = 0; r < repetitions; r++) {
+    QuietStdout quiet;
+    auto start = std::chrono::steady_clock::now();
+    result.work = run();
+    times.push_back(std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count());
+  }
+
+  std::sort(times.begin(), times.end());
+  result.minSeconds = times.front();
+  result.medianSeconds = times[times.size() / 2];
+
+  std::cout << std::left << std::setw(24) << name << std::right
+            << std::setw(12) << std::setprecision(4)
+            << result.medianSeconds * 1e3 << " ms" << std::setw(14)
+            << std::setprecision(4) << result.throughput() << " " << unit
+            << "/s" << std::endl;
+  return result;
+}
+
+std::vector<Ray> makeRays(const BoundingBox &bounds, int count) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::normal_distribution<float> normal(0.0f, 1.0f);
+
+  // Street-level origins, directions uniform on the sphere
+  glm::vec3 extent = bounds.max - bounds.min;
+  std::vector<Ray> rays(count);
+  for (auto &ray : rays) {
+    ray.origin = glm::vec3(bounds.min.x + unit(rng) * extent.x,
+                           2.0f + unit(rng) * 30.0f,
+                           bounds.min.z + unit(rng) * extent.z);
+    glm::vec3 direction(normal(rng), normal(rng), normal(rng));
+    ray.direction = glm::normalize(direction + glm::vec3(1e-6f));
+    ray.tMax = 2000.0f;
+  }
+  return rays;
+}
+
+bool writeJSON(const std::string &path, const BenchOptions &options,
+               const std::vector<BenchResult> &results) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+
+  std::time_t now = std::time(nullptr);
+  char timestamp[32];
+  std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ",
+                std::gmtime(&now));
+
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+
+  file << std::setprecision(9);
+  file << "{\n";
+  file << "  \"timestamp\": \"" << timestamp << "\",\n";
+  file << "  \"threads\": " << threads << ",\n";
+  file << "  \"model\": \""
+       << (options.modelPath.empty()
+               ? "synthetic_city_" + std::to_string(options.citySize)
+               : std::filesystem::path(options.modelPath).filename().string())
+       << "\",\n";
+  file << "  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &r = results[i];
+    file << "    {\"name\": \"" << r.name << "\", \"unit\": \"" << r.unit
+         << "\", \"repetitions\": " << r.repetitions
+         << ", \"min_seconds\": " << r.minSeconds
+         << ", \"median_seconds\": " << r.medianSeconds
+         << ", \"work\": " << r.work
+         << ", \"throughput\": " << r.throughput() << "}"
+         << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  file << "  ]\n";
+  file << "}\n";
+  return file.good();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  if (!parseArguments(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  auto selected = [&options](const std::string &name) {
+    return options.filter.empty() ||
+           name.find(options.filter) != std::string::npos;
+  };
+
+  std::filesystem::path workDir =
+      std::filesystem::temp_directory_path() / "helmholtz_bench";
+  std::filesystem::create_directories(workDir);
+
+  std::string modelPath = options.modelPath;
+  if (modelPath.empty()) {
+    modelPath = (workDir / "synthetic_city.obj").string();
+    if (!writeSyntheticCity(modelPath, options.citySize))
+      return 1;
+  }
+  std::string bvhPath = (workDir / "bench.bvh").string();
+  std::string meshCachePath = (workDir / "bench.hmesh").string();
+
+  std::vector<BenchResult> results;
+
+  // Geometry
+  ModelData model;
+  {
+    QuietStdout quiet;
+    model = ModelLoader::loadOBJ(modelPath);
+  }
+  if (!model.loaded) {
+    std::cerr << "Failed to load model: " << modelPath << std::endl;
+    return 1;
+  }
+  const double triangleCount = static_cast<double>(model.indices.size() / 3);
+  std::cout << "Model: " << modelPath << " (" << triangleCount
+            << " triangles)" << std::endl;
+
+  if (selected("obj_parse")) {
+    results.push_back(
+        measure("obj_parse", "triangles", options.repetitions, [&]() {
+          ModelData data = ModelLoader::loadOBJ(modelPath);
+          return static_cast<double>(data.indices.size() / 3);
+        }));
+  }
+
+  // What loadOBJCached stores: the mesh plus its LOD chain
+  ModelData lodModel = model;
+  {
+    QuietStdout quiet;
+    MeshLodBuilder::build(lodModel);
+  }
+  if (selected("mesh_lod_build")) {
+    results.push_back(
+        measure("mesh_lod_build", "triangles", options.repetitions, [&]() {
+          ModelData data = model;
+          MeshLodBuilder::build(data);
+          return triangleCount;
+        }));
+  }
+
+  SpatialIndex spatialIndex;
+  {
+    QuietStdout quiet;
+    spatialIndex.buildFromMesh(model.vertices, model.indices);
+    spatialIndex.saveBVH(bvhPath);
+  }
+
+  if (selected("bvh_build")) {
+    results.push_back(measure("bvh_build", "triangles", options.repetitions,
+                              [&]() {
+                                SpatialIndex index;
+                                index.buildFromMesh(model.vertices,
+                                                    model.indices);
+                                return triangleCount;
+                              }));
+  }
+  if (selected("bvh_save")) {
+    results.push_back(measure("bvh_save", "triangles", options.repetitions,
+                              [&]() {
+                                spatialIndex.saveBVH(bvhPath);
+                                return triangleCount;
+                              }));
+  }
+  if (selected("bvh_load")) {
+    results.push_back(measure("bvh_load", "triangles", options.repetitions,
+                              [&]() {
+                                SpatialIndex index;
+                                index.loadBVH(bvhPath);
+                                return triangleCount;
+                              }));
+  }
+
+  MeshCacheKey meshKey;
+  MeshCacheKey::fromFile(modelPath, meshKey);
+  if (selected("mesh_cache_save")) {
+    results.push_back(measure("mesh_cache_save", "triangles",
+                              options.repetitions, [&]() {
+                                MeshCache::save(meshCachePath, lodModel,
+                                                meshKey);
+                                return triangleCount;
+                              }));
+  }
+  if (selected("mesh_cache_load")) {
+    {
+      QuietStdout quiet;
+      MeshCache::save(meshCachePath, lodModel, meshKey);
+    }
+    results.push_back(measure("mesh_cache_load", "triangles",
+                              options.repetitions, [&]() {
+                                ModelData data;
+                                MeshCache::load(meshCachePath, meshKey, data);
+                                return static_cast<double>(data.indices.size() /
+                                                           3);
+                              }));
+  }
+
+  // Ray casting
+  // Hit counts are kept so the traversal can't be optimized away
+  std::vector<Ray> rays =
+      makeRays(spatialIndex.getBounds(), options.rayCount);
+  int rayHits = 0;
+  if (selected("ray_single")) {
+    results.push_back(measure("ray_single", "rays", options.repetitions, [&]() {
+      int hits = 0;
+      for (const Ray &ray : rays)
+        hits += spatialIndex.intersect(ray).hit ? 1 : 0;
+      rayHits = hits;
+      return static_cast<double>(rays.size());
+    }));
+  }
+  if (selected("ray_batch")) {
+    results.push_back(measure("ray_batch", "rays", options.repetitions, [&]() {
+      int hits = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+ : hits)
+      for (int i = 0; i < static_cast<int>(rays.size()); i++)
+        hits += spatialIndex.intersect(rays[i]).hit ? 1 : 0;
+      rayHits = hits;
+      return static_cast<double>(rays.size());
+    }));
+  }
+  if (selected("ray_occlusion")) {
+    results.push_back(
+        measure("ray_occlusion", "rays", options.repetitions, [&]() {
+          int hits = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+ : hits)
+          for (int i = 0; i < static_cast<int>(rays.size()); i++)
+            hits += spatialIndex.intersectAny(rays[i]) ? 1 : 0;
+          rayHits = hits;
+          return static_cast<double>(rays.size());
+        }));
+  }
+
+  if (rayHits > 0) {
+    std::cout << "Last ray batch: " << rayHits << " of " << rays.size()
+              << " rays hit" << std::endl;
+  }
+
+  // Propagation: a ring of transmitters and a grid of receivers at street
+  // level around the center of the model
+  const BoundingBox &bounds = spatialIndex.getBounds();
+  glm::vec3 center = bounds.centroid();
+  glm::vec3 extent = bounds.max - bounds.min;
+  float radius = std::min(extent.x, extent.z) * 0.25f;
+
+  RadioSystem radioSystem;
+  for (int t = 0; t < 8; t++) {
+    float angle = 6.2831853f * t / 8.0f;
+    radioSystem.addSource(glm::vec3(center.x + radius * std::cos(angle), 25.0f,
+                                    center.z + radius * std::sin(angle)),
+                          2.4e9f, NodeType::TRANSMITTER);
+  }
+  for (int r = 0; r < 16; r++) {
+    float u = (r % 4) / 1.5f - 1.0f;
+    float v = (r / 4) / 1.5f - 1.0f;
+    radioSystem.addSource(
+        glm::vec3(center.x + radius * u, 2.0f, center.z + radius * v), 2.4e9f,
+        NodeType::RECEIVER);
+  }
+
+  if (selected("propagation")) {
+    results.push_back(
+        measure("propagation", "rays", options.repetitions, [&]() {
+          radioSystem.invalidateAll();
+          radioSystem.computeSignalPropagation(&spatialIndex);
+          return static_cast<double>(radioSystem.getSignalRays().size());
+        }));
+  }
+  if (selected("image_method")) {
+    results.push_back(
+        measure("image_method", "links", options.repetitions, [&]() {
+          ImageMethodSolver solver;
+          solver.computeLinks(radioSystem, spatialIndex);
+          return static_cast<double>(solver.getLinks().size());
+        }));
+  }
+
+  // Voxelization and FDTD on a grid over the middle of the model
+  glm::vec3 gridHalfSize(std::min(extent.x, extent.z) * 0.25f);
+  glm::vec3 gridCenter(center.x, gridHalfSize.y, center.z);
+  if (selected("voxelize_64")) {
+    results.push_back(
+        measure("voxelize_64", "cells", options.repetitions, [&]() {
+          std::vector<unsigned char> occupancy = CPUFDTDSolver::voxelize(
+              64, gridCenter, gridHalfSize, spatialIndex, 0.0f);
+          return static_cast<double>(occupancy.size());
+        }));
+  }
+
+  for (int gridSize : options.fdtdGridSizes) {
+    std::string name = "fdtd_" + std::to_string(gridSize);
+    if (!selected(name))
+      continue;
+
+    CPUFDTDSolver solver;
+    std::vector<unsigned char> occupancy;
+    {
+      QuietStdout quiet;
+      solver.initialize(gridSize);
+      occupancy = CPUFDTDSolver::voxelize(gridSize, gridCenter, gridHalfSize,
+                                          spatialIndex, 0.0f);
+    }
+    solver.applyMaterial(occupancy, 50.0f);
+    solver.setDFTFrequencies({2.4e9f});
+
+    int middle = gridSize / 2;
+    results.push_back(measure(name, "cells", options.repetitions, [&]() {
+      solver.reset();
+      for (int step = 0; step < options.fdtdSteps; step++) {
+        solver.clearEmission();
+        solver.addEmissionSource(middle, middle, middle,
+                                 std::sin(0.3f * step) * 0.5f);
+        solver.update();
+      }
+      return static_cast<double>(gridSize) * gridSize * gridSize *
+             options.fdtdSteps;
+    }));
+  }
+
+  if (!options.jsonPath.empty()) {
+    if (!writeJSON(options.jsonPath, options, results))
+      return 1;
+    std::cout << "Results written to " << options.jsonPath << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Compare two helmholtz_bench JSON files and flag throughput regressions.
+
+Usage: compare.py <baseline.json> <current.json> [--threshold 0.10]
+
+Exits with status 1 when any benchmark present in both files lost more than
+the threshold fraction of its throughput, so it can gate CI.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data, {b["name"]: b for b in data["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="allowed throughput loss (default: 0.10)")
+    args = parser.parse_args()
+
+    base_info, baseline = load(args.baseline)
+    curr_info, current = load(args.current)
+
+    for key in ("model", "threads"):
+        if base_info.get(key) != curr_info.get(key):
+            print(f"warning: {key} differs ({base_info.get(key)} vs "
+                  f"{curr_info.get(key)}), results may not be comparable")
+
+    print(f"{'benchmark':<24}{'baseline':>14}{'current':>14}{'change':>10}")
+    regressions = []
+    for name, result in current.items():
+        unit = result["unit"] + "/s"
+        if name not in baseline:
+            print(f"{name:<24}{'-':>14}{result['throughput']:>14.4g}"
+                  f"{'new':>10}  {unit}")
+            continue
+
+        before = baseline[name]["throughput"]
+        after = result["throughput"]
+        change = (after - before) / before if before > 0 else 0.0
+        flag = ""
+        if change < -args.threshold:
+            regressions.append(name)
+            flag = "  REGRESSION"
+        print(f"{name:<24}{before:>14.4g}{after:>14.4g}{change:>+10.1%}"
+              f"  {unit}{flag}")
+
+    for name in baseline:
+        if name not in current:
+            print(f"{name:<24} missing from current run")
+
+    if regressions:
+        print(f"\n{len(regressions)} regression(s) beyond "
+              f"{args.threshold:.0%}: {', '.join(regressions)}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "model_loader.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class SpatialIndex;
+
+// Loads a model and its BVH on background threads so the window can open
+// and start drawing while they run. The mesh (via the .hmesh cache) and the
+// BVH cache are read in parallel; the BVH is only built from the mesh, and
+// cached, when its cache cannot be loaded.
+//
+// Results are handed over once each, polled from the main loop.
+class AsyncModelLoader {
+public:
+  AsyncModelLoader();
+  ~AsyncModelLoader();
+
+  void start(const std::string &objPath, const std::string &bvhPath);
+
+  // The parsed mesh once it is ready, then nullptr
+  std::shared_ptr<const ModelData> takeMesh();
+  // The finished spatial index once it is ready, then nullptr
+  std::unique_ptr<SpatialIndex> takeSpatialIndex();
+
+  bool isRunning() const;
+  // Set when the model could not be loaded
+  bool hasFailed() const;
+
+  void wait();
+
+private:
+  std::thread meshThread;
+  std::thread indexThread;
+
+  mutable std::mutex mutex;
+  std::condition_variable meshCondition;
+  std::shared_ptr<const ModelData> mesh;
+  std::unique_ptr<SpatialIndex> index;
+  bool meshDone;
+  bool meshTaken;
+  bool indexDone;
+  bool failed;
+
+  void loadMesh(const std::string &objPath);
+  void loadIndex(const std::string &objPath, const std::string &bvhPath);
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Reads float textures back without stalling the pipeline. A request
+// copies the texture into one of a ring of pixel-pack buffers and fences
+// it; poll() maps the buffers whose fences have passed, oldest first, and
+// hands their contents to the callback. When every buffer is still in
+// flight a request is refused rather than waited on, so the caller can try
+// again on a later frame.
+class AsyncReadback {
+public:
+  using Callback = std::function<void(uint64_t tag, std::vector<float> &&)>;
+
+  AsyncReadback();
+  ~AsyncReadback();
+
+  // Buffers are created on first use and grown to the largest request
+  void initialize(int slotCount);
+  // Deletes the buffers and fences, dropping copies in flight; needs the
+  // GL context
+  void cleanup();
+
+  // Runs inside poll() on the GL thread; hand the data to another thread
+  // for anything slow
+  void setCallback(Callback newCallback) { callback = std::move(newCallback); }
+
+  // Queues a copy of level 0 of a 3D texture of `size` texels, read as
+  // GL_RED or GL_RG floats. `tag` is passed back with the data. False if
+  // every buffer is in flight
+  bool request(GLuint texture, GLenum format, const glm::ivec3 &size,
+               uint64_t tag);
+  // Delivers finished copies without waiting
+  void poll();
+  // Waits for and delivers every copy in flight
+  void flush();
+
+  // Copies that were queued but never delivered because their fence wait
+  // failed or the buffer could not be mapped
+  size_t getLostCount() const { return lostCount; }
+
+private:
+  struct Slot {
+    GLuint buffer = 0;
+    size_t capacity = 0; // Bytes
+    size_t count = 0;    // Floats in the pending copy
+    GLsync fence = nullptr;
+    uint64_t tag = 0;
+  };
+
+  // Copies are filled and delivered in ring order
+  std::vector<Slot> slots;
+  int firstPending;
+  int pendingCount;
+  size_t lostCount;
+  Callback callback;
+
+  bool deliver(Slot &slot, bool wait);
+};
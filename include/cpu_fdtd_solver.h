@@ -0,0 +1,105 @@
+#pragma once
+
+#include "fdtd_common.h"
+
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+class SceneGeometry;
+
+// CPU (OpenMP) port of FDTDSolver for headless runs. Uses the same update
+// equations, boundary damping, voxelization rule and DFT convention as the
+// compute shaders so batch results match what the viewer shows.
+class CPUFDTDSolver {
+public:
+  CPUFDTDSolver();
+
+  bool initialize(int gridSize);
+
+  void addEmissionSource(int x, int y, int z, float strength);
+  void clearEmission() { emission.clear(); }
+  void update();
+  void reset();
+
+  // Same rule as shaders/mark_geometry.comp: below groundLevel or more than
+  // half of 9 voxel samples inside the mesh (ray parity) -> materialEpsilon
+  void markGeometry(const glm::vec3 &gridCenter, const glm::vec3 &gridHalfSize,
+                    const SceneGeometry &spatialIndex, float groundLevel = 0.0f,
+                    float materialEpsilon = 50.0f);
+
+  // markGeometry in two halves, so one voxelization can be shared by runs
+  // that only differ in material: 1 = solid, 0 = air, same layout as fields
+  static std::vector<unsigned char>
+  voxelize(int gridSize, const glm::vec3 &gridCenter,
+           const glm::vec3 &gridHalfSize, const SceneGeometry &spatialIndex,
+           float groundLevel = 0.0f);
+  void applyMaterial(const std::vector<unsigned char> &occupancy,
+                     float materialEpsilon);
+
+  // Bytes one solver needs for a run, for sizing worker pools
+  static size_t estimateMemory(int gridSize, int dftCount, int probeCount,
+                               int steps);
+
+  int getGridSize() const { return gridSize; }
+  int getStepCount() const { return stepCount; }
+  float getTimeStep() const { return timeStep; }
+  void setTimeStep(float seconds) { timeStep = seconds; }
+
+  float getVoxelSpacing() const { return voxelSpacing; }
+  void setVoxelSpacing(float spacing) { voxelSpacing = spacing; }
+  float getConductivity() const { return conductivity; }
+  void setConductivity(float cond) { conductivity = cond; }
+
+  // Field access, x fastest then y then z
+  const std::vector<float> &getEz() const { return ez; }
+  const std::vector<float> &getEpsilon() const { return epsilon; }
+  size_t cellIndex(int x, int y, int z) const {
+    return (static_cast<size_t>(z) * gridSize + y) * gridSize + x;
+  }
+
+  // Probes are sampled after every step and keep their full history
+  void setProbes(const std::vector<FDTDProbe> &probes);
+  int getProbeCount() const { return static_cast<int>(probeList.size()); }
+  const FDTDProbe &getProbe(int index) const { return probeList[index]; }
+  const std::vector<ProbeSample> &getProbeHistory(int index) const {
+    return probeHistory[index];
+  }
+  // Mean Ez power over the last `window` steps in dB, like FDTDSolver
+  float getProbeRSSI(int index, int window = 256) const;
+
+  // Running DFT of Ez over the whole grid, normalized like FDTDSolver::readDFT
+  void setDFTFrequencies(const std::vector<float> &frequencies);
+  int getDFTFrequencyCount() const {
+    return static_cast<int>(dftFrequencies.size());
+  }
+  float getDFTFrequency(int index) const { return dftFrequencies[index]; }
+  int getDFTSampleCount() const { return dftSampleCount; }
+  void readDFT(int index, std::vector<glm::vec2> &field) const;
+  glm::vec2 getDFTPhasor(int index, const glm::ivec3 &cell) const;
+
+private:
+  int gridSize;
+  float voxelSpacing;
+  float conductivity;
+  float timeStep;
+  int stepCount;
+
+  std::vector<float> ex, ey, ez;
+  std::vector<float> hx, hy, hz;
+  std::vector<float> epsilon;
+  std::vector<std::pair<size_t, float>> emission;
+
+  std::vector<FDTDProbe> probeList;
+  std::vector<std::vector<ProbeSample>> probeHistory;
+
+  std::vector<float> dftFrequencies;
+  std::vector<std::vector<glm::vec2>> dftAccumulators;
+  int dftSampleCount;
+
+  void updateE();
+  void updateH();
+  float boundaryDamping(int x, int y, int z) const;
+  static bool isInside(const SceneGeometry &spatialIndex,
+                       const glm::vec3 &point);
+};
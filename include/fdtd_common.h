@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Types and helpers shared by the GPU and CPU FDTD solvers (no GL here)
+
+// Field point sampled every step; `id` is the caller's identifier (node id)
+struct FDTDProbe {
+  int id;
+  glm::ivec3 cell;
+};
+
+struct ProbeSample {
+  float ex, ey, ez;
+  float hx, hy, hz;
+};
+
+// Result of the periodic steady-state check. Deltas are the largest change of
+// any 8^3 brick since the previous check, relative to the largest brick
+struct ConvergenceStatus {
+  bool converged = false;
+  int step = 0;             // Solver step the statistics were taken at
+  float energyDelta = 1.0f; // Field energy (E^2 + H^2)
+  float dftDelta = 1.0f;    // DFT amplitude, 0 while no DFT is running
+  float totalEnergy = 0.0f;
+  int stableChecks = 0; // Consecutive checks under tolerance
+};
+
+// World position -> clamped grid cell for a grid spanning
+// gridCenter +/- gridHalfSize
+inline glm::ivec3 worldToGrid(const glm::vec3 &worldPos,
+                              const glm::vec3 &gridCenter,
+                              const glm::vec3 &gridHalfSize, int gridSize) {
+  glm::vec3 localPos = worldPos - gridCenter;
+  glm::vec3 gridPos = (localPos / gridHalfSize) * 0.5f + 0.5f;
+
+  glm::ivec3 cell(static_cast<int>(gridPos.x * gridSize),
+                  static_cast<int>(gridPos.y * gridSize),
+                  static_cast<int>(gridPos.z * gridSize));
+  return glm::clamp(cell, glm::ivec3(0), glm::ivec3(gridSize - 1));
+}
+
+// Lossy-medium term sigma * dt / (2 * eps0) for the E update. Each cell
+// divides it by its relative permittivity and applies
+//   E' = (1 - a) / (1 + a) * E + dt / (eps * (1 + a)) * curl(H)
+inline float conductivityLoss(float conductivity, float timeStep) {
+  const double eps0 = 8.8541878128e-12;
+  return static_cast<float>(conductivity * static_cast<double>(timeStep) /
+                            (2.0 * eps0));
+}
+
+// Cubic grid resolution that gives roughly `voxelSpacing` meters per voxel
+// along the longest axis, clamped to what the solver can run interactively
+inline int gridSizeForSpacing(const glm::vec3 &gridHalfSize,
+                              float voxelSpacing) {
+  float longest = std::max(std::max(gridHalfSize.x, gridHalfSize.y),
+                           gridHalfSize.z);
+  int size = static_cast<int>(std::ceil(longest * 2.0f / voxelSpacing));
+  return std::min(std::max(size, 32), 128);
+}
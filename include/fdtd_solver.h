@@ -1,12 +1,17 @@
 #pragma once
 
+#include "fdtd_common.h"
+
 #include <GL/glew.h>
+#include <deque>
+#include <functional>
 #include <glm/glm.hpp>
 #include <vector>
 
 // Forward declarations
 struct Triangle;
-class SpatialIndex;
+class GpuProfiler;
+class SceneGeometry;
 
 class FDTDSolver {
 public:
@@ -27,7 +32,7 @@ public:
   // GPU-based geometry marking (extremely fast)
   void markGeometryGPU(const glm::vec3 &gridCenter,
                        const glm::vec3 &gridHalfSize,
-                       const SpatialIndex &spatialIndex,
+                       const SceneGeometry &spatialIndex,
                        float groundLevel = 0.0f, float materialEpsilon = 50.0f);
 
   // Getters for textures (for rendering)
@@ -40,8 +45,90 @@ public:
   GLuint getEpsilonTexture() const { return texEpsilon; }
   GLuint getMuTexture() const { return texMu; }
   GLuint getEmissionTexture() const { return texEmission; }
+  // R8, 1 on material cells with air among their six neighbours; rebuilt
+  // whenever the geometry is marked
+  GLuint getEdgeMaskTexture() const { return texEdgeMask; }
 
   int getGridSize() const { return gridSize; }
+  // Steps run since initialization, never reset
+  int getStepCount() const { return stepCount; }
+
+  // Coarse occupancy for the volume renderer: one RGBA32F texel per
+  // BRICK_SIZE^3 brick holding max |Ez|, the max raw |DFT| of each
+  // accumulator (times getDFTNormalization() for the phasor) and flags
+  // (1 = emission source, 2 = geometry edge). The maxima include a one-cell
+  // border. Rebuilt only when something changed since the last call
+  static const int BRICK_SIZE = 8;
+  void updateBrickVolume();
+  GLuint getBrickTexture() const { return texBrick; }
+
+  // Probes sample E/H into a GPU ring buffer every step; completed blocks of
+  // probeReadInterval steps are picked up through a persistently mapped
+  // buffer (or, without GL 4.4 / ARB_buffer_storage, by mapping the block)
+  // once their fence has signalled, so reading never stalls
+  void setProbes(const std::vector<FDTDProbe> &probes);
+  int getProbeCount() const { return static_cast<int>(probeList.size()); }
+  int findProbe(int id) const;
+  const std::deque<ProbeSample> &getProbeHistory(int index) const {
+    return probeHistory[index];
+  }
+  // Mean Ez power over the last `window` samples, in dB
+  float getProbeRSSI(int index, int window = 256) const;
+  void setProbeReadInterval(int steps);
+
+  // Running DFT of Ez at up to MAX_DFT_FREQUENCIES frequencies, accumulated
+  // inside the E update over a sub-volume (size 0 on an axis = whole axis).
+  // Changing frequencies or region restarts accumulation.
+  static const int MAX_DFT_FREQUENCIES = 2;
+  void setDFTFrequencies(const std::vector<float> &frequencies);
+  void setDFTRegion(const glm::ivec3 &regionMin, const glm::ivec3 &regionSize);
+  void resetDFT();
+  int getDFTFrequencyCount() const {
+    return static_cast<int>(dftFrequencies.size());
+  }
+  float getDFTFrequency(int index) const { return dftFrequencies[index]; }
+  GLuint getDFTTexture(int index) const { return texDFT[index]; }
+  int getDFTSampleCount() const { return dftSampleCount; }
+  // Scale that turns the raw accumulator into the steady-state phasor
+  float getDFTNormalization() const {
+    return dftSampleCount > 0 ? 2.0f / dftSampleCount : 0.0f;
+  }
+  // Clamped region actually covered by the accumulators
+  glm::ivec3 getDFTRegionMin() const;
+  glm::ivec3 getDFTRegionSize() const;
+  // Normalized complex Ez (re, im) over the region, x fastest
+  bool readDFT(int index, std::vector<glm::vec2> &field) const;
+
+  // Steady-state detection: every `intervalSteps` steps a GPU reduction
+  // collects per-brick energy (averaged over a whole number of source
+  // periods) and DFT amplitude; the result is read back one check later so
+  // it never stalls. After `stableChecks` consecutive checks
+  // under `tolerance` the callback fires once and, if stop-on-convergence is
+  // set, update() stops stepping until resetConvergence() or reset().
+  // intervalSteps = 0 disables the check.
+  void setConvergenceCheck(int intervalSteps, float tolerance,
+                           int stableChecks = 3);
+  void setConvergenceCallback(
+      std::function<void(const ConvergenceStatus &)> callback) {
+    convergenceCallback = callback;
+  }
+  void setStopOnConvergence(bool stop) { stopOnConvergence = stop; }
+  // Times the E/H updates and geometry marking when set
+  void setProfiler(GpuProfiler *gpuProfiler) { profiler = gpuProfiler; }
+  bool getStopOnConvergence() const { return stopOnConvergence; }
+  int getConvergenceInterval() const { return convergenceInterval; }
+  float getConvergenceTolerance() const { return convergenceTolerance; }
+  const ConvergenceStatus &getConvergenceStatus() const {
+    return convergenceStatus;
+  }
+  bool isHalted() const {
+    return stopOnConvergence && convergenceStatus.converged;
+  }
+  void resetConvergence();
+
+  // Seconds of simulated time per step, shared with the emission sources
+  float getTimeStep() const { return timeStep; }
+  void setTimeStep(float seconds) { timeStep = seconds; }
 
   // Voxel spacing controls (meters per voxel)
   float getVoxelSpacing() const { return voxelSpacing; }
@@ -62,15 +149,74 @@ private:
 
   // Material textures
   GLuint texEpsilon, texMu, texEmission;
+  GLuint texEdgeMask;
 
   // Compute shader programs
   GLuint updateEProgram;
   GLuint updateHProgram;
   GLuint markGeometryProgram;
+  GLuint edgeMaskProgram;
 
   // SSBO for triangle geometry
   GLuint triangleSSBO;
 
+  // Probe sampling
+  GLuint probeProgram;
+  GLuint probeCellSSBO;
+  GLuint probeRingSSBO;
+  const ProbeSample *probeRingPtr;
+  std::vector<FDTDProbe> probeList;
+  std::vector<std::deque<ProbeSample>> probeHistory;
+  std::vector<GLsync> probeBlockFences;
+  int probeReadInterval;
+  int probeStep;
+
+  // DFT accumulators (RG32F, real/imaginary)
+  GLuint texDFT[MAX_DFT_FREQUENCIES];
+  std::vector<float> dftFrequencies;
+  glm::ivec3 dftRegionMin;
+  glm::ivec3 dftRegionSize;
+  int dftSampleCount;
+  float timeStep;
+  int stepCount;
+
+  // Brick occupancy volume
+  GLuint brickVolumeProgram;
+  GLuint texBrick;
+  bool brickVolumeDirty;
+
+  // Convergence check (double-buffered brick statistics)
+  GLuint convergenceProgram;
+  GLuint brickSSBO[2];
+  GLsync brickFences[2];
+  int brickCheckIndex;
+  int convergenceStartStep;
+  std::vector<glm::vec2> brickStats;
+  std::vector<glm::vec2> previousBrickStats;
+  int convergenceInterval;
+  float convergenceTolerance;
+  int convergenceStableChecks;
+  bool stopOnConvergence;
+  ConvergenceStatus convergenceStatus;
+  int pendingCheckStep[2];
+  std::function<void(const ConvergenceStatus &)> convergenceCallback;
+
+  GpuProfiler *profiler;
+
+  static const int PROBE_RING_BLOCKS = 3;
+  static const size_t PROBE_HISTORY_LENGTH = 4096;
+
+  void releaseProbes();
+  void sampleProbes();
+  void readProbeBlock(int block, bool wait);
+  void releaseDFT();
+  void releaseConvergence();
+  int convergenceWindow() const;
+  void reduceBricks(bool accumulate, bool includeDFT);
+  void evaluateBricks(int buffer);
+  void allocateDFT();
+  void updateEdgeMask();
+
   GLuint createTexture3D(int size);
   GLuint createComputeProgram(const char *shaderPath);
   GLuint compileShader(const char *source, GLenum type);
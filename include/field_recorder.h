@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records a sequence of scalar field snapshots into one file. Frames are
+// queued from any thread (typically an AsyncReadback callback) and
+// compressed and written on a worker thread; when the worker falls
+// MAX_QUEUED frames behind, new frames are dropped rather than buffered.
+//
+// File layout, little-endian: "HFRC", uint32 version, int32 nx, ny, nz,
+// then per frame uint64 step, uint32 word count and that many 32-bit
+// words of run-length encoded floats. Each packet is an int32 n followed
+// by n literal floats when n > 0, or by one float repeated -n times.
+class FieldRecorder {
+public:
+  static constexpr size_t MAX_QUEUED = 8;
+
+  FieldRecorder();
+  ~FieldRecorder();
+
+  // Starts a new file for fields of `size` cells, stopping any recording
+  bool start(const std::string &path, const glm::ivec3 &size);
+  // Writes the frames still queued, then closes the file
+  void stop();
+  bool isRecording() const;
+
+  // Frames must hold size.x * size.y * size.z values (x fastest). False
+  // when dropped: not recording, wrong size or queue full
+  bool enqueue(uint64_t step, std::vector<float> &&values);
+
+  // Record every `steps` solver steps; read by the caller
+  void setInterval(int steps) { interval = steps > 0 ? steps : 1; }
+  int getInterval() const { return interval; }
+
+  size_t getFramesWritten() const;
+  size_t getFramesDropped() const;
+  // Bytes written and raw float bytes they stand for
+  size_t getBytesWritten() const;
+  size_t getRawBytes() const;
+
+  static void encode(const std::vector<float> &values,
+                     std::vector<uint32_t> &words);
+
+private:
+  struct Frame {
+    uint64_t step;
+    std::vector<float> values;
+  };
+
+  std::thread worker;
+  mutable std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Frame> queue;
+  bool recording;
+  bool stopping;
+  std::ofstream file;
+  glm::ivec3 fieldSize;
+  int interval;
+
+  size_t framesWritten;
+  size_t framesDropped;
+  size_t bytesWritten;
+  size_t rawBytes;
+
+  void run();
+};
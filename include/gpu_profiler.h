@@ -0,0 +1,139 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Per-pass GPU timings from GL_TIME_ELAPSED queries plus CPU scope timings.
+//
+// Queries live in a ring of FRAME_LATENCY frame slots. A slot's results are
+// read back when the ring comes round to it again, by which time the GPU has
+// long finished, so reading never stalls the pipeline (a slot that is still
+// not ready is dropped instead). Time-elapsed queries cannot nest, so GPU
+// scopes must not overlap; CPU scopes may nest. While the Tracer is recording,
+// CPU scopes are also forwarded to it, even with the profiler disabled, and
+// read-back GPU passes go to its "GPU passes" track.
+class GpuProfiler {
+public:
+  static constexpr int FRAME_LATENCY = 4;
+  static constexpr int HISTORY_FRAMES = 240;
+
+  // Completed frame; indices follow getGpuPassNames() / getCpuStageNames()
+  struct FrameRecord {
+    unsigned long long frame = 0;
+    float cpuFrameMs = 0.0f;
+    std::vector<float> gpuMs;
+    std::vector<float> cpuMs; // Top-level CPU scopes only
+  };
+
+  GpuProfiler();
+  ~GpuProfiler();
+
+  // Deletes the query objects; needs the GL context
+  void cleanup();
+
+  void setEnabled(bool enabled) { enabledNextFrame = enabled; }
+  bool isEnabled() const { return enabledNextFrame; }
+
+  void beginFrame();
+  void endFrame();
+
+  // `name` must outlive the profiler (a string literal)
+  void beginGpu(const char *name);
+  void endGpu();
+  void beginCpu(const char *name);
+  void endCpu();
+
+  const std::vector<std::string> &getGpuPassNames() const {
+    return gpuPassNames;
+  }
+  const std::vector<std::string> &getCpuStageNames() const {
+    return cpuStageNames;
+  }
+  const std::deque<FrameRecord> &getHistory() const { return history; }
+  int getDroppedFrames() const { return droppedFrames; }
+
+private:
+  struct PendingQuery {
+    int nameIndex;
+    const char *traceName; // Null when not traced
+    uint64_t issueNs;      // Tracer time the pass was submitted
+  };
+
+  struct FrameSlot {
+    unsigned long long frame = 0;
+    bool pending = false;
+    std::vector<GLuint> queries; // Grows on demand, reused every lap
+    std::vector<PendingQuery> issued;
+    float cpuFrameMs = 0.0f;
+    std::vector<float> cpuMs;
+  };
+
+  struct OpenCpuScope {
+    int nameIndex; // -1 when only traced
+    double startUs;
+    const char *traceName; // Null when not traced
+    uint64_t traceStartNs;
+  };
+
+  bool enabled;
+  bool enabledNextFrame;
+  bool frameOpen;
+  int gpuDepth; // Nested GPU scopes; only the outermost is queried
+  unsigned long long frameCounter;
+  int droppedFrames;
+
+  FrameSlot slots[FRAME_LATENCY];
+  int currentSlot;
+  double frameStartUs;
+  std::vector<OpenCpuScope> cpuStack;
+
+  std::vector<std::string> gpuPassNames;
+  std::vector<std::string> cpuStageNames;
+  std::deque<FrameRecord> history;
+  int gpuTrack; // Tracer track, 0 until the first traced pass
+
+  std::chrono::steady_clock::time_point epoch;
+
+  double nowUs() const;
+  static int internName(std::vector<std::string> &names, const char *name);
+  void collectSlot(FrameSlot &slot);
+};
+
+// Scope guards; a null profiler makes them no-ops
+class GpuScope {
+public:
+  GpuScope(GpuProfiler *profiler, const char *name) : profiler(profiler) {
+    if (profiler)
+      profiler->beginGpu(name);
+  }
+  ~GpuScope() {
+    if (profiler)
+      profiler->endGpu();
+  }
+  GpuScope(const GpuScope &) = delete;
+  GpuScope &operator=(const GpuScope &) = delete;
+
+private:
+  GpuProfiler *profiler;
+};
+
+class CpuScope {
+public:
+  CpuScope(GpuProfiler *profiler, const char *name) : profiler(profiler) {
+    if (profiler)
+      profiler->beginCpu(name);
+  }
+  ~CpuScope() {
+    if (profiler)
+      profiler->endCpu();
+  }
+  CpuScope(const CpuScope &) = delete;
+  CpuScope &operator=(const CpuScope &) = delete;
+
+private:
+  GpuProfiler *profiler;
+};
@@ -0,0 +1,117 @@
+#pragma once
+#include "scene_geometry.h"
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+class RadioSystem;
+
+// One specular path between a transmitter and a receiver
+struct PropagationPath {
+  std::vector<glm::vec3> points; // Transmitter, reflection points, receiver
+  int bounces = 0;
+  float length = 0.0f;          // Meters
+  float delay = 0.0f;           // Seconds
+  float lossDb = 0.0f;          // Free-space plus reflection losses
+  float departureAzimuth = 0.0f; // Degrees, at the transmitter
+  float departureElevation = 0.0f;
+  float arrivalAzimuth = 0.0f; // Degrees, direction the signal arrives from
+  float arrivalElevation = 0.0f;
+};
+
+struct RadioLink {
+  int transmitterId = -1;
+  int receiverId = -1;
+  bool lineOfSight = false;
+  float bestLossDb = 0.0f;
+  float totalGainDb = -300.0f; // Incoherent sum over all paths
+  std::vector<PropagationPath> paths;
+};
+
+// Deterministic image-method solver for transmitter -> receiver links.
+//
+// Each transmitter owns an image tree (mirror images of its position across
+// candidate faces, up to maxBounces deep). Trees only depend on transmitter
+// position and geometry, so they are cached and receivers are validated
+// against them whenever a node changes.
+class ImageMethodSolver {
+public:
+  ImageMethodSolver();
+
+  // Does nothing when the geometry and the active nodes are unchanged since
+  // the last call
+  void computeLinks(const RadioSystem &radioSystem,
+                    const SceneGeometry &spatialIndex);
+  void invalidate() {
+    imageTrees.clear();
+    linksValid = false;
+  }
+
+  const std::vector<RadioLink> &getLinks() const { return links; }
+  const RadioLink *findLink(int transmitterId, int receiverId) const;
+
+  void setMaxBounces(int bounces);
+  void setSearchRadius(float radius);
+  void setMaxCandidateFaces(int count);
+  void setRelativePermittivity(float eps) {
+    relativePermittivity = eps;
+    linksValid = false;
+  }
+
+  int getMaxBounces() const { return maxBounces; }
+  float getSearchRadius() const { return searchRadius; }
+  int getMaxCandidateFaces() const { return maxCandidateFaces; }
+  float getRelativePermittivity() const { return relativePermittivity; }
+
+private:
+  struct ImageNode {
+    glm::vec3 image;
+    int parent;                // -1 for first-order images
+    unsigned int faceIndex;    // Index into ImageTree::faces
+  };
+
+  // What the links of one active node depend on
+  struct NodeInput {
+    int id;
+    bool transmitter;
+    glm::vec3 position;
+    float frequency;
+
+    bool operator==(const NodeInput &other) const {
+      return id == other.id && transmitter == other.transmitter &&
+             position == other.position && frequency == other.frequency;
+    }
+  };
+
+  struct ImageTree {
+    glm::vec3 position;
+    std::vector<Triangle> faces; // Candidate faces, copied from the geometry
+    std::vector<ImageNode> nodes;
+  };
+
+  int maxBounces;
+  float searchRadius;
+  int maxCandidateFaces;
+  float relativePermittivity;
+
+  const SceneGeometry *cachedSpatialIndex;
+  unsigned long long cachedGeneration;
+  std::unordered_map<int, ImageTree> imageTrees;
+  std::vector<NodeInput> cachedInputs;
+  bool linksValid;
+  std::vector<RadioLink> links;
+
+  void buildImageTree(const glm::vec3 &transmitter,
+                      const SceneGeometry &spatialIndex, ImageTree &tree) const;
+  void solveLink(const ImageTree &tree, const glm::vec3 &transmitter,
+                 const glm::vec3 &receiver, float frequency,
+                 const SceneGeometry &spatialIndex, RadioLink &link) const;
+  bool traceImagePath(const ImageTree &tree, int nodeIndex,
+                      const glm::vec3 &transmitter, const glm::vec3 &receiver,
+                      const SceneGeometry &spatialIndex,
+                      std::vector<glm::vec3> &points,
+                      std::vector<float> &incidenceCos) const;
+  void finalizePath(const std::vector<float> &incidenceCos, float frequency,
+                    PropagationPath &path) const;
+  float reflectionLossDb(float cosIncidence) const;
+};
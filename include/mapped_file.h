@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. Memory-mapped on POSIX systems so large
+// meshes are paged in on demand instead of copied; on Windows the file is
+// read into memory.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool open(const std::string &path);
+  void close();
+
+  bool isOpen() const { return opened; }
+  const char *data() const { return view; }
+  size_t size() const { return length; }
+
+private:
+  const char *view = nullptr;
+  size_t length = 0;
+  bool opened = false;
+  bool mapped = false;
+  std::vector<char> buffer; // Fallback storage when not mapped
+};
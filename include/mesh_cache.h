@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct ModelData;
+
+// Identifies the source OBJ a cache was built from: size, modification time
+// and an FNV-1a hash of evenly spaced samples of its contents (the whole file
+// when small), so edits that keep the size and timestamp are still caught
+// without reading every byte
+struct MeshCacheKey {
+  uint64_t fileSize = 0;
+  int64_t modifiedTime = 0;
+  uint64_t sampleHash = 0;
+
+  static bool fromFile(const std::string &path, MeshCacheKey &key);
+  bool operator==(const MeshCacheKey &other) const {
+    return fileSize == other.fileSize && modifiedTime == other.modifiedTime &&
+           sampleHash == other.sampleHash;
+  }
+};
+
+// Binary mesh cache (.hmesh) stored next to the OBJ. Positions are quantized
+// to 16 bits per axis within the mesh bounds and normals are oct-encoded to
+// two 16-bit values, so a vertex takes 12 bytes instead of 24. Loading maps
+// the file and decodes it in parallel.
+class MeshCache {
+public:
+  static bool save(const std::string &path, const ModelData &data,
+                   const MeshCacheKey &key);
+
+  // Fails (without printing) when the file is missing or was built from a
+  // different OBJ
+  static bool load(const std::string &path, const MeshCacheKey &key,
+                   ModelData &data);
+};
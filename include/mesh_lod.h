@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct ModelData;
+
+// One detail level of a cluster: a range of the combined index buffer
+// (ModelData::indices followed by MeshLod::indices)
+struct LodLevel {
+  unsigned int firstIndex;
+  unsigned int indexCount;
+  // Bound on how far (world units) the level's surface strays from the full
+  // detail one
+  float error;
+};
+
+struct MeshCluster {
+  glm::vec3 boundsMin;
+  glm::vec3 boundsMax;
+  // Range of MeshLod::levels, finest first; level 0 is the full-detail mesh
+  unsigned int firstLevel;
+  unsigned int levelCount;
+};
+
+// Simplified versions of a mesh split into spatial clusters. The vertices
+// and indices extend the mesh's own: indices here count vertices from the
+// start of ModelData::vertices, so both parts go into one buffer each.
+struct MeshLod {
+  std::vector<float> vertices;
+  std::vector<unsigned int> indices;
+  std::vector<MeshCluster> clusters;
+  std::vector<LodLevel> levels;
+
+  bool empty() const { return clusters.empty(); }
+};
+
+class MeshLodBuilder {
+public:
+  // Groups the triangles into clusters on an XZ grid (reordering
+  // data.indices so each cluster is contiguous) and simplifies every
+  // cluster into a chain of levels with quadric error edge collapses,
+  // halving the triangle count per level. Vertices on cluster borders stay
+  // put so neighbouring clusters at different levels do not crack.
+  static void build(ModelData &data);
+};
@@ -1,14 +1,30 @@
 #pragma once
+#include "mesh_lod.h"
 #include <string>
 #include <vector>
 
+// Indexed triangle mesh. Vertices are interleaved position + normal (6 floats);
+// OBJ corners that share a position and face normal share a vertex
 struct ModelData {
   std::vector<float> vertices;
   std::vector<unsigned int> indices;
   bool loaded = false;
+  // Decoded from the .hmesh cache, so positions carry its quantization error.
+  // Fine for drawing; ray tracing and the BVH need loadOBJ's full precision
+  bool quantized = false;
+  // Simplified levels for rendering, built with the mesh cache (empty for
+  // meshes straight from loadOBJ)
+  MeshLod lod;
 };
 
 class ModelLoader {
 public:
   static ModelData loadOBJ(const std::string &filepath);
+
+  // Loads from the binary mesh cache when it matches the OBJ, otherwise
+  // parses the OBJ, builds its LOD chain and writes the cache. An empty
+  // cachePath means the OBJ path with a .hmesh extension. Meshes read from
+  // the cache are marked quantized
+  static ModelData loadOBJCached(const std::string &filepath,
+                                 const std::string &cachePath = "");
 };
\ No newline at end of file
@@ -6,7 +6,7 @@
 #include <vector>
 
 class Camera;
-class SpatialIndex;
+class SceneGeometry;
 
 class NodeManager {
 public:
@@ -35,7 +35,7 @@ public:
                float maxDistance = 10000.0f);
   glm::vec3 pickPosition(const glm::vec3 &rayOrigin,
                          const glm::vec3 &rayDirection,
-                         const SpatialIndex *spatialIndex, bool &hit);
+                         const SceneGeometry *spatialIndex, bool &hit);
 
   // Screen to world ray conversion
   static void screenToWorldRay(int mouseX, int mouseY, int screenWidth,
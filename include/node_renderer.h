@@ -33,17 +33,48 @@ public:
   void cleanup();
 
 private:
-  // Sphere rendering for nodes
+  // Per-instance sphere attributes; all floats so instance lists compare
+  // with memcmp
+  struct NodeInstance {
+    glm::vec3 position;
+    float scale;
+    glm::vec3 color;
+    float selected;
+  };
+
+  // Sphere rendering for nodes, all drawn by one instanced call. The
+  // preview has its own single-instance buffer so it never dirties the
+  // node list
   GLuint nodeShaderProgram;
   GLuint sphereVAO, sphereVBO, sphereEBO;
   size_t sphereIndexCount;
+  GLuint instanceVBO;
+  size_t instanceCapacity;
+  GLuint previewVAO, previewInstanceVBO;
+
+  // Instances last uploaded, and the list built this frame to compare
+  std::vector<NodeInstance> instances;
+  std::vector<NodeInstance> frameInstances;
+
+  // Uniform locations, looked up once after linking
+  struct {
+    GLint view = -1, projection = -1, lightPos = -1, viewPos = -1;
+  } nodeUniforms;
 
   // Gizmo rendering
   GLuint gizmoShaderProgram;
   GLuint gizmoVAO, gizmoVBO;
   GizmoAxis highlightedAxis = GizmoAxis::NONE;
 
+  struct {
+    GLint view = -1, projection = -1, gizmoPosition = -1, axisColor = -1;
+  } gizmoUniforms;
+
   void createSphere(float radius, int segments);
+  void createInstancedVAO(GLuint &vao, GLuint &instanceBuffer,
+                          size_t instanceCount);
+  void updateInstances(const RadioSystem &radioSystem, int selectedNodeId);
+  void setNodeUniforms(const glm::mat4 &view, const glm::mat4 &projection);
   void createGizmo();
   bool rayIntersectCylinder(const glm::vec3 &rayOrigin,
                             const glm::vec3 &rayDirection,
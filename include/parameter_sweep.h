@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+class RadioSystem;
+class SceneGeometry;
+struct SceneData;
+
+// One swept parameter and the values it takes. Positions are swept per node
+// (by name); frequency applies to every active transmitter
+struct SweepAxis {
+  enum class Parameter { FREQUENCY, CONDUCTIVITY, MATERIAL_EPSILON, POSITION };
+
+  Parameter parameter = Parameter::FREQUENCY;
+  std::string nodeName;             // POSITION only
+  std::vector<float> values;        // Scalar parameters
+  std::vector<glm::vec3> positions; // POSITION only
+
+  size_t size() const {
+    return parameter == Parameter::POSITION ? positions.size() : values.size();
+  }
+};
+
+// One point of the sweep grid; NAN (or no position entry) keeps the scene's
+// own value
+struct SweepVariant {
+  size_t index = 0;
+  float frequency = NAN;
+  float conductivity = NAN;
+  float materialEpsilon = NAN;
+  std::vector<std::pair<std::string, glm::vec3>> positions;
+};
+
+struct SweepSettings {
+  bool runRays = true;
+  bool runFDTD = true;
+  int steps = 2000;
+  int gridSize = 0; // 0 = derive from the scene's voxel spacing
+  float emissionStrength = 0.5f;
+  float coverageCellSize = 10.0f;
+  int workers = 0;               // 0 = one per hardware thread
+  size_t memoryLimitMB = 4096;   // Caps workers * per-solver memory
+  float materialEpsilon = 50.0f; // When not swept, same as the viewer
+};
+
+// Metrics for one receiver in one variant (one row of the output table).
+// NAN marks a metric that was not computed
+struct ReceiverMetrics {
+  int receiverId = -1;
+  std::string receiverName;
+
+  // Rays / image method
+  float coverage = NAN; // Ray coverage at the receiver's cell
+  int bestTransmitterId = -1;
+  bool lineOfSight = false;
+  int paths = 0;
+  float bestLossDb = NAN;
+  float totalGainDb = NAN; // Incoherent sum over transmitters and paths
+
+  // FDTD
+  float rssiDb = NAN;
+  float dftFrequency[2] = {NAN, NAN};
+  float dftAmplitudeDb[2] = {NAN, NAN};
+};
+
+// Runs every combination of a set of parameter axes against one scene.
+//
+// The mesh, BVH and the voxelized occupancy of the FDTD grid are built once
+// and shared read-only; the grid is placed to cover every candidate node
+// position so a single voxelization serves all variants. Variants are pulled
+// from a shared counter by a pool of worker threads, each owning one
+// RadioSystem, ImageMethodSolver and CPUFDTDSolver that are reused between
+// variants. The pool is sized so workers * solver memory fits the limit.
+class ParameterSweep {
+public:
+  // Text file, one axis per line ('#' starts a comment):
+  //   frequency <hz> [<hz> ...]
+  //   conductivity <S/m> [...]
+  //   material_epsilon <eps> [...]
+  //   position <node name> <x,y,z> [<x,y,z> ...]
+  //   position_grid <node name> <min x,y,z> <max x,y,z> <nx,ny,nz>
+  bool loadFile(const std::string &path);
+  void addAxis(const SweepAxis &axis) { axes.push_back(axis); }
+  const std::vector<SweepAxis> &getAxes() const { return axes; }
+
+  // Cartesian product of all axes, last axis varying fastest
+  size_t getVariantCount() const;
+  SweepVariant getVariant(size_t index) const;
+
+  // Runs all variants and writes one CSV row per (variant, receiver)
+  bool run(const SweepSettings &settings, const RadioSystem &scene,
+           const SceneData &sceneData, const SceneGeometry &spatialIndex,
+           const std::string &outputPath);
+
+private:
+  std::vector<SweepAxis> axes;
+
+  // Value index along each axis for a variant index
+  std::vector<size_t> decodeIndex(size_t index) const;
+  bool writeTable(const std::string &path, const SweepSettings &settings,
+                  const std::vector<std::vector<ReceiverMetrics>> &results)
+      const;
+};
@@ -1,8 +1,11 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+class SceneGeometry;
+
 enum class NodeType { TRANSMITTER, RECEIVER, RELAY };
 
 struct RadioSource {
@@ -58,6 +61,25 @@ struct SignalRay {
   int bounces;
   glm::vec3 color;
   std::vector<glm::vec3> points;
+  float weight = 1.0f; // Launch solid angle relative to a base-level tube
+};
+
+// Ground-plane raster of accumulated ray strength (XZ plane, row-major in z)
+struct CoverageMap {
+  glm::vec3 origin = glm::vec3(0.0f); // World-space min corner
+  float cellSize = 10.0f;
+  int width = 0;
+  int height = 0;
+  std::vector<float> values;
+
+  bool isValid() const { return width > 0 && height > 0; }
+  int cellIndex(const glm::vec3 &p) const {
+    int cx = static_cast<int>((p.x - origin.x) / cellSize);
+    int cz = static_cast<int>((p.z - origin.z) / cellSize);
+    if (cx < 0 || cx >= width || cz < 0 || cz >= height)
+      return -1;
+    return cz * width + cx;
+  }
 };
 
 class RadioSystem {
@@ -76,25 +98,73 @@ public:
 
   void update(float deltaTime);
 
-  void computeSignalPropagation(const class SpatialIndex *spatialIndex);
+  // Only sources whose cached result is stale are retraced; their coverage
+  // contribution is swapped out of the total in place.
+  void computeSignalPropagation(const SceneGeometry *spatialIndex);
+
+  // Drop cached propagation for one source (or all) so the next
+  // computeSignalPropagation() retraces it
+  void invalidateSource(int id);
+  void invalidateAll();
 
   const std::vector<RadioSource> &getSources() const { return sources; }
   std::vector<RadioSource> &getSources() { return sources; }
   const std::vector<SignalRay> &getSignalRays() const { return signalRays; }
+  const CoverageMap &getCoverage() const { return coverage; }
 
-  void setRaysPerSource(int count) { raysPerSource = count; }
-  void setMaxBounces(int count) { maxBounces = count; }
-  void setMaxDistance(float dist) { maxDistance = dist; }
+  void setRaysPerSource(int count);
+  void setMaxBounces(int count);
+  void setMaxDistance(float dist);
+  // Extra subdivision levels applied to ray tubes whose corner rays diverge
+  void setMaxRefinementDepth(int depth);
+
+  // Coverage raster over [min, max] in XZ; resizing invalidates every source
+  void setCoverageArea(const glm::vec3 &min, const glm::vec3 &max,
+                       float cellSize);
 
 private:
+  // Per-source propagation result plus the inputs it was computed from
+  struct SourcePropagation {
+    glm::vec3 position;
+    float frequency;
+    NodeType type;
+    bool dirty = true;
+    std::vector<SignalRay> rays;
+    std::vector<float> coverage; // Same layout as CoverageMap::values
+  };
+
   std::vector<RadioSource> sources;
   std::vector<SignalRay> signalRays;
 
+  std::unordered_map<int, SourcePropagation> propagationCache;
+  CoverageMap coverage;
+  const SceneGeometry *cachedSpatialIndex;
+  unsigned long long cachedGeneration;
+
   int nextNodeId;
   int raysPerSource;
   int maxBounces;
   float maxDistance;
-
-  float calculatePathLoss(float distance, float frequency);
-  float calculateReflectionLoss(const glm::vec3 &normal);
+  int maxRefinementDepth;
+
+  // One launched ray plus the first-hit data used to decide tube splitting
+  struct LaunchSample {
+    SignalRay ray;
+    bool hit = false;
+    float range = 0.0f;
+    glm::vec3 point = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+  };
+
+  void traceSource(const RadioSource &source, const SceneGeometry *spatialIndex,
+                   SourcePropagation &result);
+  LaunchSample traceRay(const RadioSource &source, const glm::vec3 &direction,
+                        const SceneGeometry *spatialIndex) const;
+  static bool tubeDiverges(const LaunchSample &a, const LaunchSample &b);
+  void depositCoverage(const SignalRay &ray, float frequency,
+                       std::vector<float> &target) const;
+  void applyContribution(const std::vector<float> &contribution, float sign);
+
+  float calculatePathLoss(float distance, float frequency) const;
+  float calculateReflectionLoss(const glm::vec3 &normal) const;
 };
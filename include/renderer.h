@@ -3,8 +3,11 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
+#include "model_loader.h"
 #include "visual_settings.h"
 
 class Renderer {
@@ -19,18 +22,118 @@ public:
 
   void setVisualSettings(const VisualSettings &settings) { visualSettings = settings; }
 
+  // Replaces every mesh with a single one
   void setModelData(const std::vector<float> &vertices,
                     const std::vector<unsigned int> &indices);
 
+  // Meshes drawn together, keyed by the caller (tile index when streaming).
+  // Adding an existing key replaces its buffers
+  void addMesh(int key, const std::vector<float> &vertices,
+               const std::vector<unsigned int> &indices);
+  void removeMesh(int key);
+  void clearMeshes();
+
+  // Like addMesh, but the buffers are filled over the following frames by
+  // processUploads; until then the triangles uploaded so far are drawn. A
+  // mesh with LOD data is drawn per cluster at the coarsest level within
+  // VisualSettings::lodPixelError once it has fully arrived
+  void queueMesh(int key, std::shared_ptr<const ModelData> data);
+  // Copies up to byteBudget bytes of queued meshes to the GPU. Returns true
+  // while uploads remain
+  bool processUploads(size_t byteBudget);
+
+  // Triangles submitted by the last render() and at full detail. With GPU
+  // culling the submitted counts trail by a frame or so
+  size_t getDrawnTriangleCount() const { return drawnTriangles; }
+  size_t getFullTriangleCount() const { return fullTriangles; }
+  // Clusters that passed culling, and all clusters of the drawn meshes
+  size_t getVisibleClusterCount() const { return visibleClusters; }
+  size_t getClusterCount() const { return totalClusters; }
+
+  // The depth buffer as a single-sampled texture, copied by the first call
+  // after render() and reused until the next one. 0 if the window's depth
+  // format cannot be copied
+  GLuint resolveSceneDepth();
+
 private:
+  struct Mesh {
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    size_t indexCount = 0;
+    // Empty until the upload completes, then draws go per cluster
+    std::vector<MeshCluster> clusters;
+    std::vector<LodLevel> levels;
+    // Copies of clusters and levels for the cull shader, and the indirect
+    // draw it writes per cluster
+    GLuint clusterBuffer = 0, levelBuffer = 0, commandBuffer = 0;
+  };
+
+  struct PendingUpload {
+    std::shared_ptr<const ModelData> data;
+    size_t vertexBytesDone = 0;
+    size_t indexBytesDone = 0;
+  };
+
   GLuint shaderProgram;
-  GLuint VAO, VBO, EBO;
+  std::map<int, Mesh> meshes;
+
+  // Uniform locations, looked up once after linking
+  struct {
+    GLint model = -1, view = -1, projection = -1;
+    GLint lightPos = -1, lightColor = -1, viewPos = -1;
+    GLint enableFog = -1, fogDensity = -1, fogColor = -1;
+  } sceneUniforms;
+  struct {
+    GLint frustumPlanes = -1, cameraPos = -1, enableLod = -1, lodScale = -1;
+    GLint useOcclusion = -1, hiZLevels = -1, viewportSize = -1;
+    GLint previousMVP = -1, recordStats = -1, clusterCount = -1;
+  } cullUniforms;
+  GLint hiZSourceLevelLoc = -1;
+  std::map<int, PendingUpload> uploads;
+
+  // glMultiDrawElements arguments, reused across frames
+  std::vector<GLsizei> drawCounts;
+  std::vector<const void *> drawOffsets;
+  size_t drawnTriangles;
+  size_t fullTriangles;
+  size_t visibleClusters;
+  size_t totalClusters;
+
+  // GPU cluster culling: frustum, LOD selection and occlusion against a
+  // farthest-depth pyramid (HiZ) of the previous frame. Without compute
+  // shaders clusters are frustum culled on the CPU instead
+  GLuint cullProgram;
+  GLuint hiZProgram;
+  bool occlusionSupported;
+  bool depthCopySupported, depthResolved;
+  GLuint depthTexture, depthFBO, hiZTexture;
+  int hiZWidth, hiZHeight, hiZLevels;
+  bool hiZValid;
+  glm::mat4 hiZMVP;
+  // [visible clusters, drawn triangles] of the culled meshes, read back
+  // once the fence says they are ready
+  GLuint statsBuffer;
+  GLsync statsFence;
+  size_t gpuVisibleClusters;
+  size_t gpuDrawnTriangles;
 
-  size_t indexCount;
   VisualSettings visualSettings;
 
+  Mesh &createMesh(int key, size_t vertexBytes, const void *vertices,
+                   size_t indexBytes, const void *indices);
+  void deleteMesh(Mesh &mesh);
+  void createClusterBuffers(Mesh &mesh);
+  void deleteClusterBuffers(Mesh &mesh);
+
+  void cullClusters(const glm::vec4 planes[6], const glm::vec3 &cameraPos,
+                    float lodScale, int width, int height);
+  void updateHiZ(const glm::mat4 &mvp);
+  void createHiZ(int width, int height);
+  void deleteHiZ();
+  void readCullStats();
+
   GLuint compileShader(const std::string &source, GLenum type);
   GLuint createShaderProgram(const std::string &vertexSource,
                              const std::string &fragmentSource);
+  GLuint createComputeProgram(const char *shaderPath);
   char *loadShaderSource(const char *path);
 };
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cfloat>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+struct Triangle {
+  glm::vec3 v0, v1, v2;
+  glm::vec3 normal;
+  unsigned int id;
+};
+
+struct BoundingBox {
+  glm::vec3 min;
+  glm::vec3 max;
+
+  BoundingBox() : min(glm::vec3(FLT_MAX)), max(glm::vec3(-FLT_MAX)) {}
+  BoundingBox(const glm::vec3 &min, const glm::vec3 &max)
+      : min(min), max(max) {}
+
+  void expand(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  void expand(const BoundingBox &box) {
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+  }
+
+  glm::vec3 centroid() const { return (min + max) * 0.5f; }
+
+  bool overlaps(const BoundingBox &box) const {
+    return min.x <= box.max.x && max.x >= box.min.x && min.y <= box.max.y &&
+           max.y >= box.min.y && min.z <= box.max.z && max.z >= box.min.z;
+  }
+
+  float surfaceArea() const {
+    glm::vec3 d = max - min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+
+  bool intersect(const glm::vec3 &origin, const glm::vec3 &direction,
+                 float tMin, float tMax) const {
+    for (int i = 0; i < 3; i++) {
+      float invD = 1.0f / direction[i];
+      float t0 = (min[i] - origin[i]) * invD;
+      float t1 = (max[i] - origin[i]) * invD;
+      if (invD < 0.0f)
+        std::swap(t0, t1);
+      tMin = t0 > tMin ? t0 : tMin;
+      tMax = t1 < tMax ? t1 : tMax;
+      if (tMax <= tMin)
+        return false;
+    }
+    return true;
+  }
+};
+
+struct Ray {
+  glm::vec3 origin;
+  glm::vec3 direction;
+  float tMin = 0.001f;
+  float tMax = 10000.0f;
+};
+
+struct RayHit {
+  bool hit = false;
+  float distance = FLT_MAX;
+  glm::vec3 point;
+  glm::vec3 normal;
+  unsigned int triangleId = 0;
+};
+
+// Read-only triangle geometry the simulation queries: rays, box queries and
+// bounds. Implemented by SpatialIndex (one mesh, one BVH) and TileManager
+// (tiled datasets with streamed per-tile BVHs)
+class SceneGeometry {
+public:
+  virtual ~SceneGeometry() = default;
+
+  virtual RayHit intersect(const Ray &ray) const = 0;
+  virtual bool intersectAny(const Ray &ray) const = 0;
+
+  // Copies of the triangles whose bounds overlap `box`
+  virtual void queryTriangles(const BoundingBox &box,
+                              std::vector<Triangle> &triangles) const = 0;
+
+  virtual const BoundingBox &getBounds() const = 0;
+  virtual bool isEmpty() const = 0;
+
+  // Changes whenever the triangles change, so callers holding results
+  // derived from them (traced rays, image trees) know to rebuild
+  virtual unsigned long long getGeneration() const { return 0; }
+};
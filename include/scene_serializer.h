@@ -4,40 +4,44 @@
 #include <string>
 
 // Forward declarations
-class NodeManager;
-class FDTDSolver;
-class Camera;
-class VolumeRenderer;
+class RadioSystem;
 
+// Defaults match a fresh viewer session, so files missing a section (and
+// headless runs) still get sensible values
 struct SceneData {
   // Camera settings
-  glm::vec3 cameraPosition;
-  float cameraYaw;
-  float cameraPitch;
+  glm::vec3 cameraPosition = glm::vec3(0.0f, 100.0f, 500.0f);
+  float cameraYaw = -90.0f;
+  float cameraPitch = -10.0f;
 
   // Grid settings
-  glm::vec3 fdtdGridHalfSize;
-  float voxelSpacing;
-  float conductivity;
+  glm::vec3 fdtdGridHalfSize = glm::vec3(200.0f);
+  float voxelSpacing = 5.0f;
+  float conductivity = 0.0001f;
 
   // Visualization settings
-  glm::vec3 gradientColorLow;
-  glm::vec3 gradientColorHigh;
-  bool showEmissionSource;
-  bool showGeometryEdges;
+  glm::vec3 gradientColorLow = glm::vec3(0.0f, 0.0f, 0.5f);
+  glm::vec3 gradientColorHigh = glm::vec3(1.0f, 0.0f, 0.0f);
+  bool showEmissionSource = true;
+  bool showGeometryEdges = false;
 };
 
 class SceneSerializer {
 public:
   // Save scene to file
   static bool saveScene(const std::string &filepath,
-                        const NodeManager *nodeManager,
+                        const RadioSystem &radioSystem,
                         const SceneData &sceneData);
 
-  // Load scene from file
-  static bool loadScene(const std::string &filepath, NodeManager *nodeManager,
+  // Load scene from file, replacing every node in `radioSystem`
+  static bool loadScene(const std::string &filepath, RadioSystem &radioSystem,
                         SceneData &sceneData);
 
+  // Strict parsing for command lines and sweep files: the whole string must
+  // be a finite number ("x,y,z" for vectors), with no trailing characters
+  static bool parseFloat(const std::string &str, float &result);
+  static bool parseVec3(const std::string &str, glm::vec3 &result);
+
 private:
   // Helper functions for parsing
   static std::string serializeVec3(const glm::vec3 &v);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+
+// Paces the FDTD solver at a target number of steps per second, whatever
+// the frame rate. Each frame owes the steps its share of wall time is worth
+// and dispatches them as one batch ahead of rendering, so the frame always
+// shows the latest step.
+//
+// A batch is capped by a per-frame GPU time budget. Step costs come from
+// timestamp queries read back when the ring of QUERY_LATENCY slots comes
+// round again, so measuring never stalls. Steps the budget cannot cover are
+// dropped rather than carried over; the achieved rate then falls short of
+// the target instead of the frame rate collapsing.
+class SimulationScheduler {
+public:
+  static constexpr int QUERY_LATENCY = 4;
+
+  SimulationScheduler();
+  ~SimulationScheduler();
+
+  // Deletes the query objects; needs the GL context
+  void cleanup();
+
+  void setTargetRate(float stepsPerSecond) { targetRate = stepsPerSecond; }
+  float getTargetRate() const { return targetRate; }
+  // GPU milliseconds per frame the steps may take
+  void setFrameBudget(float milliseconds) { frameBudgetMs = milliseconds; }
+  float getFrameBudget() const { return frameBudgetMs; }
+
+  // Steps to run for `elapsedSeconds` of wall time since the last batch.
+  // Dispatch them, then call endBatch() with the cells each step updates
+  int beginBatch(double elapsedSeconds);
+  void endBatch(size_t cellsPerStep);
+  // Forgets owed steps (while paused), so resuming does not catch up
+  void reset();
+
+  // Averaged over about half a second
+  float getAchievedRate() const { return achievedRate; }
+  float getMegacellsPerSecond() const { return megacellsPerSecond; }
+  // Smoothed GPU time of one step; 0 until the first batch is measured
+  float getStepCostMs() const { return stepCostMs; }
+  // The last batch ran fewer steps than owed
+  bool isBudgetLimited() const { return budgetLimited; }
+
+private:
+  struct QuerySlot {
+    GLuint start = 0, end = 0;
+    int steps = 0;
+    bool pending = false;
+  };
+
+  float targetRate;
+  float frameBudgetMs;
+  double owedSteps;
+  int batchSteps;
+  bool budgetLimited;
+
+  QuerySlot slots[QUERY_LATENCY];
+  int currentSlot;
+  bool timing; // The open batch issued a start timestamp
+  float stepCostMs;
+
+  double windowSeconds;
+  double windowSteps;
+  double windowCells;
+  float achievedRate;
+  float megacellsPerSecond;
+
+  void collectSlot(QuerySlot &slot);
+};
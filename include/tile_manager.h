@@ -0,0 +1,94 @@
+#pragma once
+
+#include "model_loader.h"
+#include "scene_geometry.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class SpatialIndex;
+
+// One tile of a tiled dataset, as listed in the manifest
+struct TileInfo {
+  std::string objPath;
+  BoundingBox bounds;
+};
+
+// Streams the tiles of a dataset too large to hold at once. Tiles that
+// overlap a focus region (around the camera, the FDTD grid) are loaded, each
+// with its own BVH (cached next to the tile as .bvh, with its mesh in
+// .hmesh); queries go through a flat top level over the resident tiles'
+// bounds. Tiles that fall out of every region stay resident until the memory
+// budget forces the least recently used ones out.
+//
+// Loading and eviction only happen in update(); queries may run on any
+// number of threads as long as update() is not called concurrently.
+class TileManager : public SceneGeometry {
+public:
+  TileManager();
+  ~TileManager() override;
+
+  // One tile per line ('#' starts a comment), paths relative to the manifest:
+  //   tile <file.obj> <min x,y,z> <max x,y,z>
+  bool loadManifest(const std::string &path);
+
+  void setMemoryBudgetMB(size_t megabytes) { memoryBudget = megabytes << 20; }
+  size_t getMemoryBudgetMB() const { return memoryBudget >> 20; }
+
+  // Keep each loaded tile's render mesh until takeLoadedMeshes() collects it
+  void setKeepMeshes(bool keep) { keepMeshes = keep; }
+
+  // Loads every tile overlapping one of `regions`, then evicts the least
+  // recently used tiles outside them while over budget. Returns true when
+  // the resident set changed
+  bool update(const std::vector<BoundingBox> &regions);
+
+  // Tile index and mesh of tiles loaded since the last call
+  std::vector<std::pair<int, ModelData>> takeLoadedMeshes();
+  // Tile indices evicted since the last call
+  std::vector<int> takeEvictedTiles();
+
+  int getTileCount() const { return static_cast<int>(tiles.size()); }
+  const TileInfo &getTile(int index) const { return tiles[index]; }
+  int getResidentCount() const { return static_cast<int>(resident.size()); }
+  size_t getResidentBytes() const { return residentBytes; }
+  const BoundingBox &getDatasetBounds() const { return datasetBounds; }
+
+  // SceneGeometry
+  RayHit intersect(const Ray &ray) const override;
+  bool intersectAny(const Ray &ray) const override;
+  void queryTriangles(const BoundingBox &box,
+                      std::vector<Triangle> &triangles) const override;
+  // Bounds of the resident geometry (the whole dataset while none is loaded)
+  const BoundingBox &getBounds() const override;
+  bool isEmpty() const override { return resident.empty(); }
+  unsigned long long getGeneration() const override { return generation; }
+
+private:
+  struct ResidentTile {
+    int tile;
+    std::unique_ptr<SpatialIndex> index;
+    size_t bytes;
+    unsigned long long lastUsed;
+  };
+
+  std::vector<TileInfo> tiles;
+  std::vector<ResidentTile> resident;
+  BoundingBox datasetBounds;
+  BoundingBox residentBounds;
+
+  size_t memoryBudget;
+  size_t residentBytes;
+  bool keepMeshes;
+  unsigned long long useCounter;
+  unsigned long long generation;
+
+  std::vector<std::pair<int, ModelData>> loadedMeshes;
+  std::vector<int> evictedTiles;
+
+  int findResident(int tile) const;
+  bool loadTile(int tile);
+  void evictTile(size_t residentIndex);
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Records CPU scopes from any thread and writes them in Chrome trace-event
+// format (chrome://tracing, Perfetto).
+//
+// Each thread appends to its own buffer of fixed-size blocks without taking
+// a lock; the buffers are only walked by write(). Recording is off until
+// start() is called, so an idle TRACE_SCOPE costs one atomic load.
+class Tracer {
+public:
+  static void start() { enabled.store(true, std::memory_order_relaxed); }
+  static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+  // Label for the calling thread's row in the trace viewer
+  static void setThreadName(const std::string &name);
+
+  // Nanoseconds since the first call
+  static uint64_t nowNs();
+
+  // `name` must outlive the tracer (a string literal)
+  static void record(const char *name, uint64_t startNs, uint64_t endNs);
+
+  // Row for events that belong to no thread, such as GPU passes. Each track
+  // must only be recorded to from one thread
+  static int addTrack(const std::string &name);
+  static void record(int track, const char *name, uint64_t startNs,
+                     uint64_t endNs);
+
+  // Writes every event recorded so far, from all threads
+  static bool write(const std::string &path);
+
+private:
+  static inline std::atomic<bool> enabled{false};
+};
+
+class TraceScope {
+public:
+  explicit TraceScope(const char *name)
+      : name(Tracer::isEnabled() ? name : nullptr),
+        startNs(this->name ? Tracer::nowNs() : 0) {}
+  ~TraceScope() {
+    if (name)
+      Tracer::record(name, startNs, Tracer::nowNs());
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *name;
+  uint64_t startNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Times the enclosing scope; `name` must be a string literal
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
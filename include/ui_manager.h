@@ -5,8 +5,15 @@
 #include <string>
 #include "visual_settings.h"
 
+class AsyncReadback;
 class Camera;
+class FDTDSolver;
+class FieldRecorder;
+class GpuProfiler;
+class ImageMethodSolver;
 class NodeManager;
+class SimulationScheduler;
+struct RadioSource;
 
 class UIManager {
 public:
@@ -26,10 +33,10 @@ public:
 
   // Render FDTD controls (pass app state from main.cpp)
   void renderFDTDPanel(bool &fdtdEnabled, bool &fdtdPaused,
-                       int &simulationSpeed, float &emissionStrength,
-                       bool &continuousEmission, glm::vec3 &gridCenter,
-                       glm::vec3 &gridHalfSize, bool &autoCenterGrid,
-                       void *fdtdSolverPtr, void *volumeRendererPtr);
+                       float &emissionStrength, bool &continuousEmission,
+                       glm::vec3 &gridCenter, glm::vec3 &gridHalfSize,
+                       bool &autoCenterGrid, void *fdtdSolverPtr,
+                       void *volumeRendererPtr);
 
   // End frame and render ImGui
   void endFrame();
@@ -49,6 +56,28 @@ public:
   // Set scene data reference for save/load
   void setSceneDataPointers(void *sceneDataPtr);
 
+  // Set link solver whose results are shown for selected receivers
+  void setLinkSolver(const ImageMethodSolver *solver) { linkSolver = solver; }
+
+  // Set FDTD solver whose receiver probes are shown for selected receivers
+  void setProbeSolver(const FDTDSolver *solver) { probeSolver = solver; }
+
+  // Set profiler whose per-pass timings are shown in the Performance window
+  void setProfiler(GpuProfiler *gpuProfiler) { profiler = gpuProfiler; }
+
+  // Set recorder the FDTD panel starts and stops
+  void setFieldRecorder(FieldRecorder *recorder) { fieldRecorder = recorder; }
+
+  // Set readback feeding the recorder, whose lost copies the panel reports
+  void setFieldReadback(const AsyncReadback *readback) {
+    fieldReadback = readback;
+  }
+
+  // Set scheduler whose stepping rate the FDTD panel controls
+  void setSimulationScheduler(SimulationScheduler *scheduler) {
+    simulationScheduler = scheduler;
+  }
+
   // Check if scene was just loaded
   bool wasSceneLoaded() const { return sceneJustLoaded; }
   void clearSceneLoadedFlag() { sceneJustLoaded = false; }
@@ -79,7 +108,10 @@ public:
 private:
   void renderAboutWindow();
   void renderPerformanceWindow(float fps, float deltaTime);
+  void renderFrameBreakdown();
   void renderNodePanel(NodeManager *nodeManager, const Camera &camera);
+  void renderLinkInfo(const RadioSource &receiver);
+  void renderProbeInfo(const RadioSource &receiver);
 
   bool initialized = false;
   GLFWwindow *window = nullptr;
@@ -88,6 +120,13 @@ private:
   void *sceneDataPtr = nullptr;
   bool sceneJustLoaded = false;
 
+  const ImageMethodSolver *linkSolver = nullptr;
+  const FDTDSolver *probeSolver = nullptr;
+  GpuProfiler *profiler = nullptr;
+  SimulationScheduler *simulationScheduler = nullptr;
+  FieldRecorder *fieldRecorder = nullptr;
+  const AsyncReadback *fieldReadback = nullptr;
+
   // Performance tracking
   static const int FPS_SAMPLE_COUNT = 60;
   float fpsHistory[FPS_SAMPLE_COUNT] = {0};
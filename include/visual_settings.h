@@ -6,4 +6,12 @@ struct VisualSettings {
   bool enableFog = true;
   float fogDensity = 0.0003f;
   glm::vec3 fogColor = glm::vec3(0.5f, 0.7f, 1.0f);
+
+  // City level of detail: the coarsest level whose simplification error
+  // projects to at most this many pixels is drawn
+  bool enableLod = true;
+  float lodPixelError = 1.0f;
+
+  // Skip city clusters outside the view or hidden behind last frame's depth
+  bool enableCulling = true;
 };
@@ -3,6 +3,9 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+// What the volume shows: instantaneous Ez or the accumulated DFT of Ez
+enum class FieldDisplayMode { INSTANTANEOUS, DFT_AMPLITUDE, DFT_PHASE };
+
 class VolumeRenderer {
 public:
   VolumeRenderer();
@@ -11,7 +14,7 @@ public:
   bool initialize();
   void cleanup();
 
-  void render(GLuint fieldTexture, GLuint epsilonTexture,
+  void render(GLuint fieldTexture, GLuint edgeMaskTexture,
               GLuint emissionTexture, const glm::mat4 &view,
               const glm::mat4 &projection, const glm::vec3 &gridCenter,
               const glm::vec3 &gridHalfSize, int gridSize);
@@ -27,6 +30,39 @@ public:
   bool getShowEmissionSource() const { return showEmissionSource; }
   bool getShowGeometryEdges() const { return showGeometryEdges; }
 
+  // Frequency-domain display. The DFT texture covers the grid cells
+  // [regionMin, regionMin + regionSize) and is scaled by `normalization`
+  void setDisplayMode(FieldDisplayMode mode) { displayMode = mode; }
+  FieldDisplayMode getDisplayMode() const { return displayMode; }
+  void setDFTIndex(int index) { dftIndex = index; }
+  int getDFTIndex() const { return dftIndex; }
+  void setDFTField(GLuint texture, const glm::ivec3 &regionMin,
+                   const glm::ivec3 &regionSize, float normalization);
+
+  // Per-brick maxima from FDTDSolver::updateBrickVolume(). With skipping
+  // on, bricks too faint to show are stepped over and nearly empty ones
+  // marched at twice the step
+  void setBrickVolume(GLuint texture, int size) {
+    brickTexture = texture;
+    brickSize = size;
+  }
+  void setEmptySpaceSkipping(bool enabled) { emptySpaceSkipping = enabled; }
+  bool getEmptySpaceSkipping() const { return emptySpaceSkipping; }
+
+  // Depth to end rays at (Renderer::resolveSceneDepth()), 0 for none
+  void setSceneDepth(GLuint texture) { sceneDepthTexture = texture; }
+
+  // Below 1 the volume is marched offscreen at that fraction of the
+  // viewport, then upsampled over the scene with weights that keep it from
+  // bleeding across depth edges. Temporal accumulation jitters the samples
+  // along each ray and averages them with the reprojected earlier frames
+  void setResolutionScale(float scale) { resolutionScale = scale; }
+  float getResolutionScale() const { return resolutionScale; }
+  void setTemporalAccumulation(bool enabled) {
+    temporalAccumulation = enabled;
+  }
+  bool getTemporalAccumulation() const { return temporalAccumulation; }
+
   // Gradient color controls
   void setGradientColorLow(const glm::vec3 &color) { gradientColorLow = color; }
   void setGradientColorHigh(const glm::vec3 &color) {
@@ -38,6 +74,29 @@ public:
 private:
   GLuint vao, vbo;
   GLuint shaderProgram;
+  GLuint temporalProgram, upsampleProgram;
+
+  // Uniform locations, looked up once after linking; the samplers' texture
+  // units are fixed then too
+  struct {
+    GLint invView = -1, invProj = -1;
+    GLint gridCenter = -1, gridHalfSize = -1, gridSize = -1;
+    GLint intensityScale = -1, stepCount = -1;
+    GLint showEmissionSource = -1, showGeometryEdges = -1;
+    GLint gradientColorLow = -1, gradientColorHigh = -1;
+    GLint displayMode = -1, dftRegionMin = -1, dftRegionMax = -1;
+    GLint dftScale = -1;
+    GLint useBricks = -1, brickSize = -1, brickWeights = -1;
+    GLint useSceneDepth = -1, fullResScale = -1;
+    GLint jitterRays = -1, jitterOffset = -1;
+  } uniforms;
+  struct {
+    GLint invView = -1, invProj = -1;
+    GLint previousViewProj = -1, historyValid = -1;
+  } temporalUniforms;
+  struct {
+    GLint useSceneDepth = -1, fullResScale = -1, depthParams = -1;
+  } upsampleUniforms;
 
   // Visualization parameters
   float intensityScale;
@@ -45,10 +104,42 @@ private:
   bool showEmissionSource;
   bool showGeometryEdges;
 
+  // DFT display
+  FieldDisplayMode displayMode;
+  int dftIndex;
+  GLuint dftTexture;
+  glm::ivec3 dftRegionMin;
+  glm::ivec3 dftRegionSize;
+  float dftNormalization;
+
+  // Empty-space skipping
+  GLuint brickTexture;
+  int brickSize;
+  bool emptySpaceSkipping;
+
+  // Reduced-resolution rendering. The march writes color and ray distance
+  // into marchFBO; the two history targets take turns holding the
+  // accumulated result
+  GLuint sceneDepthTexture;
+  float resolutionScale;
+  bool temporalAccumulation;
+  GLuint marchFBO, marchColor, marchDepth;
+  GLuint historyFBO[2], historyColor[2];
+  int targetWidth, targetHeight;
+  int historyIndex;
+  bool historyValid;
+  glm::mat4 previousViewProj;
+  unsigned int frameIndex;
+
   // Gradient colors for waveform visualization
   glm::vec3 gradientColorLow;  // Color for low intensity
   glm::vec3 gradientColorHigh; // Color for high intensity
 
+  bool drawOffscreen(const glm::mat4 &view, const glm::mat4 &projection,
+                     const GLint viewport[4]);
+  bool createTargets(int width, int height);
+  void deleteTargets();
+
   GLuint compileShader(const char *source, GLenum type);
   GLuint createShaderProgram(const char *vertexPath, const char *fragmentPath);
   char *loadShaderSource(const char *path);
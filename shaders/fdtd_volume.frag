@@ -3,11 +3,15 @@
 in vec3 nearPoint;
 in vec3 farPoint;
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+// Opacity-weighted distance along the ray, for reprojecting the result
+layout(location = 1) out float RayDepth;
 
 uniform sampler3D volumeTexture;     // E-field (Ez component)
-uniform sampler3D epsilonTexture;    // Material properties
+uniform sampler3D edgeMaskTexture;   // 1 on material cells bordering air
 uniform sampler3D emissionTexture;   // Emission sources
+uniform sampler3D dftTexture;        // Accumulated DFT of Ez (re, im)
+uniform sampler3D brickTexture;      // Per-brick maxima and flags
 
 uniform vec3 gridCenter;             // World-space grid center
 uniform vec3 gridHalfSize;           // Half size of grid in world units (per-axis, anisotropic)
@@ -17,6 +21,35 @@ uniform int stepCount;               // Ray-marching steps
 uniform bool showEmissionSource;     // Show emission markers
 uniform bool showGeometryEdges;      // Show geometry wireframe
 
+// 0 = instantaneous Ez, 1 = DFT amplitude, 2 = DFT phase
+uniform int displayMode;
+uniform vec3 dftRegionMin;           // DFT region in texture coordinates
+uniform vec3 dftRegionMax;
+uniform float dftScale;              // Accumulator -> phasor normalization
+
+uniform mat4 invView;
+uniform mat4 invProj;
+
+// Rays end at the first scene surface. fullResScale maps this target's
+// pixels onto the full-resolution depth copy
+uniform bool useSceneDepth;
+uniform sampler2D sceneDepth;
+uniform vec2 fullResScale;
+
+// Offset of the first sample within a step, varied per pixel and per frame
+// when frames are accumulated
+uniform bool jitterRays;
+uniform float jitterOffset;
+
+// Empty-space skipping: bricks of brickSize^3 cells whose displayed value
+// stays under emptyAlpha are stepped over, faint ones marched at twice the
+// step. brickWeights picks the brick maximum matching displayMode
+uniform bool useBricks;
+uniform int brickSize;
+uniform vec3 brickWeights;
+const float emptyAlpha = 0.002;
+const float faintAlpha = 0.05;
+
 // Gradient colors for waveform
 uniform vec3 gradientColorLow;       // Color for low intensity (default: dark blue)
 uniform vec3 gradientColorHigh;      // Color for high intensity (default: red)
@@ -29,24 +62,19 @@ vec3 valueToColor(float value) {
     return mix(gradientColorLow, gradientColorHigh, intensity);
 }
 
+vec3 phaseToColor(float phase) {
+    // Hue wheel over [-pi, pi]
+    float h = phase / 6.28318531 + 0.5;
+    vec3 k = abs(fract(vec3(h) + vec3(0.0, 2.0 / 3.0, 1.0 / 3.0)) * 6.0 - 3.0);
+    return clamp(k - 1.0, 0.0, 1.0);
+}
+
 bool isEdge(vec3 texCoord) {
     if (!showGeometryEdges) return false;
     
-    float eps = texture(epsilonTexture, texCoord).r;
-    if (eps <= 1.01) return false; // Not in material
-    
-    // Check neighbors for edge detection
-    float step = 1.0 / float(gridSize);
-    float neighbors = 0.0;
-    neighbors += texture(epsilonTexture, texCoord + vec3(step, 0, 0)).r;
-    neighbors += texture(epsilonTexture, texCoord - vec3(step, 0, 0)).r;
-    neighbors += texture(epsilonTexture, texCoord + vec3(0, step, 0)).r;
-    neighbors += texture(epsilonTexture, texCoord - vec3(0, step, 0)).r;
-    neighbors += texture(epsilonTexture, texCoord + vec3(0, 0, step)).r;
-    neighbors += texture(epsilonTexture, texCoord - vec3(0, 0, step)).r;
-    
-    // If any neighbor is air (epsilon ~= 1), this is an edge
-    return neighbors < 6.0 * eps * 0.95;
+    // Precomputed per cell when the geometry is marked; filtered, so the
+    // outline follows the cell faces rather than whole cells
+    return texture(edgeMaskTexture, texCoord).r > 0.5;
 }
 
 bool intersectBox(vec3 orig, vec3 dir, out float t0, out float t1) {
@@ -66,6 +94,20 @@ bool intersectBox(vec3 orig, vec3 dir, out float t0, out float t1) {
     return t1 > max(t0, 0.0);
 }
 
+float sceneDistance(vec3 rayOrigin, vec3 rayDir) {
+    ivec2 size = textureSize(sceneDepth, 0);
+    ivec2 pixel = min(ivec2(gl_FragCoord.xy * fullResScale), size - 1);
+    float depth = texelFetch(sceneDepth, pixel, 0).r;
+    if (depth >= 1.0) {
+        return 1e30;
+    }
+
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(size) * 2.0 - 1.0;
+    vec4 eyeSpace = invProj * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    vec3 surface = (invView * vec4(eyeSpace.xyz / eyeSpace.w, 1.0)).xyz;
+    return dot(surface - rayOrigin, rayDir);
+}
+
 void main() {
     vec3 rayDir = normalize(farPoint - nearPoint);
     vec3 rayOrigin = nearPoint;
@@ -76,15 +118,40 @@ void main() {
     }
     
     t0 = max(t0, 0.0);
+    float tEnd = useSceneDepth ? min(t1, sceneDistance(rayOrigin, rayDir)) : t1;
+    if (tEnd <= t0) {
+        discard;
+    }
     
-    // Ray marching
+    // Ray marching. The step follows the whole box so that occluded rays
+    // sample as densely as the rest
     int numSteps = stepCount;
     float stepSize = (t1 - t0) / float(numSteps);
+    if (jitterRays) {
+        // Interleaved gradient noise, shifted every frame
+        float noise = fract(52.9829189 * fract(dot(gl_FragCoord.xy,
+                                                   vec2(0.06711056, 0.00583715))));
+        t0 += fract(noise + jitterOffset) * stepSize;
+    }
     
     vec4 color = vec4(0.0);
+    float depthSum = 0.0;
+    float weightSum = 0.0;
+
+    ivec3 brickCount = useBricks ? textureSize(brickTexture, 0) : ivec3(1);
+    vec3 brickExtent = gridHalfSize * 2.0 * float(brickSize) / float(gridSize);
+    ivec3 currentBrick = ivec3(-1);
+    bool brickOccupied = true;
+    float stepScale = 1.0;
     
-    for (int i = 0; i < numSteps; i++) {
-        float t = t0 + float(i) * stepSize;
+    // Samples stay on the fixed-step positions t0 + i * stepSize; skipping
+    // only leaves some out
+    float i = 0.0;
+    while (i < float(numSteps)) {
+        float t = t0 + i * stepSize;
+        if (t > tEnd) {
+            break;
+        }
         vec3 pos = rayOrigin + rayDir * t;
         
         // Convert world space to texture coordinates [0,1]
@@ -94,13 +161,54 @@ void main() {
         if (texCoord.x < 0.0 || texCoord.x > 1.0 ||
             texCoord.y < 0.0 || texCoord.y > 1.0 ||
             texCoord.z < 0.0 || texCoord.z > 1.0) {
+            i += 1.0;
             continue;
         }
+
+        if (useBricks) {
+            ivec3 brick = min(ivec3(texCoord * float(gridSize)) / brickSize,
+                              brickCount - 1);
+            if (brick != currentBrick) {
+                currentBrick = brick;
+                vec4 stats = texelFetch(brickTexture, brick, 0);
+                float alpha = dot(stats.rgb, brickWeights) * intensityScale * 0.5;
+                int flags = int(stats.a);
+                bool marked = (showEmissionSource && (flags & 1) != 0) ||
+                              (showGeometryEdges && (flags & 2) != 0);
+                brickOccupied = marked || alpha >= emptyAlpha;
+                stepScale = (!marked && alpha < faintAlpha) ? 2.0 : 1.0;
+            }
+
+            if (!brickOccupied) {
+                // Jump to the first sample past the brick's far side
+                vec3 brickMin = gridCenter - gridHalfSize + vec3(brick) * brickExtent;
+                vec3 exitPlane = brickMin + step(0.0, rayDir) * brickExtent;
+                vec3 tExit = (exitPlane - rayOrigin) / rayDir;
+                float exitT = min(min(tExit.x, tExit.y), tExit.z);
+                i = max(i + 1.0, ceil((exitT - t0) / stepSize + 1e-3));
+                continue;
+            }
+        }
         
-        float value = texture(volumeTexture, texCoord).r;
+        float value = 0.0;
+        vec3 rgb;
+        if (displayMode == 0) {
+            value = texture(volumeTexture, texCoord).r;
+            rgb = valueToColor(value * intensityScale);
+        } else {
+            // Steady-state phasor, zero outside the accumulated region
+            vec2 phasor = vec2(0.0);
+            if (all(greaterThanEqual(texCoord, dftRegionMin)) &&
+                all(lessThanEqual(texCoord, dftRegionMax))) {
+                vec3 dftCoord = (texCoord - dftRegionMin) / (dftRegionMax - dftRegionMin);
+                phasor = texture(dftTexture, dftCoord).rg * dftScale;
+            }
+            value = length(phasor);
+            rgb = displayMode == 1 ? valueToColor(value * intensityScale)
+                                   : phaseToColor(atan(phasor.y, phasor.x));
+        }
         float intensity = abs(value) * intensityScale;
         
-        vec3 rgb = valueToColor(value * intensityScale);
         vec4 sampleColor = vec4(rgb, intensity);
         
         // Check if this is an emission source location
@@ -119,13 +227,22 @@ void main() {
         
         // Front-to-back compositing
         sampleColor.a *= 0.5; // Alpha for better visibility
-        color.rgb += sampleColor.rgb * sampleColor.a * (1.0 - color.a);
-        color.a += sampleColor.a * (1.0 - color.a);
+        // A longer step absorbs as much as the samples it stands in for
+        if (stepScale != 1.0) {
+            sampleColor.a = 1.0 - pow(1.0 - min(sampleColor.a, 1.0), stepScale);
+        }
+        float weight = sampleColor.a * (1.0 - color.a);
+        depthSum += t * weight;
+        weightSum += weight;
+        color.rgb += sampleColor.rgb * weight;
+        color.a += weight;
         
         if (color.a > 0.95) {
             break;
         }
+        i += stepScale;
     }
     
     FragColor = color;
+    RayDepth = weightSum > 0.0 ? depthSum / weightSum : 0.5 * (t0 + tEnd);
 }
@@ -0,0 +1,49 @@
+#version 430 core
+
+in vec3 nearPoint;
+in vec3 farPoint;
+
+out vec4 FragColor;
+
+uniform sampler2D currentColor;  // This frame's reduced-resolution march
+uniform sampler2D currentDepth;  // Its opacity-weighted ray distance
+uniform sampler2D historyColor;  // Accumulated result of earlier frames
+uniform mat4 previousViewProj;
+uniform bool historyValid;
+
+// Share of the new frame in the running average
+const float blendWeight = 0.2;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(currentColor, 0);
+    vec4 current = texelFetch(currentColor, pixel, 0);
+
+    // Where this pixel's volume sat on the previous frame's screen
+    vec3 rayDir = normalize(farPoint - nearPoint);
+    float rayDistance = texelFetch(currentDepth, pixel, 0).r;
+    vec4 clip = previousViewProj * vec4(nearPoint + rayDir * rayDistance, 1.0);
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (!historyValid || clip.w <= 0.0 || any(lessThan(uv, vec2(0.0))) ||
+        any(greaterThan(uv, vec2(1.0)))) {
+        FragColor = current;
+        return;
+    }
+
+    // History outside the range of the surrounding new samples is stale
+    // (the field moved on, or the view uncovered something) and is pulled
+    // back into it
+    vec4 lo = current;
+    vec4 hi = current;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 neighbor = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+            vec4 neighborColor = texelFetch(currentColor, neighbor, 0);
+            lo = min(lo, neighborColor);
+            hi = max(hi, neighborColor);
+        }
+    }
+
+    vec4 history = clamp(texture(historyColor, uv), lo, hi);
+    FragColor = mix(history, current, blendWeight);
+}
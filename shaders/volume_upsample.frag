@@ -0,0 +1,53 @@
+#version 430 core
+
+out vec4 FragColor;
+
+uniform sampler2D volumeColor;  // Reduced-resolution volume
+uniform bool useSceneDepth;
+uniform sampler2D sceneDepth;   // Full-resolution depth copy
+uniform vec2 fullResScale;      // Full-resolution pixels per volume texel
+uniform vec2 depthParams;       // projection[2][2], projection[3][2]
+
+float linearDepth(float depth) {
+    return depthParams.y / (depthParams.x + depth * 2.0 - 1.0);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 volumeSize = textureSize(volumeColor, 0);
+    ivec2 depthSize = textureSize(sceneDepth, 0);
+
+    // Bilinear footprint among the volume texel centres
+    vec2 position = gl_FragCoord.xy / fullResScale - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+
+    float depth = 0.0;
+    if (useSceneDepth) {
+        depth = linearDepth(texelFetch(sceneDepth, min(pixel, depthSize - 1),
+                                       0).r);
+    }
+
+    vec4 sum = vec4(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), volumeSize - 1);
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y;
+
+        if (useSceneDepth) {
+            // The depth the texel's ray ended against, picked as in the
+            // march; texels across a depth edge belong to another surface
+            ivec2 source =
+                min(ivec2((vec2(texel) + 0.5) * fullResScale), depthSize - 1);
+            float texelDepth = linearDepth(texelFetch(sceneDepth, source, 0).r);
+            weight /= 1e-3 + abs(texelDepth - depth) / depth;
+        }
+
+        sum += texelFetch(volumeColor, texel, 0) * weight;
+        weightSum += weight;
+    }
+
+    FragColor = sum / max(weightSum, 1e-8);
+}
@@ -0,0 +1,110 @@
+#include "async_model_loader.h"
+#include "spatial_index.h"
+#include "trace.h"
+
+#include <iostream>
+
+AsyncModelLoader::AsyncModelLoader()
+    : meshDone(false), meshTaken(false), indexDone(false), failed(false) {}
+
+AsyncModelLoader::~AsyncModelLoader() { wait(); }
+
+void AsyncModelLoader::start(const std::string &objPath,
+                             const std::string &bvhPath) {
+  wait();
+  mesh.reset();
+  index.reset();
+  meshDone = meshTaken = indexDone = failed = false;
+
+  meshThread = std::thread(&AsyncModelLoader::loadMesh, this, objPath);
+  indexThread =
+      std::thread(&AsyncModelLoader::loadIndex, this, objPath, bvhPath);
+}
+
+void AsyncModelLoader::loadMesh(const std::string &objPath) {
+  Tracer::setThreadName("Model loader");
+  auto data = std::make_shared<ModelData>(ModelLoader::loadOBJCached(objPath));
+  if (!data->loaded)
+    std::cerr << "Failed to load model: " << objPath << std::endl;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (data->loaded)
+    mesh = data;
+  else
+    failed = true;
+  meshDone = true;
+  meshCondition.notify_all();
+}
+
+void AsyncModelLoader::loadIndex(const std::string &objPath,
+                                 const std::string &bvhPath) {
+  Tracer::setThreadName("BVH loader");
+  auto result = std::make_unique<SpatialIndex>();
+
+  if (!result->loadBVH(bvhPath)) {
+    // No usable cache: build from the mesh once the other thread has it. The
+    // mesh is shared, so the renderer may already be uploading it. A mesh
+    // from the .hmesh cache is quantized, so parse the OBJ again for the BVH
+    std::shared_ptr<const ModelData> data;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      meshCondition.wait(lock, [this] { return meshDone; });
+      data = mesh;
+    }
+
+    if (!data) {
+      std::lock_guard<std::mutex> lock(mutex);
+      indexDone = true;
+      return;
+    }
+
+    if (data->quantized) {
+      auto full = std::make_shared<ModelData>(ModelLoader::loadOBJ(objPath));
+      if (!full->loaded) {
+        std::lock_guard<std::mutex> lock(mutex);
+        indexDone = true;
+        return;
+      }
+      data = full;
+    }
+
+    std::cout << "Building spatial index from scratch..." << std::endl;
+    result->buildFromMesh(data->vertices, data->indices);
+    std::cout << "Saving BVH to cache..." << std::endl;
+    result->saveBVH(bvhPath);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  index = std::move(result);
+  indexDone = true;
+}
+
+std::shared_ptr<const ModelData> AsyncModelLoader::takeMesh() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!meshDone || meshTaken)
+    return nullptr;
+  meshTaken = true;
+  return mesh;
+}
+
+std::unique_ptr<SpatialIndex> AsyncModelLoader::takeSpatialIndex() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return std::move(index);
+}
+
+bool AsyncModelLoader::isRunning() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return !meshDone || !indexDone;
+}
+
+bool AsyncModelLoader::hasFailed() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return failed;
+}
+
+void AsyncModelLoader::wait() {
+  if (meshThread.joinable())
+    meshThread.join();
+  if (indexThread.joinable())
+    indexThread.join();
+}
@@ -0,0 +1,102 @@
+#include "async_readback.h"
+
+#include <cstring>
+
+AsyncReadback::AsyncReadback()
+    : firstPending(0), pendingCount(0), lostCount(0) {}
+
+AsyncReadback::~AsyncReadback() {}
+
+void AsyncReadback::initialize(int slotCount) {
+  cleanup();
+  slots.resize(slotCount > 0 ? slotCount : 1);
+}
+
+void AsyncReadback::cleanup() {
+  for (auto &slot : slots) {
+    if (slot.fence)
+      glDeleteSync(slot.fence);
+    if (slot.buffer)
+      glDeleteBuffers(1, &slot.buffer);
+    slot = Slot();
+  }
+  firstPending = 0;
+  pendingCount = 0;
+}
+
+bool AsyncReadback::request(GLuint texture, GLenum format,
+                            const glm::ivec3 &size, uint64_t tag) {
+  if (slots.empty() || pendingCount == static_cast<int>(slots.size()))
+    return false;
+
+  Slot &slot = slots[(firstPending + pendingCount) % slots.size()];
+  const size_t components = format == GL_RG ? 2 : 1;
+  slot.count = static_cast<size_t>(size.x) * size.y * size.z * components;
+  const size_t bytes = slot.count * sizeof(float);
+
+  if (!slot.buffer)
+    glGenBuffers(1, &slot.buffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  if (bytes > slot.capacity) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+    slot.capacity = bytes;
+  }
+
+  // The fields are written through images; with a pack buffer bound the
+  // copy goes to the buffer and returns at once
+  glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+  glBindTexture(GL_TEXTURE_3D, texture);
+  glGetTexImage(GL_TEXTURE_3D, 0, format, GL_FLOAT, nullptr);
+  glBindTexture(GL_TEXTURE_3D, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.tag = tag;
+  pendingCount++;
+  return true;
+}
+
+void AsyncReadback::poll() {
+  while (pendingCount > 0 && deliver(slots[firstPending], false)) {
+    firstPending = (firstPending + 1) % static_cast<int>(slots.size());
+    pendingCount--;
+  }
+}
+
+void AsyncReadback::flush() {
+  while (pendingCount > 0) {
+    deliver(slots[firstPending], true);
+    firstPending = (firstPending + 1) % static_cast<int>(slots.size());
+    pendingCount--;
+  }
+}
+
+bool AsyncReadback::deliver(Slot &slot, bool wait) {
+  GLenum status =
+      wait ? glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              1000000000ull)
+           : glClientWaitSync(slot.fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED && !wait)
+    return false;
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+  if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+    lostCount++;
+    return true;
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  const void *mapped = glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, slot.count * sizeof(float), GL_MAP_READ_BIT);
+  if (mapped) {
+    std::vector<float> data(slot.count);
+    std::memcpy(data.data(), mapped, slot.count * sizeof(float));
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    if (callback)
+      callback(slot.tag, std::move(data));
+  } else {
+    lostCount++;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return true;
+}
@@ -0,0 +1,513 @@
+// Headless batch runner: loads a model and an .hscene, runs ray propagation,
+// image-method links and/or the CPU FDTD solver, and writes results to disk.
+// Links against no windowing or GL libraries.
+
+#include "cpu_fdtd_solver.h"
+#include "image_method_solver.h"
+#include "model_loader.h"
+#include "parameter_sweep.h"
+#include "radio_system.h"
+#include "scene_serializer.h"
+#include "spatial_index.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BatchOptions {
+  std::string modelPath;
+  std::string scenePath;
+  std::string bvhPath; // Defaults to <model>.bvh
+  std::string outputDir = "batch_output";
+  bool runRays = true;
+  bool runFDTD = true;
+  int steps = 2000;
+  int snapshotEvery = 0; // 0 = final snapshot only
+  int gridSize = 0;      // 0 = derive from the scene's voxel spacing
+  float emissionStrength = 0.5f;
+  float coverageCellSize = 10.0f;
+  float sliceHeight = NAN; // NAN = mean receiver height
+  std::string sweepPath;    // Non-empty = run a parameter sweep instead
+  int workers = 0;
+  size_t memoryLimitMB = 4096;
+  std::string tracePath; // Non-empty = write a Chrome trace on exit
+};
+
+void printUsage(const char *program) {
+  std::cout
+      << "Usage: " << program << " --model <file.obj> [options]\n"
+      << "\n"
+      << "Options:\n"
+      << "  --scene <file.hscene>   Nodes and grid settings to simulate\n"
+      << "  --bvh <file.bvh>        BVH cache (default: <model>.bvh)\n"
+      << "  --out <dir>             Output directory (default: batch_output)\n"
+      << "  --mode <rays|fdtd|all>  What to run (default: all)\n"
+      << "  --steps <n>             FDTD steps (default: 2000)\n"
+      << "  --snapshot-every <n>    Write Ez every n steps (default: end only)\n"
+      << "  --grid-size <n>         FDTD grid resolution (default: from scene)\n"
+      << "  --emission <value>      Source amplitude (default: 0.5)\n"
+      << "  --coverage-cell <m>     Ray coverage cell size (default: 10)\n"
+      << "  --slice-height <m>      Height of the FDTD coverage slice\n"
+      << "                          (default: mean receiver height)\n"
+      << "  --sweep <file>          Run every variant in a sweep file and\n"
+      << "                          write one table (sweep.csv)\n"
+      << "  --workers <n>           Sweep worker threads (default: all cores)\n"
+      << "  --max-memory <MB>       Memory budget for sweep solvers\n"
+      << "                          (default: 4096)\n"
+      << "  --trace <file.json>     Write a Chrome trace of the run\n";
+}
+
+// Whole-string numeric parsing; trailing characters and out-of-range values
+// are rejected instead of being silently truncated
+bool parseNumber(const std::string &arg, const std::string &value,
+                 long long minimum, long long &result) {
+  char *end = nullptr;
+  errno = 0;
+  result = std::strtoll(value.c_str(), &end, 10);
+  if (value.empty() || *end != '\0' || errno == ERANGE || result < minimum) {
+    std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool parseNumber(const std::string &arg, const std::string &value,
+                 int &result) {
+  long long parsed = 0;
+  if (!parseNumber(arg, value, 0, parsed))
+    return false;
+  if (parsed > INT_MAX) {
+    std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+    return false;
+  }
+  result = static_cast<int>(parsed);
+  return true;
+}
+
+bool parseNumber(const std::string &arg, const std::string &value,
+                 float &result) {
+  if (!SceneSerializer::parseFloat(value, result)) {
+    std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool parseArguments(int argc, char **argv, BatchOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      return false;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+
+    std::string value = argv[++i];
+    bool valid = true;
+    if (arg == "--model") {
+      options.modelPath = value;
+    } else if (arg == "--scene") {
+      options.scenePath = value;
+    } else if (arg == "--bvh") {
+      options.bvhPath = value;
+    } else if (arg == "--out") {
+      options.outputDir = value;
+    } else if (arg == "--mode") {
+      options.runRays = value == "rays" || value == "all";
+      options.runFDTD = value == "fdtd" || value == "all";
+      if (!options.runRays && !options.runFDTD) {
+        std::cerr << "Unknown mode: " << value << std::endl;
+        return false;
+      }
+    } else if (arg == "--steps") {
+      valid = parseNumber(arg, value, options.steps);
+    } else if (arg == "--snapshot-every") {
+      valid = parseNumber(arg, value, options.snapshotEvery);
+    } else if (arg == "--grid-size") {
+      valid = parseNumber(arg, value, options.gridSize);
+    } else if (arg == "--emission") {
+      valid = parseNumber(arg, value, options.emissionStrength);
+    } else if (arg == "--coverage-cell") {
+      valid = parseNumber(arg, value, options.coverageCellSize);
+    } else if (arg == "--slice-height") {
+      valid = parseNumber(arg, value, options.sliceHeight);
+    } else if (arg == "--sweep") {
+      options.sweepPath = value;
+    } else if (arg == "--workers") {
+      valid = parseNumber(arg, value, options.workers);
+    } else if (arg == "--max-memory") {
+      long long megabytes = 0;
+      valid = parseNumber(arg, value, 1, megabytes);
+      options.memoryLimitMB = static_cast<size_t>(megabytes);
+    } else if (arg == "--trace") {
+      options.tracePath = value;
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return false;
+    }
+    if (!valid)
+      return false;
+  }
+
+  if (options.modelPath.empty()) {
+    std::cerr << "--model is required" << std::endl;
+    return false;
+  }
+  if (options.bvhPath.empty()) {
+    options.bvhPath =
+        std::filesystem::path(options.modelPath).replace_extension(".bvh")
+            .string();
+  }
+  return true;
+}
+
+bool loadGeometry(const BatchOptions &options, SpatialIndex &spatialIndex) {
+  if (spatialIndex.loadBVH(options.bvhPath)) {
+    return true;
+  }
+
+  // Nothing is drawn here, so skip the quantized mesh cache entirely
+  ModelData modelData = ModelLoader::loadOBJ(options.modelPath);
+  if (!modelData.loaded) {
+    std::cerr << "Failed to load model: " << options.modelPath << std::endl;
+    return false;
+  }
+
+  spatialIndex.buildFromMesh(modelData.vertices, modelData.indices);
+  spatialIndex.saveBVH(options.bvhPath);
+  return true;
+}
+
+bool writeCoverage(const std::string &path, const CoverageMap &coverage) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+
+  file << "x,z,strength\n";
+  for (int cz = 0; cz < coverage.height; cz++) {
+    for (int cx = 0; cx < coverage.width; cx++) {
+      float x = coverage.origin.x + (cx + 0.5f) * coverage.cellSize;
+      float z = coverage.origin.z + (cz + 0.5f) * coverage.cellSize;
+      file << x << "," << z << "," << coverage.values[cz * coverage.width + cx]
+           << "\n";
+    }
+  }
+  return true;
+}
+
+bool writeLinks(const std::string &path, const ImageMethodSolver &solver) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+
+  file << "transmitter_id,receiver_id,line_of_sight,paths,best_loss_db,"
+          "total_gain_db\n";
+  for (const auto &link : solver.getLinks()) {
+    file << link.transmitterId << "," << link.receiverId << ","
+         << (link.lineOfSight ? 1 : 0) << "," << link.paths.size() << ","
+         << link.bestLossDb << "," << link.totalGainDb << "\n";
+  }
+  return true;
+}
+
+bool writeRaw(const std::string &path, const std::vector<float> &values) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+  file.write(reinterpret_cast<const char *>(values.data()),
+             values.size() * sizeof(float));
+  return file.good();
+}
+
+void runRays(const BatchOptions &options, RadioSystem &radioSystem,
+             const SpatialIndex &spatialIndex) {
+  const BoundingBox &bounds = spatialIndex.getBounds();
+  radioSystem.setCoverageArea(bounds.min, bounds.max,
+                              options.coverageCellSize);
+
+  auto start = std::chrono::steady_clock::now();
+  radioSystem.computeSignalPropagation(&spatialIndex);
+
+  ImageMethodSolver linkSolver;
+  linkSolver.computeLinks(radioSystem, spatialIndex);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  std::cout << "Traced " << radioSystem.getSignalRays().size()
+            << " rays and " << linkSolver.getLinks().size() << " links in "
+            << seconds << " s" << std::endl;
+
+  std::filesystem::path out(options.outputDir);
+  writeCoverage((out / "coverage.csv").string(), radioSystem.getCoverage());
+  writeLinks((out / "links.csv").string(), linkSolver);
+}
+
+void runFDTD(const BatchOptions &options, const RadioSystem &radioSystem,
+             const SceneData &sceneData, const SpatialIndex &spatialIndex) {
+  // Center the grid on every active node; unlike the viewer (which follows
+  // the transmitters) a batch run must keep its receivers inside the grid
+  glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+  std::vector<const RadioSource *> transmitters;
+  std::vector<const RadioSource *> receivers;
+  std::vector<float> frequencies;
+
+  for (const auto &node : radioSystem.getSources()) {
+    if (!node.active)
+      continue;
+    if (node.type == NodeType::TRANSMITTER) {
+      transmitters.push_back(&node);
+      minPos = glm::min(minPos, node.position);
+      maxPos = glm::max(maxPos, node.position);
+      if (std::find(frequencies.begin(), frequencies.end(), node.frequency) ==
+          frequencies.end()) {
+        frequencies.push_back(node.frequency);
+      }
+    } else if (node.type == NodeType::RECEIVER) {
+      receivers.push_back(&node);
+      minPos = glm::min(minPos, node.position);
+      maxPos = glm::max(maxPos, node.position);
+    }
+  }
+
+  if (transmitters.empty()) {
+    std::cerr << "No active transmitters, skipping FDTD" << std::endl;
+    return;
+  }
+
+  glm::vec3 gridCenter = (minPos + maxPos) * 0.5f;
+  glm::vec3 gridHalfSize = sceneData.fdtdGridHalfSize;
+  int gridSize = options.gridSize > 0
+                     ? options.gridSize
+                     : gridSizeForSpacing(gridHalfSize, sceneData.voxelSpacing);
+
+  CPUFDTDSolver solver;
+  solver.setVoxelSpacing(sceneData.voxelSpacing);
+  solver.setConductivity(sceneData.conductivity);
+  if (!solver.initialize(gridSize))
+    return;
+  solver.markGeometry(gridCenter, gridHalfSize, spatialIndex, 0.0f, 50.0f);
+
+  // Every active receiver is a probe
+  std::vector<FDTDProbe> probes;
+  float receiverHeight = 0.0f;
+  for (const RadioSource *node : receivers) {
+    glm::vec3 offset = glm::abs(node->position - gridCenter);
+    if (offset.x > gridHalfSize.x || offset.y > gridHalfSize.y ||
+        offset.z > gridHalfSize.z) {
+      std::cerr << "Warning: receiver " << node->id
+                << " lies outside the FDTD grid; its probe is clamped to the "
+                   "boundary"
+                << std::endl;
+    }
+    probes.push_back({node->id, worldToGrid(node->position, gridCenter,
+                                            gridHalfSize, gridSize)});
+    receiverHeight += node->position.y;
+  }
+  solver.setProbes(probes);
+  solver.setDFTFrequencies(frequencies);
+
+  std::filesystem::path out(options.outputDir);
+  if (options.snapshotEvery > 0) {
+    std::filesystem::create_directories(out / "snapshots");
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int step = 0; step < options.steps; step++) {
+    // Same continuous-wave drive as the viewer
+    solver.clearEmission();
+    double time = (step + 1) * static_cast<double>(solver.getTimeStep());
+    for (const RadioSource *node : transmitters) {
+      float oscillation = static_cast<float>(
+          std::sin(2.0 * M_PI * node->frequency * time) *
+          options.emissionStrength);
+      glm::ivec3 cell =
+          worldToGrid(node->position, gridCenter, gridHalfSize, gridSize);
+      solver.addEmissionSource(cell.x, cell.y, cell.z, oscillation);
+    }
+    solver.update();
+
+    if (options.snapshotEvery > 0 && (step + 1) % options.snapshotEvery == 0) {
+      writeRaw((out / "snapshots" /
+                ("ez_" + std::to_string(step + 1) + ".raw"))
+                   .string(),
+               solver.getEz());
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  double cells = static_cast<double>(gridSize) * gridSize * gridSize;
+  std::cout << "FDTD: " << options.steps << " steps on " << gridSize
+            << "^3 in " << seconds << " s ("
+            << cells * options.steps / seconds / 1e6 << " Mcells/s)"
+            << std::endl;
+
+  // Grid description for the raw volumes
+  {
+    std::ofstream file((out / "fdtd_grid.txt").string());
+    file << "gridSize=" << gridSize << "\n";
+    file << "center=" << gridCenter.x << "," << gridCenter.y << ","
+         << gridCenter.z << "\n";
+    file << "halfSize=" << gridHalfSize.x << "," << gridHalfSize.y << ","
+         << gridHalfSize.z << "\n";
+    file << "timeStep=" << solver.getTimeStep() << "\n";
+    file << "steps=" << options.steps << "\n";
+    file << "layout=float32, x fastest, then y, then z\n";
+  }
+  writeRaw((out / "ez_final.raw").string(), solver.getEz());
+
+  // Probe traces
+  {
+    std::ofstream file((out / "probes.csv").string());
+    file << "probe_id,step,time_s,ex,ey,ez,hx,hy,hz\n";
+    for (int p = 0; p < solver.getProbeCount(); p++) {
+      const auto &history = solver.getProbeHistory(p);
+      for (size_t s = 0; s < history.size(); s++) {
+        const ProbeSample &v = history[s];
+        file << solver.getProbe(p).id << "," << s + 1 << ","
+             << (s + 1) * solver.getTimeStep() << "," << v.ex << "," << v.ey
+             << "," << v.ez << "," << v.hx << "," << v.hy << "," << v.hz
+             << "\n";
+      }
+    }
+  }
+
+  // Steady-state amplitude per frequency: full volume plus a coverage slice
+  float sliceHeight = options.sliceHeight;
+  if (std::isnan(sliceHeight)) {
+    sliceHeight = probes.empty() ? gridCenter.y
+                                 : receiverHeight / probes.size();
+  }
+  int sliceY = worldToGrid(glm::vec3(gridCenter.x, sliceHeight, gridCenter.z),
+                           gridCenter, gridHalfSize, gridSize)
+                   .y;
+  glm::vec3 voxelSize = gridHalfSize * 2.0f / static_cast<float>(gridSize);
+  glm::vec3 gridMin = gridCenter - gridHalfSize;
+
+  std::vector<glm::vec2> phasors;
+  std::vector<float> amplitude;
+  for (int f = 0; f < solver.getDFTFrequencyCount(); f++) {
+    solver.readDFT(f, phasors);
+    amplitude.resize(phasors.size());
+    for (size_t i = 0; i < phasors.size(); i++)
+      amplitude[i] = glm::length(phasors[i]);
+
+    std::string prefix = "dft" + std::to_string(f);
+    writeRaw((out / (prefix + "_amplitude.raw")).string(), amplitude);
+
+    std::ofstream file((out / (prefix + "_coverage.csv")).string());
+    file << "# frequency_hz=" << solver.getDFTFrequency(f)
+         << " height=" << sliceHeight << "\n";
+    file << "x,z,amplitude,amplitude_db\n";
+    for (int z = 0; z < gridSize; z++) {
+      for (int x = 0; x < gridSize; x++) {
+        float a = amplitude[solver.cellIndex(x, sliceY, z)];
+        file << gridMin.x + (x + 0.5f) * voxelSize.x << ","
+             << gridMin.z + (z + 0.5f) * voxelSize.z << "," << a << ","
+             << (a > 0.0f ? 20.0f * std::log10(a) : -300.0f) << "\n";
+      }
+    }
+  }
+}
+
+int runBatch(const BatchOptions &options) {
+  std::error_code error;
+  std::filesystem::create_directories(options.outputDir, error);
+  if (error) {
+    std::cerr << "Failed to create output directory " << options.outputDir
+              << ": " << error.message() << std::endl;
+    return 1;
+  }
+
+  SpatialIndex spatialIndex;
+  if (!loadGeometry(options, spatialIndex)) {
+    return 1;
+  }
+
+  RadioSystem radioSystem;
+  SceneData sceneData;
+  if (!options.scenePath.empty() &&
+      !SceneSerializer::loadScene(options.scenePath, radioSystem, sceneData)) {
+    return 1;
+  }
+  if (radioSystem.getSourceCount() == 0) {
+    std::cerr << "Scene has no nodes, nothing to simulate" << std::endl;
+    return 1;
+  }
+
+  if (!options.sweepPath.empty()) {
+    ParameterSweep sweep;
+    if (!sweep.loadFile(options.sweepPath)) {
+      return 1;
+    }
+
+    SweepSettings settings;
+    settings.runRays = options.runRays;
+    settings.runFDTD = options.runFDTD;
+    settings.steps = options.steps;
+    settings.gridSize = options.gridSize;
+    settings.emissionStrength = options.emissionStrength;
+    settings.coverageCellSize = options.coverageCellSize;
+    settings.workers = options.workers;
+    settings.memoryLimitMB = options.memoryLimitMB;
+
+    std::string tablePath =
+        (std::filesystem::path(options.outputDir) / "sweep.csv").string();
+    return sweep.run(settings, radioSystem, sceneData, spatialIndex, tablePath)
+               ? 0
+               : 1;
+  }
+
+  if (options.runRays) {
+    runRays(options, radioSystem, spatialIndex);
+  }
+  if (options.runFDTD) {
+    runFDTD(options, radioSystem, sceneData, spatialIndex);
+  }
+
+  std::cout << "Results written to " << options.outputDir << std::endl;
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  BatchOptions options;
+  if (!parseArguments(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  if (!options.tracePath.empty()) {
+    Tracer::start();
+    Tracer::setThreadName("Main thread");
+  }
+
+  int status = runBatch(options);
+
+  if (!options.tracePath.empty())
+    Tracer::write(options.tracePath);
+  return status;
+}
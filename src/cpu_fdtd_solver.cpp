@@ -0,0 +1,361 @@
+#include "cpu_fdtd_solver.h"
+#include "scene_geometry.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+CPUFDTDSolver::CPUFDTDSolver()
+    : gridSize(0), voxelSpacing(5.0f), conductivity(0.0001f),
+      timeStep(1e-11f), stepCount(0), dftSampleCount(0) {}
+
+bool CPUFDTDSolver::initialize(int size) {
+  if (size <= 0) {
+    std::cerr << "Invalid FDTD grid size: " << size << std::endl;
+    return false;
+  }
+
+  gridSize = size;
+  size_t cellCount = static_cast<size_t>(size) * size * size;
+
+  for (auto *field : {&ex, &ey, &ez, &hx, &hy, &hz}) {
+    field->assign(cellCount, 0.0f);
+  }
+  epsilon.assign(cellCount, 1.0f);
+  emission.clear();
+
+  // Probe cells and accumulators are sized for the old grid
+  probeList.clear();
+  probeHistory.clear();
+  std::vector<float> frequencies;
+  frequencies.swap(dftFrequencies);
+  setDFTFrequencies(frequencies);
+
+  stepCount = 0;
+
+  std::cout << "CPU FDTD Solver initialized with grid size: " << gridSize
+            << std::endl;
+  return true;
+}
+
+void CPUFDTDSolver::addEmissionSource(int x, int y, int z, float strength) {
+  if (x < 0 || x >= gridSize || y < 0 || y >= gridSize || z < 0 ||
+      z >= gridSize) {
+    return;
+  }
+
+  // Like the emission texture, a second source in the same cell overwrites
+  size_t index = cellIndex(x, y, z);
+  for (auto &source : emission) {
+    if (source.first == index) {
+      source.second = strength;
+      return;
+    }
+  }
+  emission.emplace_back(index, strength);
+}
+
+void CPUFDTDSolver::reset() {
+  for (auto *field : {&ex, &ey, &ez, &hx, &hy, &hz}) {
+    std::fill(field->begin(), field->end(), 0.0f);
+  }
+  emission.clear();
+
+  for (auto &history : probeHistory)
+    history.clear();
+
+  for (auto &accumulator : dftAccumulators)
+    std::fill(accumulator.begin(), accumulator.end(), glm::vec2(0.0f));
+  dftSampleCount = 0;
+  stepCount = 0;
+}
+
+float CPUFDTDSolver::boundaryDamping(int x, int y, int z) const {
+  // Quadratic absorbing layer, same profile as the compute shaders
+  const int pmlThickness = 8;
+  int distToBoundary =
+      std::min(std::min(std::min(x, gridSize - 1 - x),
+                        std::min(y, gridSize - 1 - y)),
+               std::min(z, gridSize - 1 - z));
+  if (distToBoundary >= pmlThickness)
+    return 1.0f;
+
+  float depth =
+      static_cast<float>(pmlThickness - distToBoundary) / pmlThickness;
+  return 1.0f - 0.3f * depth * depth;
+}
+
+void CPUFDTDSolver::update() {
+  TRACE_SCOPE("CPUFDTDSolver::update");
+  updateE();
+  updateH();
+
+  if (!dftFrequencies.empty())
+    dftSampleCount++;
+  stepCount++;
+
+  for (size_t i = 0; i < probeList.size(); i++) {
+    const glm::ivec3 &c = probeList[i].cell;
+    size_t index = cellIndex(c.x, c.y, c.z);
+    probeHistory[i].push_back({ex[index], ey[index], ez[index], hx[index],
+                               hy[index], hz[index]});
+  }
+}
+
+void CPUFDTDSolver::updateE() {
+  const int n = gridSize;
+  const size_t strideY = n;
+  const size_t strideZ = static_cast<size_t>(n) * n;
+  const float dt = 0.5f;
+  const float lossTerm = conductivityLoss(conductivity, timeStep);
+
+  // Source strengths for this step, scattered into a lookup only when used
+  std::vector<float> source;
+  if (!emission.empty()) {
+    source.assign(ez.size(), 0.0f);
+    for (const auto &s : emission)
+      source[s.first] = s.second;
+  }
+
+  // DFT phasors e^{-i w n dt}, in double so the phase doesn't drift
+  const int dftCount = static_cast<int>(dftFrequencies.size());
+  glm::vec2 phasors[2];
+  for (int i = 0; i < dftCount; i++) {
+    double phase = std::fmod(2.0 * M_PI * dftFrequencies[i] * timeStep *
+                                 static_cast<double>(dftSampleCount),
+                             2.0 * M_PI);
+    phasors[i] = glm::vec2(static_cast<float>(std::cos(phase)),
+                           static_cast<float>(-std::sin(phase)));
+  }
+
+#pragma omp parallel for
+  for (int z = 0; z < n; z++) {
+    for (int y = 0; y < n; y++) {
+      for (int x = 0; x < n; x++) {
+        size_t i = cellIndex(x, y, z);
+        float eps = epsilon[i];
+
+        // Inside solid material fields are forced to zero
+        if (eps > 10.0f) {
+          ex[i] = ey[i] = ez[i] = 0.0f;
+          continue;
+        }
+
+        float curlHx = 0.0f, curlHy = 0.0f, curlHz = 0.0f;
+        if (y < n - 1 && z < n - 1)
+          curlHx = (hz[i + strideY] - hz[i]) - (hy[i + strideZ] - hy[i]);
+        if (x < n - 1 && z < n - 1)
+          curlHy = (hx[i + strideZ] - hx[i]) - (hz[i + 1] - hz[i]);
+        if (x < n - 1 && y < n - 1)
+          curlHz = (hy[i + 1] - hy[i]) - (hx[i + strideY] - hx[i]);
+
+        float loss = lossTerm / eps;
+        float decay = (1.0f - loss) / (1.0f + loss);
+        float gain = dt / (eps * (1.0f + loss));
+        float exNew = decay * ex[i] + gain * curlHx;
+        float eyNew = decay * ey[i] + gain * curlHy;
+        float ezNew = decay * ez[i] + gain * curlHz;
+        if (!source.empty())
+          ezNew += source[i];
+
+        float damping = boundaryDamping(x, y, z);
+        ex[i] = exNew * damping;
+        ey[i] = eyNew * damping;
+        ez[i] = ezNew * damping;
+
+        for (int f = 0; f < dftCount; f++)
+          dftAccumulators[f][i] += ez[i] * phasors[f];
+      }
+    }
+  }
+}
+
+void CPUFDTDSolver::updateH() {
+  const int n = gridSize;
+  const size_t strideY = n;
+  const size_t strideZ = static_cast<size_t>(n) * n;
+  const float dt = 0.5f;
+
+#pragma omp parallel for
+  for (int z = 0; z < n; z++) {
+    for (int y = 0; y < n; y++) {
+      for (int x = 0; x < n; x++) {
+        size_t i = cellIndex(x, y, z);
+
+        if (epsilon[i] > 10.0f) {
+          hx[i] = hy[i] = hz[i] = 0.0f;
+          continue;
+        }
+
+        float curlEx = 0.0f, curlEy = 0.0f, curlEz = 0.0f;
+        if (y > 0 && z > 0)
+          curlEx = (ez[i] - ez[i - strideY]) - (ey[i] - ey[i - strideZ]);
+        if (x > 0 && z > 0)
+          curlEy = (ex[i] - ex[i - strideZ]) - (ez[i] - ez[i - 1]);
+        if (x > 0 && y > 0)
+          curlEz = (ey[i] - ey[i - 1]) - (ex[i] - ex[i - strideY]);
+
+        float damping = boundaryDamping(x, y, z);
+        hx[i] = (hx[i] - dt * curlEx) * damping;
+        hy[i] = (hy[i] - dt * curlEy) * damping;
+        hz[i] = (hz[i] - dt * curlEz) * damping;
+      }
+    }
+  }
+}
+
+bool CPUFDTDSolver::isInside(const SceneGeometry &spatialIndex,
+                             const glm::vec3 &point) {
+  // Odd number of crossings along a fixed off-axis ray = inside
+  Ray ray;
+  ray.origin = point;
+  ray.direction = glm::normalize(glm::vec3(1.0f, 0.3f, 0.7f));
+  ray.tMin = 0.001f;
+  ray.tMax = 100.0f;
+
+  int hitCount = 0;
+  while (true) {
+    RayHit hit = spatialIndex.intersect(ray);
+    if (!hit.hit)
+      break;
+    hitCount++;
+    ray.tMin = hit.distance + 1e-4f;
+  }
+  return (hitCount % 2) == 1;
+}
+
+void CPUFDTDSolver::markGeometry(const glm::vec3 &gridCenter,
+                                 const glm::vec3 &gridHalfSize,
+                                 const SceneGeometry &spatialIndex,
+                                 float groundLevel, float materialEpsilon) {
+  applyMaterial(voxelize(gridSize, gridCenter, gridHalfSize, spatialIndex,
+                         groundLevel),
+                materialEpsilon);
+}
+
+std::vector<unsigned char>
+CPUFDTDSolver::voxelize(int gridSize, const glm::vec3 &gridCenter,
+                        const glm::vec3 &gridHalfSize,
+                        const SceneGeometry &spatialIndex, float groundLevel) {
+  TRACE_SCOPE("CPUFDTDSolver::voxelize");
+  const int n = gridSize;
+  const glm::vec3 voxelSize = gridHalfSize * 2.0f / static_cast<float>(n);
+  const glm::vec3 halfVoxel = voxelSize * 0.5f;
+  const BoundingBox &bounds = spatialIndex.getBounds();
+  const bool hasGeometry = !spatialIndex.isEmpty();
+  // Parity rays are 100 units long; voxels farther than that from the mesh
+  // bounds cannot hit anything
+  const glm::vec3 reach = voxelSize + glm::vec3(100.0f);
+
+  std::cout << "Marking geometry on CPU (" << n << "^3 voxels)..."
+            << std::endl;
+
+  std::vector<unsigned char> occupancy(static_cast<size_t>(n) * n * n, 0);
+
+#pragma omp parallel for schedule(dynamic)
+  for (int z = 0; z < n; z++) {
+    for (int y = 0; y < n; y++) {
+      for (int x = 0; x < n; x++) {
+        glm::vec3 texCoord =
+            (glm::vec3(x, y, z) + 0.5f) / static_cast<float>(n);
+        glm::vec3 cellWorld =
+            (texCoord - 0.5f) * 2.0f * gridHalfSize + gridCenter;
+
+        bool solid = false;
+        if (cellWorld.y < groundLevel) {
+          solid = true;
+        } else if (hasGeometry &&
+                   BoundingBox(cellWorld - reach, cellWorld + reach)
+                       .overlaps(bounds)) {
+          // Center plus the 8 corners pulled slightly inside the voxel
+          int insideCount = isInside(spatialIndex, cellWorld) ? 1 : 0;
+          for (int c = 0; c < 8; c++) {
+            glm::vec3 offset((c & 1) ? halfVoxel.x : -halfVoxel.x,
+                             (c & 2) ? halfVoxel.y : -halfVoxel.y,
+                             (c & 4) ? halfVoxel.z : -halfVoxel.z);
+            if (isInside(spatialIndex, cellWorld + offset * 0.9f))
+              insideCount++;
+          }
+          solid = insideCount > 4;
+        }
+
+        occupancy[(static_cast<size_t>(z) * n + y) * n + x] = solid ? 1 : 0;
+      }
+    }
+  }
+
+  std::cout << "Geometry marking complete (CPU)" << std::endl;
+  return occupancy;
+}
+
+void CPUFDTDSolver::applyMaterial(const std::vector<unsigned char> &occupancy,
+                                  float materialEpsilon) {
+  if (occupancy.size() != epsilon.size()) {
+    std::cerr << "Occupancy volume does not match the FDTD grid" << std::endl;
+    return;
+  }
+
+  for (size_t i = 0; i < occupancy.size(); i++)
+    epsilon[i] = occupancy[i] ? materialEpsilon : 1.0f;
+}
+
+size_t CPUFDTDSolver::estimateMemory(int gridSize, int dftCount,
+                                     int probeCount, int steps) {
+  size_t cells = static_cast<size_t>(gridSize) * gridSize * gridSize;
+  // Six field components plus epsilon, the per-step source scatter and the
+  // DFT accumulators
+  size_t fields = cells * sizeof(float) * 8;
+  size_t dft = cells * sizeof(glm::vec2) * dftCount;
+  size_t probes = static_cast<size_t>(probeCount) * steps * sizeof(ProbeSample);
+  return fields + dft + probes;
+}
+
+void CPUFDTDSolver::setProbes(const std::vector<FDTDProbe> &probes) {
+  probeList = probes;
+  for (auto &probe : probeList) {
+    probe.cell =
+        glm::clamp(probe.cell, glm::ivec3(0), glm::ivec3(gridSize - 1));
+  }
+  probeHistory.assign(probeList.size(), {});
+}
+
+float CPUFDTDSolver::getProbeRSSI(int index, int window) const {
+  if (index < 0 || index >= static_cast<int>(probeHistory.size()))
+    return -120.0f;
+
+  const auto &history = probeHistory[index];
+  size_t count = std::min(history.size(), static_cast<size_t>(window));
+  if (count == 0)
+    return -120.0f;
+
+  double power = 0.0;
+  for (size_t i = history.size() - count; i < history.size(); i++) {
+    power += history[i].ez * history[i].ez;
+  }
+  power /= count;
+  return 10.0f * std::log10(std::max(power, 1e-12));
+}
+
+void CPUFDTDSolver::setDFTFrequencies(const std::vector<float> &frequencies) {
+  dftFrequencies.assign(frequencies.begin(),
+                        frequencies.begin() +
+                            std::min<size_t>(frequencies.size(), 2));
+  dftAccumulators.assign(dftFrequencies.size(),
+                         std::vector<glm::vec2>(ez.size(), glm::vec2(0.0f)));
+  dftSampleCount = 0;
+}
+
+glm::vec2 CPUFDTDSolver::getDFTPhasor(int index,
+                                      const glm::ivec3 &cell) const {
+  float scale = dftSampleCount > 0 ? 2.0f / dftSampleCount : 0.0f;
+  return dftAccumulators[index][cellIndex(cell.x, cell.y, cell.z)] * scale;
+}
+
+void CPUFDTDSolver::readDFT(int index, std::vector<glm::vec2> &field) const {
+  float scale = dftSampleCount > 0 ? 2.0f / dftSampleCount : 0.0f;
+  const auto &accumulator = dftAccumulators[index];
+  field.resize(accumulator.size());
+  for (size_t i = 0; i < accumulator.size(); i++)
+    field[i] = accumulator[i] * scale;
+}
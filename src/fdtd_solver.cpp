@@ -1,6 +1,10 @@
 #include "fdtd_solver.h"
-#include "spatial_index.h"
+#include "gpu_profiler.h"
+#include "scene_geometry.h"
+#include "trace.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
@@ -11,8 +15,16 @@
 FDTDSolver::FDTDSolver()
     : gridSize(0), voxelSpacing(5.0f), conductivity(0.0001f), texEx(0),
       texEy(0), texEz(0), texHx(0), texHy(0), texHz(0), texEpsilon(0), texMu(0),
-      texEmission(0), updateEProgram(0), updateHProgram(0),
-      markGeometryProgram(0), triangleSSBO(0) {}
+      texEmission(0), texEdgeMask(0), updateEProgram(0), updateHProgram(0),
+      markGeometryProgram(0), edgeMaskProgram(0), triangleSSBO(0),
+      probeProgram(0), probeCellSSBO(0), probeRingSSBO(0), probeRingPtr(nullptr),
+      probeReadInterval(32), probeStep(0), texDFT{0, 0}, dftRegionMin(0),
+      dftRegionSize(0), dftSampleCount(0), timeStep(1e-11f), stepCount(0),
+      brickVolumeProgram(0), texBrick(0), brickVolumeDirty(true),
+      convergenceProgram(0), brickSSBO{0, 0}, brickFences{nullptr, nullptr},
+      brickCheckIndex(0), convergenceStartStep(0), convergenceInterval(512),
+      convergenceTolerance(1e-3f), convergenceStableChecks(3),
+      stopOnConvergence(false), pendingCheckStep{0, 0}, profiler(nullptr) {}
 
 FDTDSolver::~FDTDSolver() { cleanup(); }
 
@@ -100,6 +112,7 @@ GLuint FDTDSolver::createComputeProgram(const char *shaderPath) {
 }
 
 bool FDTDSolver::initialize(int size) {
+  TRACE_SCOPE("FDTDSolver::initialize");
   gridSize = size;
 
   // Create field textures
@@ -115,6 +128,16 @@ bool FDTDSolver::initialize(int size) {
   texMu = createTexture3D(gridSize);
   texEmission = createTexture3D(gridSize);
 
+  glGenTextures(1, &texEdgeMask);
+  glBindTexture(GL_TEXTURE_3D, texEdgeMask);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, gridSize, gridSize, gridSize, 0,
+               GL_RED, GL_UNSIGNED_BYTE, nullptr);
+
   // Initialize epsilon and mu to 1.0 (vacuum)
   std::vector<float> data(gridSize * gridSize * gridSize, 1.0f);
 
@@ -136,12 +159,33 @@ bool FDTDSolver::initialize(int size) {
   updateEProgram = createComputeProgram("shaders/fdtd_update_e.comp");
   updateHProgram = createComputeProgram("shaders/fdtd_update_h.comp");
   markGeometryProgram = createComputeProgram("shaders/mark_geometry.comp");
-
-  if (updateEProgram == 0 || updateHProgram == 0 || markGeometryProgram == 0) {
+  probeProgram = createComputeProgram("shaders/fdtd_probe.comp");
+  convergenceProgram = createComputeProgram("shaders/fdtd_convergence.comp");
+  brickVolumeProgram = createComputeProgram("shaders/fdtd_brick_volume.comp");
+  edgeMaskProgram = createComputeProgram("shaders/fdtd_edge_mask.comp");
+
+  if (updateEProgram == 0 || updateHProgram == 0 || markGeometryProgram == 0 ||
+      probeProgram == 0 || convergenceProgram == 0 ||
+      brickVolumeProgram == 0 || edgeMaskProgram == 0) {
     std::cerr << "Failed to create FDTD compute shaders" << std::endl;
     return false;
   }
 
+  // All vacuum so far: an empty mask
+  updateEdgeMask();
+
+  int bricksPerAxis = (gridSize + BRICK_SIZE - 1) / BRICK_SIZE;
+  glGenTextures(1, &texBrick);
+  glBindTexture(GL_TEXTURE_3D, texBrick);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, bricksPerAxis, bricksPerAxis,
+               bricksPerAxis, 0, GL_RGBA, GL_FLOAT, nullptr);
+  brickVolumeDirty = true;
+
+  // Accumulators follow the grid size
+  allocateDFT();
+
   std::cout << "FDTD Solver initialized with grid size: " << gridSize
             << std::endl;
   return true;
@@ -156,8 +200,11 @@ bool FDTDSolver::reinitialize(int newGridSize) {
 
   // Reset all texture/program IDs to 0
   texEx = texEy = texEz = texHx = texHy = texHz = 0;
-  texEpsilon = texMu = texEmission = 0;
-  updateEProgram = updateHProgram = markGeometryProgram = 0;
+  texEpsilon = texMu = texEmission = texEdgeMask = 0;
+  edgeMaskProgram = 0;
+  updateEProgram = updateHProgram = markGeometryProgram = probeProgram = 0;
+  convergenceProgram = brickVolumeProgram = 0;
+  texBrick = 0;
   triangleSSBO = 0;
 
   // Initialize with new grid size
@@ -173,6 +220,7 @@ void FDTDSolver::addEmissionSource(int x, int y, int z, float strength) {
   glBindTexture(GL_TEXTURE_3D, texEmission);
   glTexSubImage3D(GL_TEXTURE_3D, 0, x, y, z, 1, 1, 1, GL_RED, GL_FLOAT,
                   &strength);
+  brickVolumeDirty = true;
 }
 
 void FDTDSolver::clearEmission() {
@@ -180,9 +228,14 @@ void FDTDSolver::clearEmission() {
   glBindTexture(GL_TEXTURE_3D, texEmission);
   glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, gridSize, gridSize, gridSize,
                   GL_RED, GL_FLOAT, zeros.data());
+  brickVolumeDirty = true;
 }
 
 void FDTDSolver::update() {
+  // Converged with stop-on-convergence set: nothing left to compute
+  if (isHalted())
+    return;
+
   int workGroups = (gridSize + 7) / 8;
 
   // Update E field
@@ -207,8 +260,39 @@ void FDTDSolver::update() {
   glUniform1i(glGetUniformLocation(updateEProgram, "emission"), 2);
 
   glUniform1i(glGetUniformLocation(updateEProgram, "gridSize"), gridSize);
-  glDispatchCompute(workGroups, workGroups, workGroups);
-  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  glUniform1f(glGetUniformLocation(updateEProgram, "conductivityLoss"),
+              conductivityLoss(conductivity, timeStep));
+
+  // DFT phasors e^{-i w n dt} for this step, computed in double precision so
+  // the phase doesn't drift over long runs
+  int dftCount = texDFT[0] ? getDFTFrequencyCount() : 0;
+  float phasors[MAX_DFT_FREQUENCIES * 2] = {0.0f};
+  for (int i = 0; i < dftCount; i++) {
+    double phase = std::fmod(2.0 * M_PI * dftFrequencies[i] * timeStep *
+                                 static_cast<double>(dftSampleCount),
+                             2.0 * M_PI);
+    phasors[i * 2 + 0] = static_cast<float>(std::cos(phase));
+    phasors[i * 2 + 1] = static_cast<float>(-std::sin(phase));
+    glBindImageTexture(6 + i, texDFT[i], 0, GL_TRUE, 0, GL_READ_WRITE,
+                       GL_RG32F);
+  }
+  glm::ivec3 regionMin = getDFTRegionMin();
+  glm::ivec3 regionSize = getDFTRegionSize();
+  glUniform1i(glGetUniformLocation(updateEProgram, "dftCount"), dftCount);
+  glUniform2fv(glGetUniformLocation(updateEProgram, "dftPhasor"),
+               MAX_DFT_FREQUENCIES, phasors);
+  glUniform3i(glGetUniformLocation(updateEProgram, "dftRegionMin"),
+              regionMin.x, regionMin.y, regionMin.z);
+  glUniform3i(glGetUniformLocation(updateEProgram, "dftRegionSize"),
+              regionSize.x, regionSize.y, regionSize.z);
+  if (dftCount > 0)
+    dftSampleCount++;
+
+  {
+    GpuScope scope(profiler, "FDTD E update");
+    glDispatchCompute(workGroups, workGroups, workGroups);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
 
   // Update H field
   glUseProgram(updateHProgram);
@@ -224,8 +308,27 @@ void FDTDSolver::update() {
   glUniform1i(glGetUniformLocation(updateHProgram, "epsilon"), 0);
 
   glUniform1i(glGetUniformLocation(updateHProgram, "gridSize"), gridSize);
-  glDispatchCompute(workGroups, workGroups, workGroups);
-  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  {
+    GpuScope scope(profiler, "FDTD H update");
+    glDispatchCompute(workGroups, workGroups, workGroups);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+
+  sampleProbes();
+  stepCount++;
+  brickVolumeDirty = true;
+
+  // Brick statistics are gathered over the last `window` steps of each
+  // check interval
+  if (convergenceInterval > 0 && convergenceProgram) {
+    int intervalStep = (stepCount - convergenceStartStep) % convergenceInterval;
+    int position = intervalStep == 0 ? convergenceInterval : intervalStep;
+    int window = convergenceWindow();
+    int windowStep = position - (convergenceInterval - window);
+    if (windowStep > 0) {
+      reduceBricks(windowStep > 1, intervalStep == 0);
+    }
+  }
 }
 
 void FDTDSolver::reset() {
@@ -257,19 +360,39 @@ void FDTDSolver::reset() {
                   GL_RED, GL_FLOAT, zeros.data());
 
   clearEmission();
+
+  // In-flight probe blocks belong to the old field; drop them
+  for (auto &fence : probeBlockFences) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+  for (auto &history : probeHistory)
+    history.clear();
+  probeStep = 0;
+
+  resetDFT();
 }
 
 void FDTDSolver::markGeometryGPU(const glm::vec3 &gridCenter,
                                  const glm::vec3 &gridHalfSize,
-                                 const SpatialIndex &spatialIndex,
+                                 const SceneGeometry &spatialIndex,
                                  float groundLevel, float materialEpsilon) {
+  TRACE_SCOPE("FDTDSolver::markGeometryGPU");
   if (!markGeometryProgram) {
     std::cerr << "Mark geometry program not loaded!" << std::endl;
     return;
   }
 
-  // Get triangles from spatial index
-  const auto &triangles = spatialIndex.getTriangles();
+  // Only include triangles within a reasonable distance of the grid (with
+  // per-axis padding)
+  glm::vec3 maxDist = gridHalfSize * 1.5f; // 50% padding per axis
+  glm::vec3 gridMin = gridCenter - maxDist;
+  glm::vec3 gridMax = gridCenter + maxDist;
+
+  std::vector<Triangle> triangles;
+  spatialIndex.queryTriangles(BoundingBox(gridMin, gridMax), triangles);
 
   // Prepare triangle data for GPU (aligned struct)
   struct GPUTriangle {
@@ -284,12 +407,6 @@ void FDTDSolver::markGeometryGPU(const glm::vec3 &gridCenter,
   std::vector<GPUTriangle> gpuTriangles;
   gpuTriangles.reserve(triangles.size());
 
-  // Only include triangles within a reasonable distance of the grid (with
-  // per-axis padding)
-  glm::vec3 maxDist = gridHalfSize * 1.5f; // 50% padding per axis
-  glm::vec3 gridMin = gridCenter - maxDist;
-  glm::vec3 gridMax = gridCenter + maxDist;
-
   for (const auto &tri : triangles) {
     // Simple bounding check - if any vertex is near the grid, include it
     bool nearGrid = false;
@@ -313,7 +430,7 @@ void FDTDSolver::markGeometryGPU(const glm::vec3 &gridCenter,
 
   std::cout << "Uploading " << gpuTriangles.size()
             << " triangles to GPU (filtered from " << triangles.size()
-            << " total)..." << std::endl;
+            << " near the grid)..." << std::endl;
 
   // Create/update SSBO with triangle data
   if (triangleSSBO == 0) {
@@ -346,13 +463,305 @@ void FDTDSolver::markGeometryGPU(const glm::vec3 &gridCenter,
 
   // Dispatch compute shader
   int workGroups = (gridSize + 7) / 8;
-  glDispatchCompute(workGroups, workGroups, workGroups);
-  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  {
+    GpuScope scope(profiler, "Geometry marking");
+    glDispatchCompute(workGroups, workGroups, workGroups);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+  updateEdgeMask();
 
   std::cout << "Geometry marking complete (GPU compute shader)" << std::endl;
 }
 
+void FDTDSolver::updateEdgeMask() {
+  glUseProgram(edgeMaskProgram);
+  glBindImageTexture(0, texEpsilon, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(1, texEdgeMask, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R8);
+  glUniform1i(glGetUniformLocation(edgeMaskProgram, "gridSize"), gridSize);
+
+  int workGroups = (gridSize + 7) / 8;
+  glDispatchCompute(workGroups, workGroups, workGroups);
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+                  GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  brickVolumeDirty = true;
+}
+
+void FDTDSolver::updateBrickVolume() {
+  if (!brickVolumeDirty || !brickVolumeProgram)
+    return;
+
+  glUseProgram(brickVolumeProgram);
+  glBindImageTexture(0, texEz, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  int dftCount = texDFT[0] ? getDFTFrequencyCount() : 0;
+  for (int i = 0; i < dftCount; i++) {
+    glBindImageTexture(1 + i, texDFT[i], 0, GL_TRUE, 0, GL_READ_ONLY,
+                       GL_RG32F);
+  }
+  glBindImageTexture(3, texEmission, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(4, texEdgeMask, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R8);
+  glBindImageTexture(5, texBrick, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+  glm::ivec3 regionMin = getDFTRegionMin();
+  glm::ivec3 regionSize = getDFTRegionSize();
+  glUniform1i(glGetUniformLocation(brickVolumeProgram, "gridSize"), gridSize);
+  glUniform1i(glGetUniformLocation(brickVolumeProgram, "dftCount"), dftCount);
+  glUniform3i(glGetUniformLocation(brickVolumeProgram, "dftRegionMin"),
+              regionMin.x, regionMin.y, regionMin.z);
+  glUniform3i(glGetUniformLocation(brickVolumeProgram, "dftRegionSize"),
+              regionSize.x, regionSize.y, regionSize.z);
+
+  int bricksPerAxis = (gridSize + BRICK_SIZE - 1) / BRICK_SIZE;
+  {
+    GpuScope scope(profiler, "Brick volume");
+    glDispatchCompute(bricksPerAxis, bricksPerAxis, bricksPerAxis);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  }
+  brickVolumeDirty = false;
+}
+
+void FDTDSolver::setProbes(const std::vector<FDTDProbe> &probes) {
+  bool unchanged = probes.size() == probeList.size();
+  for (size_t i = 0; unchanged && i < probes.size(); i++) {
+    unchanged = probes[i].id == probeList[i].id &&
+                probes[i].cell == probeList[i].cell;
+  }
+  if (unchanged && (probes.empty() || probeRingSSBO))
+    return;
+
+  // Keep the history of probes that kept their id and cell
+  std::vector<std::deque<ProbeSample>> keptHistory(probes.size());
+  for (size_t i = 0; i < probes.size(); i++) {
+    for (size_t j = 0; j < probeList.size(); j++) {
+      if (probeList[j].id == probes[i].id &&
+          probeList[j].cell == probes[i].cell) {
+        keptHistory[i] = std::move(probeHistory[j]);
+        break;
+      }
+    }
+  }
+
+  releaseProbes();
+  probeList = probes;
+  probeHistory = std::move(keptHistory);
+
+  if (probeList.empty())
+    return;
+
+  std::vector<glm::ivec4> cells;
+  cells.reserve(probeList.size());
+  for (const auto &probe : probeList) {
+    cells.emplace_back(probe.cell.x, probe.cell.y, probe.cell.z, 0);
+  }
+
+  glGenBuffers(1, &probeCellSSBO);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, probeCellSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, cells.size() * sizeof(glm::ivec4),
+               cells.data(), GL_STATIC_DRAW);
+
+  GLsizeiptr ringSize = static_cast<GLsizeiptr>(PROBE_RING_BLOCKS) *
+                        probeReadInterval * probeList.size() *
+                        sizeof(ProbeSample);
+  const GLbitfield flags =
+      GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+  glGenBuffers(1, &probeRingSSBO);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, probeRingSSBO);
+  // Without immutable storage each finished block is mapped on its own
+  if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, ringSize, nullptr, flags);
+    probeRingPtr = static_cast<const ProbeSample *>(
+        glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, ringSize, flags));
+    if (!probeRingPtr) {
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+      std::cerr << "Failed to map probe ring buffer" << std::endl;
+      releaseProbes();
+      return;
+    }
+  } else {
+    glBufferData(GL_SHADER_STORAGE_BUFFER, ringSize, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  probeBlockFences.assign(PROBE_RING_BLOCKS, nullptr);
+}
+
+int FDTDSolver::findProbe(int id) const {
+  for (size_t i = 0; i < probeList.size(); i++) {
+    if (probeList[i].id == id)
+      return static_cast<int>(i);
+  }
+  return -1;
+}
+
+float FDTDSolver::getProbeRSSI(int index, int window) const {
+  if (index < 0 || index >= static_cast<int>(probeHistory.size()))
+    return -120.0f;
+
+  const auto &history = probeHistory[index];
+  size_t count = std::min(history.size(), static_cast<size_t>(window));
+  if (count == 0)
+    return -120.0f;
+
+  double power = 0.0;
+  for (size_t i = history.size() - count; i < history.size(); i++) {
+    power += history[i].ez * history[i].ez;
+  }
+  power /= count;
+  return 10.0f * std::log10(std::max(power, 1e-12));
+}
+
+void FDTDSolver::setProbeReadInterval(int steps) {
+  steps = std::max(steps, 1);
+  if (steps == probeReadInterval)
+    return;
+
+  probeReadInterval = steps;
+  std::vector<FDTDProbe> probes = probeList;
+  std::vector<std::deque<ProbeSample>> history = std::move(probeHistory);
+  releaseProbes();
+  setProbes(probes);
+  if (probeHistory.size() == history.size())
+    probeHistory = std::move(history);
+}
+
+void FDTDSolver::releaseProbes() {
+  for (auto &fence : probeBlockFences) {
+    if (fence)
+      glDeleteSync(fence);
+  }
+  probeBlockFences.clear();
+
+  if (probeRingPtr) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, probeRingSSBO);
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+  if (probeRingSSBO)
+    glDeleteBuffers(1, &probeRingSSBO);
+  if (probeCellSSBO)
+    glDeleteBuffers(1, &probeCellSSBO);
+
+  probeRingSSBO = 0;
+  probeCellSSBO = 0;
+  probeRingPtr = nullptr;
+  probeList.clear();
+  probeHistory.clear();
+  probeStep = 0;
+}
+
+void FDTDSolver::sampleProbes() {
+  if (probeList.empty() || !probeRingSSBO || !probeProgram)
+    return;
+
+  const int ringSlots = PROBE_RING_BLOCKS * probeReadInterval;
+  const int slot = probeStep % ringSlots;
+  const int block = slot / probeReadInterval;
+
+  // Harvest finished blocks oldest first; fences signal in order, so stop
+  // at the first one still in flight
+  for (int i = 1; i <= PROBE_RING_BLOCKS; i++) {
+    int b = (block + i) % PROBE_RING_BLOCKS;
+    if (!probeBlockFences[b])
+      continue;
+    GLenum status = glClientWaitSync(probeBlockFences[b], 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+      break;
+    readProbeBlock(b, false);
+  }
+
+  // About to overwrite a block the CPU has not read yet (GPU is more than a
+  // full ring ahead): this is the only case that waits
+  if (slot % probeReadInterval == 0 && probeBlockFences[block]) {
+    readProbeBlock(block, true);
+  }
+
+  glUseProgram(probeProgram);
+  glBindImageTexture(0, texEx, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(1, texEy, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(2, texEz, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(3, texHx, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(4, texHy, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(5, texHz, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, probeCellSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, probeRingSSBO);
+
+  glUniform1i(glGetUniformLocation(probeProgram, "probeCount"),
+              static_cast<int>(probeList.size()));
+  glUniform1i(glGetUniformLocation(probeProgram, "slot"), slot);
+  glDispatchCompute((static_cast<GLuint>(probeList.size()) + 63) / 64, 1, 1);
+
+  probeStep++;
+
+  if ((slot + 1) % probeReadInterval == 0) {
+    glMemoryBarrier(probeRingPtr ? GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT
+                                 : GL_BUFFER_UPDATE_BARRIER_BIT);
+    probeBlockFences[block] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}
+
+void FDTDSolver::readProbeBlock(int block, bool wait) {
+  GLsync fence = probeBlockFences[block];
+  if (!fence)
+    return;
+
+  if (wait) {
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+  }
+  glDeleteSync(fence);
+  probeBlockFences[block] = nullptr;
+
+  const size_t count = probeList.size();
+  const size_t blockOffset = static_cast<size_t>(block) * probeReadInterval *
+                             count;
+  const ProbeSample *samples = probeRingPtr ? probeRingPtr + blockOffset
+                                            : nullptr;
+  if (!samples) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, probeRingSSBO);
+    samples = static_cast<const ProbeSample *>(glMapBufferRange(
+        GL_SHADER_STORAGE_BUFFER, blockOffset * sizeof(ProbeSample),
+        probeReadInterval * count * sizeof(ProbeSample), GL_MAP_READ_BIT));
+    if (!samples) {
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+      return;
+    }
+  }
+
+  for (int s = 0; s < probeReadInterval; s++) {
+    const ProbeSample *slotSamples = samples + s * count;
+    for (size_t p = 0; p < count; p++) {
+      auto &history = probeHistory[p];
+      history.push_back(slotSamples[p]);
+      if (history.size() > PROBE_HISTORY_LENGTH)
+        history.pop_front();
+    }
+  }
+
+  if (!probeRingPtr) {
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+}
+
 void FDTDSolver::cleanup() {
+  releaseProbes();
+  releaseDFT();
+  releaseConvergence();
+  if (convergenceProgram) {
+    glDeleteProgram(convergenceProgram);
+    convergenceProgram = 0;
+  }
+  if (brickVolumeProgram) {
+    glDeleteProgram(brickVolumeProgram);
+    brickVolumeProgram = 0;
+  }
+  if (texBrick) {
+    glDeleteTextures(1, &texBrick);
+    texBrick = 0;
+  }
+  if (probeProgram) {
+    glDeleteProgram(probeProgram);
+    probeProgram = 0;
+  }
   if (texEx)
     glDeleteTextures(1, &texEx);
   if (texEy)
@@ -371,6 +780,10 @@ void FDTDSolver::cleanup() {
     glDeleteTextures(1, &texMu);
   if (texEmission)
     glDeleteTextures(1, &texEmission);
+  if (texEdgeMask)
+    glDeleteTextures(1, &texEdgeMask);
+  if (edgeMaskProgram)
+    glDeleteProgram(edgeMaskProgram);
   if (updateEProgram)
     glDeleteProgram(updateEProgram);
   if (updateHProgram)
@@ -381,3 +794,285 @@ void FDTDSolver::cleanup() {
   if (triangleSSBO)
     glDeleteBuffers(1, &triangleSSBO);
 }
+
+void FDTDSolver::setDFTFrequencies(const std::vector<float> &frequencies) {
+  std::vector<float> requested(
+      frequencies.begin(),
+      frequencies.begin() + std::min<size_t>(frequencies.size(),
+                                             MAX_DFT_FREQUENCIES));
+  if (requested == dftFrequencies)
+    return;
+
+  dftFrequencies = requested;
+  allocateDFT();
+}
+
+void FDTDSolver::setDFTRegion(const glm::ivec3 &regionMin,
+                              const glm::ivec3 &regionSize) {
+  if (regionMin == dftRegionMin && regionSize == dftRegionSize)
+    return;
+
+  dftRegionMin = regionMin;
+  dftRegionSize = regionSize;
+  allocateDFT();
+}
+
+glm::ivec3 FDTDSolver::getDFTRegionMin() const {
+  return glm::clamp(dftRegionMin, glm::ivec3(0), glm::ivec3(gridSize - 1));
+}
+
+glm::ivec3 FDTDSolver::getDFTRegionSize() const {
+  glm::ivec3 regionMin = getDFTRegionMin();
+  glm::ivec3 size = dftRegionSize;
+  for (int axis = 0; axis < 3; axis++) {
+    int available = gridSize - regionMin[axis];
+    if (size[axis] <= 0 || size[axis] > available)
+      size[axis] = available;
+  }
+  return size;
+}
+
+void FDTDSolver::releaseDFT() {
+  for (int i = 0; i < MAX_DFT_FREQUENCIES; i++) {
+    if (texDFT[i])
+      glDeleteTextures(1, &texDFT[i]);
+    texDFT[i] = 0;
+  }
+  dftSampleCount = 0;
+}
+
+void FDTDSolver::allocateDFT() {
+  releaseDFT();
+  brickVolumeDirty = true;
+  if (gridSize <= 0 || dftFrequencies.empty())
+    return;
+
+  glm::ivec3 size = getDFTRegionSize();
+  for (size_t i = 0; i < dftFrequencies.size(); i++) {
+    glGenTextures(1, &texDFT[i]);
+    glBindTexture(GL_TEXTURE_3D, texDFT[i]);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RG32F, size.x, size.y, size.z, 0, GL_RG,
+                 GL_FLOAT, nullptr);
+  }
+  resetDFT();
+}
+
+void FDTDSolver::resetDFT() {
+  dftSampleCount = 0;
+  resetConvergence();
+  brickVolumeDirty = true;
+  if (!texDFT[0])
+    return;
+
+  glm::ivec3 size = getDFTRegionSize();
+  std::vector<float> zeros(static_cast<size_t>(size.x) * size.y * size.z * 2,
+                           0.0f);
+  for (int i = 0; i < MAX_DFT_FREQUENCIES; i++) {
+    if (!texDFT[i])
+      continue;
+    glBindTexture(GL_TEXTURE_3D, texDFT[i]);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, size.x, size.y, size.z, GL_RG,
+                    GL_FLOAT, zeros.data());
+  }
+}
+
+bool FDTDSolver::readDFT(int index, std::vector<glm::vec2> &field) const {
+  if (index < 0 || index >= getDFTFrequencyCount() || !texDFT[index])
+    return false;
+
+  glm::ivec3 size = getDFTRegionSize();
+  field.resize(static_cast<size_t>(size.x) * size.y * size.z);
+
+  glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+  glBindTexture(GL_TEXTURE_3D, texDFT[index]);
+  glGetTexImage(GL_TEXTURE_3D, 0, GL_RG, GL_FLOAT, field.data());
+
+  float scale = getDFTNormalization();
+  for (auto &value : field)
+    value *= scale;
+  return true;
+}
+
+void FDTDSolver::setConvergenceCheck(int intervalSteps, float tolerance,
+                                     int stableChecks) {
+  convergenceInterval = std::max(0, intervalSteps);
+  convergenceTolerance = tolerance;
+  convergenceStableChecks = std::max(1, stableChecks);
+  resetConvergence();
+}
+
+void FDTDSolver::resetConvergence() {
+  for (int i = 0; i < 2; i++) {
+    if (brickFences[i])
+      glDeleteSync(brickFences[i]);
+    brickFences[i] = nullptr;
+  }
+  previousBrickStats.clear();
+  convergenceStatus = ConvergenceStatus();
+  convergenceStartStep = stepCount;
+  brickCheckIndex = 0;
+}
+
+void FDTDSolver::releaseConvergence() {
+  resetConvergence();
+  for (int i = 0; i < 2; i++) {
+    if (brickSSBO[i])
+      glDeleteBuffers(1, &brickSSBO[i]);
+    brickSSBO[i] = 0;
+  }
+}
+
+int FDTDSolver::convergenceWindow() const {
+  if (dftFrequencies.empty())
+    return 1;
+
+  // Instantaneous energy oscillates at twice the source frequency; average
+  // it over the whole number of periods of the lowest frequency that lands
+  // closest to an integer step count
+  float frequency =
+      *std::min_element(dftFrequencies.begin(), dftFrequencies.end());
+  double periodSteps = 1.0 / (static_cast<double>(frequency) * timeStep);
+  if (!(periodSteps >= 1.0))
+    return 1;
+
+  int best = static_cast<int>(std::round(periodSteps));
+  double bestError = std::abs(best - periodSteps) / periodSteps;
+  for (int periods = 2; periods <= 8; periods++) {
+    double steps = periods * periodSteps;
+    if (steps > convergenceInterval / 2)
+      break;
+    double error = std::abs(std::round(steps) - steps) / steps;
+    if (error < bestError) {
+      best = static_cast<int>(std::round(steps));
+      bestError = error;
+    }
+  }
+  return std::max(1, std::min(best, convergenceInterval));
+}
+
+void FDTDSolver::reduceBricks(bool accumulate, bool includeDFT) {
+  int bricksPerAxis = (gridSize + 7) / 8;
+  size_t brickCount =
+      static_cast<size_t>(bricksPerAxis) * bricksPerAxis * bricksPerAxis;
+  int buffer = brickCheckIndex % 2;
+
+  if (!brickSSBO[0]) {
+    glGenBuffers(2, brickSSBO);
+    for (int i = 0; i < 2; i++) {
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, brickSSBO[i]);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, brickCount * sizeof(glm::vec2),
+                   nullptr, GL_DYNAMIC_READ);
+    }
+  }
+
+  glUseProgram(convergenceProgram);
+  glBindImageTexture(0, texEx, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(1, texEy, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(2, texEz, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(3, texHx, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(4, texHy, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(5, texHz, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, brickSSBO[buffer]);
+
+  int dftCount = includeDFT && texDFT[0] ? getDFTFrequencyCount() : 0;
+  for (int i = 0; i < dftCount; i++) {
+    glBindImageTexture(6 + i, texDFT[i], 0, GL_TRUE, 0, GL_READ_ONLY,
+                       GL_RG32F);
+  }
+  glm::ivec3 regionMin = getDFTRegionMin();
+  glm::ivec3 regionSize = getDFTRegionSize();
+
+  glUniform1i(glGetUniformLocation(convergenceProgram, "gridSize"), gridSize);
+  glUniform1i(glGetUniformLocation(convergenceProgram, "accumulate"),
+              accumulate);
+  glUniform1i(glGetUniformLocation(convergenceProgram, "dftCount"), dftCount);
+  glUniform1f(glGetUniformLocation(convergenceProgram, "dftScale"),
+              getDFTNormalization());
+  glUniform3i(glGetUniformLocation(convergenceProgram, "dftRegionMin"),
+              regionMin.x, regionMin.y, regionMin.z);
+  glUniform3i(glGetUniformLocation(convergenceProgram, "dftRegionSize"),
+              regionSize.x, regionSize.y, regionSize.z);
+
+  glDispatchCompute(bricksPerAxis, bricksPerAxis, bricksPerAxis);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  if (!includeDFT)
+    return;
+
+  // Last step of the window: fence this buffer and evaluate the previous
+  // one, which finished an interval ago and can be read without a stall
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  brickFences[buffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  pendingCheckStep[buffer] = stepCount;
+  brickCheckIndex++;
+
+  evaluateBricks(brickCheckIndex % 2);
+}
+
+void FDTDSolver::evaluateBricks(int buffer) {
+  GLsync fence = brickFences[buffer];
+  if (!fence)
+    return;
+
+  glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+  glDeleteSync(fence);
+  brickFences[buffer] = nullptr;
+
+  int bricksPerAxis = (gridSize + 7) / 8;
+  brickStats.resize(static_cast<size_t>(bricksPerAxis) * bricksPerAxis *
+                    bricksPerAxis);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, brickSSBO[buffer]);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                     brickStats.size() * sizeof(glm::vec2), brickStats.data());
+
+  // Energy was summed over the window, make it a mean
+  float window = static_cast<float>(convergenceWindow());
+  for (auto &brick : brickStats)
+    brick.x /= window;
+
+  if (previousBrickStats.size() == brickStats.size()) {
+    float maxEnergy = 0.0f, maxAmplitude = 0.0f;
+    float energyChange = 0.0f, amplitudeChange = 0.0f;
+    float totalEnergy = 0.0f;
+    for (size_t i = 0; i < brickStats.size(); i++) {
+      maxEnergy = std::max(maxEnergy, brickStats[i].x);
+      maxAmplitude = std::max(maxAmplitude, brickStats[i].y);
+      energyChange = std::max(
+          energyChange, std::abs(brickStats[i].x - previousBrickStats[i].x));
+      amplitudeChange = std::max(
+          amplitudeChange, std::abs(brickStats[i].y - previousBrickStats[i].y));
+      totalEnergy += brickStats[i].x;
+    }
+
+    ConvergenceStatus &status = convergenceStatus;
+    status.step = pendingCheckStep[buffer];
+    status.totalEnergy = totalEnergy;
+    status.energyDelta = maxEnergy > 0.0f ? energyChange / maxEnergy : 1.0f;
+    status.dftDelta = dftFrequencies.empty()
+                          ? 0.0f
+                          : (maxAmplitude > 0.0f
+                                 ? amplitudeChange / maxAmplitude
+                                 : 1.0f);
+
+    // An empty field is not a steady state
+    bool stable = maxEnergy > 0.0f &&
+                  status.energyDelta < convergenceTolerance &&
+                  status.dftDelta < convergenceTolerance;
+    status.stableChecks = stable ? status.stableChecks + 1 : 0;
+    if (!stable)
+      status.converged = false;
+
+    if (!status.converged && status.stableChecks >= convergenceStableChecks) {
+      status.converged = true;
+      if (convergenceCallback)
+        convergenceCallback(status);
+    }
+  }
+
+  previousBrickStats.swap(brickStats);
+}
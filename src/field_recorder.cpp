@@ -0,0 +1,179 @@
+#include "field_recorder.h"
+#include "trace.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const uint32_t RECORDING_VERSION = 1;
+
+// Runs shorter than this stay in the literal packets around them
+const size_t MIN_RUN = 3;
+
+} // namespace
+
+FieldRecorder::FieldRecorder()
+    : recording(false), stopping(false), fieldSize(0), interval(1),
+      framesWritten(0), framesDropped(0), bytesWritten(0), rawBytes(0) {}
+
+FieldRecorder::~FieldRecorder() { stop(); }
+
+bool FieldRecorder::start(const std::string &path, const glm::ivec3 &size) {
+  stop();
+
+  file.open(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+
+  const int32_t dimensions[3] = {size.x, size.y, size.z};
+  file.write("HFRC", 4);
+  file.write(reinterpret_cast<const char *>(&RECORDING_VERSION),
+             sizeof(RECORDING_VERSION));
+  file.write(reinterpret_cast<const char *>(dimensions), sizeof(dimensions));
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    fieldSize = size;
+    recording = true;
+    stopping = false;
+    framesWritten = framesDropped = 0;
+    bytesWritten = 4 + sizeof(RECORDING_VERSION) + sizeof(dimensions);
+    rawBytes = 0;
+  }
+  worker = std::thread(&FieldRecorder::run, this);
+  std::cout << "Recording field to " << path << std::endl;
+  return true;
+}
+
+void FieldRecorder::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!recording)
+      return;
+    recording = false;
+    stopping = true;
+  }
+  condition.notify_all();
+  if (worker.joinable())
+    worker.join();
+  file.close();
+
+  std::cout << "Recorded " << framesWritten << " frames (" << framesDropped
+            << " dropped), " << bytesWritten / (1024 * 1024) << " MB"
+            << std::endl;
+}
+
+bool FieldRecorder::isRecording() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return recording;
+}
+
+bool FieldRecorder::enqueue(uint64_t step, std::vector<float> &&values) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!recording)
+      return false;
+    const size_t expected =
+        static_cast<size_t>(fieldSize.x) * fieldSize.y * fieldSize.z;
+    if (values.size() != expected || queue.size() >= MAX_QUEUED) {
+      framesDropped++;
+      return false;
+    }
+    queue.push_back({step, std::move(values)});
+  }
+  condition.notify_one();
+  return true;
+}
+
+size_t FieldRecorder::getFramesWritten() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return framesWritten;
+}
+
+size_t FieldRecorder::getFramesDropped() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return framesDropped;
+}
+
+size_t FieldRecorder::getBytesWritten() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return bytesWritten;
+}
+
+size_t FieldRecorder::getRawBytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return rawBytes;
+}
+
+void FieldRecorder::encode(const std::vector<float> &values,
+                           std::vector<uint32_t> &words) {
+  // Compared bit for bit, so -0.0 and NaN payloads survive the round trip
+  const size_t count = values.size();
+  std::vector<uint32_t> bits(count);
+  if (count > 0)
+    std::memcpy(bits.data(), values.data(), count * sizeof(float));
+
+  auto runLength = [&](size_t i) {
+    size_t length = 1;
+    while (i + length < count && bits[i + length] == bits[i])
+      length++;
+    return length;
+  };
+
+  words.clear();
+  size_t i = 0;
+  while (i < count) {
+    size_t run = runLength(i);
+    if (run >= MIN_RUN) {
+      words.push_back(static_cast<uint32_t>(-static_cast<int32_t>(run)));
+      words.push_back(bits[i]);
+      i += run;
+      continue;
+    }
+
+    // Literals up to the next run worth a packet of its own
+    size_t first = i;
+    while (i < count && (run = runLength(i)) < MIN_RUN)
+      i += run;
+    words.push_back(static_cast<uint32_t>(i - first));
+    words.insert(words.end(), bits.begin() + first, bits.begin() + i);
+  }
+}
+
+void FieldRecorder::run() {
+  std::vector<uint32_t> words;
+  while (true) {
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [&] { return stopping || !queue.empty(); });
+      if (queue.empty())
+        return;
+      frame = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    TRACE_SCOPE("FieldRecorder::writeFrame");
+    encode(frame.values, words);
+    const uint32_t wordCount = static_cast<uint32_t>(words.size());
+    file.write(reinterpret_cast<const char *>(&frame.step),
+               sizeof(frame.step));
+    file.write(reinterpret_cast<const char *>(&wordCount), sizeof(wordCount));
+    file.write(reinterpret_cast<const char *>(words.data()),
+               words.size() * sizeof(uint32_t));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file) {
+      std::cerr << "Failed to write field recording frame" << std::endl;
+      framesDropped++;
+      continue;
+    }
+    framesWritten++;
+    bytesWritten += sizeof(frame.step) + sizeof(wordCount) +
+                    words.size() * sizeof(uint32_t);
+    rawBytes += frame.values.size() * sizeof(float);
+  }
+}
@@ -0,0 +1,183 @@
+#include "gpu_profiler.h"
+#include "trace.h"
+
+#include <algorithm>
+
+GpuProfiler::GpuProfiler()
+    : enabled(true), enabledNextFrame(true), frameOpen(false), gpuDepth(0),
+      frameCounter(0), droppedFrames(0), currentSlot(0), frameStartUs(0.0),
+      gpuTrack(0), epoch(std::chrono::steady_clock::now()) {}
+
+GpuProfiler::~GpuProfiler() {}
+
+void GpuProfiler::cleanup() {
+  for (auto &slot : slots) {
+    if (!slot.queries.empty()) {
+      glDeleteQueries(static_cast<GLsizei>(slot.queries.size()),
+                      slot.queries.data());
+    }
+    slot = FrameSlot();
+  }
+  frameOpen = false;
+  gpuDepth = 0;
+}
+
+double GpuProfiler::nowUs() const {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+int GpuProfiler::internName(std::vector<std::string> &names,
+                            const char *name) {
+  for (size_t i = 0; i < names.size(); i++) {
+    if (names[i] == name)
+      return static_cast<int>(i);
+  }
+  names.push_back(name);
+  return static_cast<int>(names.size() - 1);
+}
+
+void GpuProfiler::beginFrame() {
+  enabled = enabledNextFrame;
+  if (!enabled)
+    return;
+
+  frameCounter++;
+  currentSlot = static_cast<int>(frameCounter % FRAME_LATENCY);
+
+  // The slot's previous frame was FRAME_LATENCY frames ago
+  FrameSlot &slot = slots[currentSlot];
+  if (slot.pending)
+    collectSlot(slot);
+
+  slot.frame = frameCounter;
+  slot.pending = false;
+  slot.issued.clear();
+  slot.cpuMs.assign(cpuStageNames.size(), 0.0f);
+  cpuStack.clear();
+
+  frameStartUs = nowUs();
+  frameOpen = true;
+}
+
+void GpuProfiler::endFrame() {
+  if (!frameOpen)
+    return;
+
+  if (gpuDepth > 0) {
+    gpuDepth = 1;
+    endGpu();
+  }
+  while (!cpuStack.empty())
+    endCpu();
+
+  FrameSlot &slot = slots[currentSlot];
+  slot.cpuFrameMs = static_cast<float>((nowUs() - frameStartUs) / 1000.0);
+  slot.pending = true;
+  frameOpen = false;
+}
+
+void GpuProfiler::beginGpu(const char *name) {
+  if (!frameOpen)
+    return;
+
+  // Time-elapsed queries cannot nest: inner passes count towards the outer
+  if (gpuDepth++ > 0)
+    return;
+
+  FrameSlot &slot = slots[currentSlot];
+  size_t index = slot.issued.size();
+  if (index == slot.queries.size()) {
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    slot.queries.push_back(query);
+  }
+
+  glBeginQuery(GL_TIME_ELAPSED, slot.queries[index]);
+  bool traced = Tracer::isEnabled();
+  slot.issued.push_back({internName(gpuPassNames, name),
+                         traced ? name : nullptr,
+                         traced ? Tracer::nowNs() : 0});
+}
+
+void GpuProfiler::endGpu() {
+  if (gpuDepth == 0 || --gpuDepth > 0)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GpuProfiler::beginCpu(const char *name) {
+  bool traced = Tracer::isEnabled();
+  if (!frameOpen && !traced)
+    return;
+  cpuStack.push_back({frameOpen ? internName(cpuStageNames, name) : -1,
+                      nowUs(), traced ? name : nullptr,
+                      traced ? Tracer::nowNs() : 0});
+}
+
+void GpuProfiler::endCpu() {
+  if (cpuStack.empty())
+    return;
+
+  OpenCpuScope scope = cpuStack.back();
+  cpuStack.pop_back();
+  if (scope.traceName)
+    Tracer::record(scope.traceName, scope.traceStartNs, Tracer::nowNs());
+  if (scope.nameIndex < 0)
+    return;
+
+  FrameSlot &slot = slots[currentSlot];
+  if (cpuStack.empty()) {
+    if (slot.cpuMs.size() < cpuStageNames.size())
+      slot.cpuMs.resize(cpuStageNames.size(), 0.0f);
+    slot.cpuMs[scope.nameIndex] +=
+        static_cast<float>((nowUs() - scope.startUs) / 1000.0);
+  }
+}
+
+void GpuProfiler::collectSlot(FrameSlot &slot) {
+  slot.pending = false;
+
+  // Queries complete in order; if the last one isn't ready, drop the frame
+  // rather than wait for it
+  size_t count = slot.issued.size();
+  if (count > 0) {
+    GLint available = 0;
+    glGetQueryObjectiv(slot.queries[count - 1], GL_QUERY_RESULT_AVAILABLE,
+                       &available);
+    if (!available) {
+      droppedFrames++;
+      return;
+    }
+  }
+
+  FrameRecord record;
+  record.frame = slot.frame;
+  record.cpuFrameMs = slot.cpuFrameMs;
+  record.gpuMs.assign(gpuPassNames.size(), 0.0f);
+  record.cpuMs = slot.cpuMs;
+  record.cpuMs.resize(cpuStageNames.size(), 0.0f);
+
+  uint64_t gpuCursorNs = 0;
+  for (size_t i = 0; i < count; i++) {
+    GLuint64 elapsedNs = 0;
+    glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &elapsedNs);
+    const PendingQuery &query = slot.issued[i];
+    record.gpuMs[query.nameIndex] += static_cast<float>(elapsedNs / 1.0e6);
+
+    if (query.traceName) {
+      // Queries only measure durations, so passes are laid out back to back
+      // starting no earlier than their submission
+      if (!gpuTrack)
+        gpuTrack = Tracer::addTrack("GPU passes");
+      uint64_t startNs = std::max(query.issueNs, gpuCursorNs);
+      gpuCursorNs = startNs + elapsedNs;
+      Tracer::record(gpuTrack, query.traceName, startNs, gpuCursorNs);
+    }
+  }
+
+  history.push_back(std::move(record));
+  if (history.size() > HISTORY_FRAMES)
+    history.pop_front();
+}
@@ -0,0 +1,364 @@
+#include "image_method_solver.h"
+#include "radio_system.h"
+#include "scene_geometry.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+
+const float SPEED_OF_LIGHT = 299792458.0f;
+
+bool pointInTriangle(const glm::vec3 &p, const Triangle &tri) {
+  const float tolerance = 1e-4f;
+  glm::vec3 e0 = tri.v1 - tri.v0;
+  glm::vec3 e1 = tri.v2 - tri.v0;
+  glm::vec3 ep = p - tri.v0;
+
+  float d00 = glm::dot(e0, e0);
+  float d01 = glm::dot(e0, e1);
+  float d11 = glm::dot(e1, e1);
+  float d20 = glm::dot(ep, e0);
+  float d21 = glm::dot(ep, e1);
+  float denom = d00 * d11 - d01 * d01;
+  if (std::abs(denom) < 1e-12f)
+    return false;
+
+  float v = (d11 * d20 - d01 * d21) / denom;
+  float w = (d00 * d21 - d01 * d20) / denom;
+  return v >= -tolerance && w >= -tolerance && v + w <= 1.0f + tolerance;
+}
+
+glm::vec3 mirror(const glm::vec3 &p, const Triangle &tri) {
+  float d = glm::dot(tri.normal, p - tri.v0);
+  return p - 2.0f * d * tri.normal;
+}
+
+void toAngles(const glm::vec3 &dir, float &azimuth, float &elevation) {
+  azimuth = glm::degrees(std::atan2(dir.z, dir.x));
+  elevation = glm::degrees(std::asin(glm::clamp(dir.y, -1.0f, 1.0f)));
+}
+
+} // namespace
+
+ImageMethodSolver::ImageMethodSolver()
+    : maxBounces(2), searchRadius(500.0f), maxCandidateFaces(64),
+      relativePermittivity(5.0f), cachedSpatialIndex(nullptr),
+      cachedGeneration(0), linksValid(false) {}
+
+void ImageMethodSolver::setMaxBounces(int bounces) {
+  if (bounces != maxBounces) {
+    maxBounces = bounces;
+    invalidate();
+  }
+}
+
+void ImageMethodSolver::setSearchRadius(float radius) {
+  if (radius != searchRadius) {
+    searchRadius = radius;
+    invalidate();
+  }
+}
+
+void ImageMethodSolver::setMaxCandidateFaces(int count) {
+  if (count != maxCandidateFaces) {
+    maxCandidateFaces = count;
+    invalidate();
+  }
+}
+
+const RadioLink *ImageMethodSolver::findLink(int transmitterId,
+                                             int receiverId) const {
+  for (const auto &link : links) {
+    if (link.transmitterId == transmitterId && link.receiverId == receiverId)
+      return &link;
+  }
+  return nullptr;
+}
+
+void ImageMethodSolver::computeLinks(const RadioSystem &radioSystem,
+                                     const SceneGeometry &spatialIndex) {
+  TRACE_SCOPE("ImageMethodSolver::computeLinks");
+  if (&spatialIndex != cachedSpatialIndex ||
+      spatialIndex.getGeneration() != cachedGeneration) {
+    cachedSpatialIndex = &spatialIndex;
+    cachedGeneration = spatialIndex.getGeneration();
+    invalidate();
+  }
+
+  std::vector<const RadioSource *> transmitters;
+  std::vector<const RadioSource *> receivers;
+  std::vector<NodeInput> inputs;
+  for (const auto &source : radioSystem.getSources()) {
+    if (!source.active)
+      continue;
+    if (source.type == NodeType::TRANSMITTER)
+      transmitters.push_back(&source);
+    else if (source.type == NodeType::RECEIVER)
+      receivers.push_back(&source);
+    else
+      continue;
+    inputs.push_back({source.id, source.type == NodeType::TRANSMITTER,
+                      source.position, source.frequency});
+  }
+
+  if (linksValid && inputs == cachedInputs)
+    return;
+  cachedInputs.swap(inputs);
+  linksValid = true;
+
+  // Drop trees of transmitters that no longer exist
+  for (auto it = imageTrees.begin(); it != imageTrees.end();) {
+    bool alive = std::any_of(
+        transmitters.begin(), transmitters.end(),
+        [&](const RadioSource *tx) { return tx->id == it->first; });
+    it = alive ? std::next(it) : imageTrees.erase(it);
+  }
+
+  // Rebuild trees only for transmitters that moved
+  for (const RadioSource *tx : transmitters) {
+    auto it = imageTrees.find(tx->id);
+    if (it == imageTrees.end() || it->second.position != tx->position) {
+      ImageTree &tree = imageTrees[tx->id];
+      buildImageTree(tx->position, spatialIndex, tree);
+    }
+  }
+
+  links.assign(transmitters.size() * receivers.size(), RadioLink());
+  if (links.empty())
+    return;
+
+#pragma omp parallel for schedule(dynamic)
+  for (long i = 0; i < static_cast<long>(links.size()); i++) {
+    const RadioSource *tx = transmitters[i / receivers.size()];
+    const RadioSource *rx = receivers[i % receivers.size()];
+
+    RadioLink &link = links[i];
+    link.transmitterId = tx->id;
+    link.receiverId = rx->id;
+    solveLink(imageTrees.at(tx->id), tx->position, rx->position,
+              tx->frequency, spatialIndex, link);
+  }
+}
+
+void ImageMethodSolver::buildImageTree(const glm::vec3 &transmitter,
+                                       const SceneGeometry &spatialIndex,
+                                       ImageTree &tree) const {
+  tree.position = transmitter;
+  tree.faces.clear();
+  tree.nodes.clear();
+
+  if (maxBounces <= 0)
+    return;
+
+  // Candidate faces: BVH query around the transmitter, then keep the faces
+  // with the largest projected solid angle that face the transmitter
+  BoundingBox searchBox(transmitter - glm::vec3(searchRadius),
+                        transmitter + glm::vec3(searchRadius));
+  std::vector<Triangle> nearby;
+  spatialIndex.queryTriangles(searchBox, nearby);
+
+  std::vector<std::pair<float, unsigned int>> scored;
+  scored.reserve(nearby.size());
+  for (unsigned int idx = 0; idx < nearby.size(); idx++) {
+    const Triangle &tri = nearby[idx];
+    float d = glm::dot(tri.normal, transmitter - tri.v0);
+    if (d <= 0.01f)
+      continue;
+
+    float area = 0.5f * glm::length(glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+    glm::vec3 centroid = (tri.v0 + tri.v1 + tri.v2) / 3.0f;
+    float r = std::max(glm::distance(transmitter, centroid), 1.0f);
+    scored.emplace_back(area * d / (r * r * r), idx);
+  }
+
+  size_t keep = std::min(scored.size(), static_cast<size_t>(maxCandidateFaces));
+  std::partial_sort(scored.begin(), scored.begin() + keep, scored.end(),
+                    [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  tree.faces.reserve(keep);
+  for (size_t i = 0; i < keep; i++)
+    tree.faces.push_back(nearby[scored[i].second]);
+  const std::vector<Triangle> &faces = tree.faces;
+  const unsigned int faceCount = static_cast<unsigned int>(faces.size());
+
+  // First-order images
+  for (unsigned int idx = 0; idx < faceCount; idx++) {
+    tree.nodes.push_back({mirror(transmitter, faces[idx]), -1, idx});
+  }
+
+  // Higher orders: reflect the parent image across faces that lie in front
+  // of the parent face and see the parent image from their front side
+  size_t levelBegin = 0;
+  for (int depth = 1; depth < maxBounces; depth++) {
+    size_t levelEnd = tree.nodes.size();
+    for (size_t n = levelBegin; n < levelEnd; n++) {
+      const ImageNode parent = tree.nodes[n];
+      const Triangle &parentTri = faces[parent.faceIndex];
+
+      for (unsigned int idx = 0; idx < faceCount; idx++) {
+        if (idx == parent.faceIndex)
+          continue;
+        const Triangle &tri = faces[idx];
+        if (glm::dot(tri.normal, parent.image - tri.v0) <= 0.01f)
+          continue;
+
+        bool inFront = false;
+        for (const auto &v : {tri.v0, tri.v1, tri.v2}) {
+          if (glm::dot(parentTri.normal, v - parentTri.v0) > 0.01f) {
+            inFront = true;
+            break;
+          }
+        }
+        if (!inFront)
+          continue;
+
+        tree.nodes.push_back(
+            {mirror(parent.image, tri), static_cast<int>(n), idx});
+      }
+    }
+    levelBegin = levelEnd;
+  }
+}
+
+void ImageMethodSolver::solveLink(const ImageTree &tree,
+                                  const glm::vec3 &transmitter,
+                                  const glm::vec3 &receiver, float frequency,
+                                  const SceneGeometry &spatialIndex,
+                                  RadioLink &link) const {
+  link.paths.clear();
+
+  // Direct path
+  glm::vec3 direct = receiver - transmitter;
+  float directLength = glm::length(direct);
+  if (directLength > 0.0f) {
+    Ray ray;
+    ray.origin = transmitter;
+    ray.direction = direct / directLength;
+    ray.tMin = 0.05f;
+    ray.tMax = directLength - 0.05f;
+    if (!spatialIndex.intersectAny(ray)) {
+      PropagationPath path;
+      path.points = {transmitter, receiver};
+      finalizePath({}, frequency, path);
+      link.paths.push_back(path);
+      link.lineOfSight = true;
+    }
+  }
+
+  std::vector<glm::vec3> points;
+  std::vector<float> incidenceCos;
+  for (size_t n = 0; n < tree.nodes.size(); n++) {
+    if (!traceImagePath(tree, static_cast<int>(n), transmitter, receiver,
+                        spatialIndex, points, incidenceCos))
+      continue;
+
+    PropagationPath path;
+    path.points = points;
+    finalizePath(incidenceCos, frequency, path);
+    link.paths.push_back(std::move(path));
+  }
+
+  std::sort(link.paths.begin(), link.paths.end(),
+            [](const PropagationPath &a, const PropagationPath &b) {
+              return a.lossDb < b.lossDb;
+            });
+
+  float linearGain = 0.0f;
+  for (const auto &path : link.paths)
+    linearGain += std::pow(10.0f, -path.lossDb / 10.0f);
+
+  if (!link.paths.empty()) {
+    link.bestLossDb = link.paths.front().lossDb;
+    link.totalGainDb = 10.0f * std::log10(std::max(linearGain, 1e-30f));
+  }
+}
+
+bool ImageMethodSolver::traceImagePath(
+    const ImageTree &tree, int nodeIndex, const glm::vec3 &transmitter,
+    const glm::vec3 &receiver, const SceneGeometry &spatialIndex,
+    std::vector<glm::vec3> &points, std::vector<float> &incidenceCos) const {
+  points.clear();
+  incidenceCos.clear();
+  points.push_back(receiver);
+
+  // Walk from the receiver back to the transmitter: aim at the image, hit
+  // the image's face, continue towards the parent image
+  glm::vec3 target = receiver;
+  for (int idx = nodeIndex; idx >= 0; idx = tree.nodes[idx].parent) {
+    const ImageNode &node = tree.nodes[idx];
+    const Triangle &tri = tree.faces[node.faceIndex];
+
+    glm::vec3 dir = node.image - target;
+    float denom = glm::dot(tri.normal, dir);
+    if (std::abs(denom) < 1e-6f)
+      return false;
+
+    float t = glm::dot(tri.normal, tri.v0 - target) / denom;
+    if (t <= 0.0f || t >= 1.0f)
+      return false;
+
+    glm::vec3 q = target + dir * t;
+    if (!pointInTriangle(q, tri))
+      return false;
+
+    incidenceCos.push_back(std::abs(denom) / glm::length(dir));
+    points.push_back(q);
+    target = q;
+  }
+  points.push_back(transmitter);
+  std::reverse(points.begin(), points.end());
+  std::reverse(incidenceCos.begin(), incidenceCos.end());
+
+  // Geometry is valid; every leg must also be unobstructed
+  for (size_t s = 0; s + 1 < points.size(); s++) {
+    glm::vec3 leg = points[s + 1] - points[s];
+    float length = glm::length(leg);
+    if (length < 0.1f)
+      continue;
+
+    Ray ray;
+    ray.origin = points[s];
+    ray.direction = leg / length;
+    ray.tMin = 0.05f;
+    ray.tMax = length - 0.05f;
+    if (spatialIndex.intersectAny(ray))
+      return false;
+  }
+
+  return true;
+}
+
+void ImageMethodSolver::finalizePath(const std::vector<float> &incidenceCos,
+                                     float frequency,
+                                     PropagationPath &path) const {
+  path.bounces = static_cast<int>(path.points.size()) - 2;
+  path.length = 0.0f;
+  for (size_t s = 0; s + 1 < path.points.size(); s++)
+    path.length += glm::distance(path.points[s], path.points[s + 1]);
+
+  path.delay = path.length / SPEED_OF_LIGHT;
+
+  // Friis free-space loss over the unfolded path length
+  float distance = std::max(path.length, 1.0f);
+  path.lossDb = 20.0f * std::log10(distance) + 20.0f * std::log10(frequency) -
+                147.55f;
+  for (float c : incidenceCos)
+    path.lossDb += reflectionLossDb(c);
+
+  size_t n = path.points.size();
+  toAngles(glm::normalize(path.points[1] - path.points[0]),
+           path.departureAzimuth, path.departureElevation);
+  toAngles(glm::normalize(path.points[n - 2] - path.points[n - 1]),
+           path.arrivalAzimuth, path.arrivalElevation);
+}
+
+float ImageMethodSolver::reflectionLossDb(float cosIncidence) const {
+  // Fresnel coefficient, perpendicular polarization
+  float sin2 = 1.0f - cosIncidence * cosIncidence;
+  float root = std::sqrt(std::max(relativePermittivity - sin2, 0.0f));
+  float gamma = (cosIncidence - root) / (cosIncidence + root);
+  return -20.0f * std::log10(std::max(std::abs(gamma), 1e-6f));
+}
@@ -1,21 +1,33 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <cstdlib>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <memory>
+#include <string>
 
+#include "async_model_loader.h"
+#include "async_readback.h"
 #include "camera.h"
 #include "fdtd_solver.h"
+#include "field_recorder.h"
+#include "gpu_profiler.h"
+#include "image_method_solver.h"
 #include "model_loader.h"
 #include "node_manager.h"
 #include "node_renderer.h"
 #include "radio_system.h"
 #include "renderer.h"
 #include "scene_serializer.h"
+#include "simulation_scheduler.h"
 #include "spatial_index.h"
+#include "tile_manager.h"
+#include "trace.h"
 #include "ui_manager.h"
 #include "volume_renderer.h"
 
@@ -38,7 +50,7 @@ NodeRenderer *g_nodeRenderer = nullptr;
 struct AppState {
   UIManager *uiManager = nullptr;
   NodeManager *nodeManager = nullptr;
-  SpatialIndex *spatialIndex = nullptr;
+  SceneGeometry *spatialIndex = nullptr;
 
   bool showPlacementPreview = false;
   glm::vec3 placementPreviewPos = glm::vec3(0.0f);
@@ -46,7 +58,6 @@ struct AppState {
   // FDTD simulation state
   bool fdtdEnabled = false;
   bool fdtdPaused = false;
-  int fdtdSimulationSpeed = 1;
   float fdtdEmissionStrength = 0.5f;
   bool fdtdContinuousEmission = true;
   float fdtdEmissionPhase = 0.0f;
@@ -297,7 +308,64 @@ void printControls() {
   std::cout << "==========================================\\n" << std::endl;
 }
 
-int main() {
+// Keep the tiles around the camera and the FDTD grid resident and mirror
+// loads and evictions in the renderer
+void streamTiles(TileManager &tileManager, Renderer &renderer,
+                 const glm::vec3 &gridCenter, const glm::vec3 &gridHalfSize) {
+  const float cameraRadius = 1500.0f;
+  const float gridPadding = 50.0f;
+  glm::vec3 cameraPos = camera.getPosition();
+  std::vector<BoundingBox> regions = {
+      BoundingBox(cameraPos - glm::vec3(cameraRadius),
+                  cameraPos + glm::vec3(cameraRadius)),
+      BoundingBox(gridCenter - gridHalfSize - glm::vec3(gridPadding),
+                  gridCenter + gridHalfSize + glm::vec3(gridPadding))};
+
+  if (!tileManager.update(regions))
+    return;
+
+  for (int tile : tileManager.takeEvictedTiles())
+    renderer.removeMesh(tile);
+  for (auto &loaded : tileManager.takeLoadedMeshes())
+    renderer.queueMesh(loaded.first,
+                       std::make_shared<ModelData>(std::move(loaded.second)));
+}
+
+int main(int argc, char **argv) {
+  std::string tracePath;
+  std::string tilesPath;
+  int tileBudgetMB = 1024;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--trace" && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (arg == "--tiles" && i + 1 < argc) {
+      tilesPath = argv[++i];
+    } else if (arg == "--tile-budget" && i + 1 < argc) {
+      tileBudgetMB = std::atoi(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--trace <out.json>]"
+                << " [--tiles <manifest.txt>] [--tile-budget <MB>]"
+                << std::endl;
+      return -1;
+    }
+  }
+
+  // Startup and frame phases go to a Chrome trace written on exit
+  if (!tracePath.empty()) {
+    Tracer::start();
+    Tracer::setThreadName("Main thread");
+  }
+  uint64_t startupStartNs = Tracer::nowNs();
+
+  // The city loads on worker threads while the window, UI and GL state are
+  // set up; the main loop picks up the mesh and BVH as they finish
+  AsyncModelLoader modelLoader;
+  if (tilesPath.empty()) {
+    std::cout << "Loading Hong Kong city model..." << std::endl;
+    modelLoader.start("hongkong.obj", "hongkong.bvh");
+  }
+
   if (!glfwInit()) {
     std::cerr << "Failed to initialize GLFW" << std::endl;
     return -1;
@@ -348,64 +416,28 @@ int main() {
     return -1;
   }
 
-  std::cout << "Loading Hong Kong city model..." << std::endl;
-  ModelData modelData = ModelLoader::loadOBJ("hongkong.obj");
-
-  if (!modelData.loaded) {
-    std::cerr << "Failed to load model" << std::endl;
-    return -1;
+  // Either the whole city in one BVH, or a tiled dataset streamed around
+  // the camera and the FDTD grid
+  // Queries go to an empty index until the city's BVH arrives. Keeping both
+  // alive means the pointer always changes, which is what tells cached
+  // propagation results to rebuild
+  SpatialIndex emptyGeometry;
+  std::unique_ptr<SpatialIndex> cityIndex;
+  TileManager tileManager;
+  SceneGeometry *geometry = &emptyGeometry;
+  if (!tilesPath.empty()) {
+    if (!tileManager.loadManifest(tilesPath))
+      return -1;
+    tileManager.setKeepMeshes(true);
+    tileManager.setMemoryBudgetMB(
+        static_cast<size_t>(std::max(tileBudgetMB, 1)));
+    geometry = &tileManager;
   }
 
-  std::cout << "Model loaded successfully!" << std::endl;
-  std::cout << "Vertices: " << modelData.vertices.size() / 6 << std::endl;
-  std::cout << "Triangles: " << modelData.indices.size() / 3 << std::endl;
-
-  renderer.setModelData(modelData.vertices, modelData.indices);
-
-  std::cout << "Initializing spatial index..." << std::endl;
-  SpatialIndex spatialIndex;
-
-  const std::string bvhCacheFile = "hongkong.bvh";
-  bool bvhLoaded = spatialIndex.loadBVH(bvhCacheFile);
-
-  if (!bvhLoaded) {
-    std::cout << "Building spatial index from scratch..." << std::endl;
-
-    std::vector<Triangle> triangles;
-    for (size_t i = 0; i < modelData.indices.size(); i += 3) {
-      Triangle tri;
-      unsigned int i0 = modelData.indices[i];
-      unsigned int i1 = modelData.indices[i + 1];
-      unsigned int i2 = modelData.indices[i + 2];
-
-      tri.v0 = glm::vec3(modelData.vertices[i0 * 6 + 0],
-                         modelData.vertices[i0 * 6 + 1],
-                         modelData.vertices[i0 * 6 + 2]);
-      tri.v1 = glm::vec3(modelData.vertices[i1 * 6 + 0],
-                         modelData.vertices[i1 * 6 + 1],
-                         modelData.vertices[i1 * 6 + 2]);
-      tri.v2 = glm::vec3(modelData.vertices[i2 * 6 + 0],
-                         modelData.vertices[i2 * 6 + 1],
-                         modelData.vertices[i2 * 6 + 2]);
-
-      glm::vec3 edge1 = tri.v1 - tri.v0;
-      glm::vec3 edge2 = tri.v2 - tri.v0;
-      tri.normal = glm::normalize(glm::cross(edge1, edge2));
-      tri.id = i / 3;
-
-      triangles.push_back(tri);
-    }
-
-    spatialIndex.build(triangles);
-
-    std::cout << "Saving BVH to cache..." << std::endl;
-    spatialIndex.saveBVH(bvhCacheFile);
-  }
-
-  std::cout << "Spatial index ready!" << std::endl;
-
   RadioSystem radioSystem;
   NodeManager nodeManager(radioSystem);
+  ImageMethodSolver linkSolver;
+  uiManager.setLinkSolver(&linkSolver);
 
   NodeRenderer nodeRenderer;
   g_nodeRenderer = &nodeRenderer; // Set global pointer for callbacks
@@ -427,6 +459,34 @@ int main() {
     return -1;
   }
 
+  uiManager.setProbeSolver(&fdtdSolver);
+
+  // Per-pass GPU timer queries and main-loop stage timings
+  GpuProfiler profiler;
+  fdtdSolver.setProfiler(&profiler);
+  uiManager.setProfiler(&profiler);
+
+  // FDTD steps per second, independent of the frame rate
+  SimulationScheduler simulationScheduler;
+  uiManager.setSimulationScheduler(&simulationScheduler);
+
+  // Ez snapshots for recording: copied through a ring of pixel-pack
+  // buffers, then compressed and written on the recorder's thread
+  FieldRecorder fieldRecorder;
+  AsyncReadback fieldReadback;
+  fieldReadback.initialize(3);
+  fieldReadback.setCallback([&](uint64_t step, std::vector<float> &&values) {
+    fieldRecorder.enqueue(step, std::move(values));
+  });
+  uiManager.setFieldRecorder(&fieldRecorder);
+  uiManager.setFieldReadback(&fieldReadback);
+  int lastRecordedStep = -1;
+  fdtdSolver.setConvergenceCallback([](const ConvergenceStatus &status) {
+    std::cout << "FDTD reached steady state at step " << status.step
+              << " (energy delta " << status.energyDelta << ", DFT delta "
+              << status.dftDelta << ")" << std::endl;
+  });
+
   VolumeRenderer volumeRenderer;
   if (!volumeRenderer.initialize()) {
     std::cerr << "Failed to initialize volume renderer" << std::endl;
@@ -439,10 +499,16 @@ int main() {
       glm::vec3(200.0f, 200.0f, 200.0f); // Grid dimensions in world space
   glm::vec3 lastFdtdGridCenter = fdtdGridCenter;
   glm::vec3 lastFdtdGridHalfSize = fdtdGridHalfSize;
+  std::vector<glm::ivec3> lastTransmitterCells;
+  float lastEmissionStrength = 0.0f;
+
+  if (geometry == &tileManager)
+    streamTiles(tileManager, renderer, fdtdGridCenter, fdtdGridHalfSize);
+  unsigned long long lastGeometryGeneration = geometry->getGeneration();
 
   // Mark geometry using GPU (instant, no performance impact)
   std::cout << "Marking geometry in FDTD grid using GPU..." << std::endl;
-  fdtdSolver.markGeometryGPU(fdtdGridCenter, fdtdGridHalfSize, spatialIndex,
+  fdtdSolver.markGeometryGPU(fdtdGridCenter, fdtdGridHalfSize, *geometry,
                              0.0f, 50.0f);
 
   // Create scene data for save/load functionality
@@ -464,19 +530,30 @@ int main() {
   AppState appState;
   appState.uiManager = &uiManager;
   appState.nodeManager = &nodeManager;
-  appState.spatialIndex = &spatialIndex;
+  appState.spatialIndex = geometry;
   glfwSetWindowUserPointer(window, &appState);
 
   std::cout << "\\nStarting render loop. Press TAB to enable mouse look."
             << std::endl;
 
+  if (Tracer::isEnabled())
+    Tracer::record("Startup", startupStartNs, Tracer::nowNs());
+
+  // Mesh bytes copied to the GPU per frame while a model or tile uploads
+  const size_t UPLOAD_BYTES_PER_FRAME = 16 << 20;
+  bool firstFrame = true;
+
   while (!glfwWindowShouldClose(window)) {
+    TRACE_SCOPE("Frame");
     float currentFrame = static_cast<float>(glfwGetTime());
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
 
     float fps = (deltaTime > 0.0f) ? (1.0f / deltaTime) : 0.0f;
 
+    profiler.beginFrame();
+    profiler.beginCpu("Input");
+
     if (mouseEnabled) {
       double xpos, ypos;
       glfwGetCursorPos(window, &xpos, &ypos);
@@ -503,6 +580,50 @@ int main() {
 
     camera.processInput(window, deltaTime);
 
+    profiler.endCpu();
+    profiler.beginCpu("Streaming");
+
+    if (auto mesh = modelLoader.takeMesh()) {
+      std::cout << "Model loaded: " << mesh->vertices.size() / 6
+                << " vertices, " << mesh->indices.size() / 3 << " triangles"
+                << std::endl;
+      renderer.queueMesh(0, mesh);
+    }
+    if (auto index = modelLoader.takeSpatialIndex()) {
+      std::cout << "Spatial index ready!" << std::endl;
+      cityIndex = std::move(index);
+      geometry = cityIndex.get();
+      appState.spatialIndex = geometry;
+
+      // Marked even while the simulation is off: the grid is only re-marked
+      // when it moves
+      fdtdSolver.reset();
+      fdtdSolver.markGeometryGPU(fdtdGridCenter, fdtdGridHalfSize, *geometry,
+                                 0.0f, 50.0f);
+      lastFdtdGridCenter = fdtdGridCenter;
+      lastFdtdGridHalfSize = fdtdGridHalfSize;
+    }
+    if (modelLoader.hasFailed()) {
+      std::cerr << "Failed to load model" << std::endl;
+      glfwSetWindowShouldClose(window, true);
+    }
+
+    // Tile loads run on this thread, so a new tile stalls the frame it
+    // enters in
+    if (geometry == &tileManager)
+      streamTiles(tileManager, renderer, fdtdGridCenter, fdtdGridHalfSize);
+
+    renderer.processUploads(UPLOAD_BYTES_PER_FRAME);
+
+    profiler.endCpu();
+    profiler.beginCpu("Propagation");
+
+    // Only recomputes when a node or the geometry changed
+    linkSolver.computeLinks(radioSystem, *geometry);
+
+    profiler.endCpu();
+    profiler.beginCpu("FDTD setup");
+
     // Auto-center FDTD grid on transmitter nodes if enabled
     if (appState.fdtdEnabled && appState.fdtdAutoCenterGrid) {
       const auto &nodes = nodeManager.getNodes();
@@ -528,19 +649,7 @@ int main() {
     // Calculate required grid size based on voxel spacing (meters per voxel)
     // This ensures constant resolution regardless of physical grid size
     float voxelSpacing = fdtdSolver.getVoxelSpacing();
-    int requiredGridSizeX =
-        static_cast<int>(std::ceil(fdtdGridHalfSize.x * 2.0f / voxelSpacing));
-    int requiredGridSizeY =
-        static_cast<int>(std::ceil(fdtdGridHalfSize.y * 2.0f / voxelSpacing));
-    int requiredGridSizeZ =
-        static_cast<int>(std::ceil(fdtdGridHalfSize.z * 2.0f / voxelSpacing));
-
-    // Use the maximum dimension for a cubic grid
-    int requiredGridSize = glm::max(
-        glm::max(requiredGridSizeX, requiredGridSizeY), requiredGridSizeZ);
-
-    // Clamp to reasonable range (performance vs detail tradeoff)
-    requiredGridSize = glm::clamp(requiredGridSize, 32, 128);
+    int requiredGridSize = gridSizeForSpacing(fdtdGridHalfSize, voxelSpacing);
 
     // Reinitialize if grid size needs to change
     if (requiredGridSize != fdtdSolver.getGridSize()) {
@@ -548,28 +657,79 @@ int main() {
                 << " to " << requiredGridSize
                 << " (voxel spacing: " << voxelSpacing << "m)" << std::endl;
       fdtdSolver.reinitialize(requiredGridSize);
+      // Frames of another size cannot go into the same file
+      fieldRecorder.stop();
 
       // Force geometry remarking
       lastFdtdGridCenter = fdtdGridCenter + glm::vec3(1000.0f);
     }
 
-    // Re-mark geometry if grid changed (GPU, instant)
-    // Use a larger threshold to avoid resetting too frequently
+    // Re-mark geometry if grid changed (GPU, instant) or tiles streamed in
+    // or out. Use a larger threshold to avoid resetting too frequently
     if (appState.fdtdEnabled &&
         (glm::distance(fdtdGridCenter, lastFdtdGridCenter) > 20.0f ||
-         glm::distance(fdtdGridHalfSize, lastFdtdGridHalfSize) > 20.0f)) {
+         glm::distance(fdtdGridHalfSize, lastFdtdGridHalfSize) > 20.0f ||
+         geometry->getGeneration() != lastGeometryGeneration)) {
       std::cout << "Grid moved significantly - resetting FDTD simulation..."
                 << std::endl;
       fdtdSolver.reset(); // Clear all fields when grid moves
-      fdtdSolver.markGeometryGPU(fdtdGridCenter, fdtdGridHalfSize, spatialIndex,
+      fdtdSolver.markGeometryGPU(fdtdGridCenter, fdtdGridHalfSize, *geometry,
                                  0.0f, 50.0f);
       lastFdtdGridCenter = fdtdGridCenter;
       lastFdtdGridHalfSize = fdtdGridHalfSize;
+      lastGeometryGeneration = geometry->getGeneration();
+    }
+
+    // Sample the field at every active receiver
+    if (appState.fdtdEnabled) {
+      std::vector<FDTDProbe> probes;
+      for (const auto &node : nodeManager.getNodes()) {
+        if (node.type == NodeType::RECEIVER && node.active) {
+          probes.push_back({node.id, worldToGrid(node.position, fdtdGridCenter,
+                                                 fdtdGridHalfSize,
+                                                 fdtdSolver.getGridSize())});
+        }
+      }
+      fdtdSolver.setProbes(probes);
+
+      // Accumulate the steady-state field at the transmitter frequencies
+      std::vector<float> dftFrequencies;
+      for (const auto &node : nodeManager.getNodes()) {
+        if (node.type == NodeType::TRANSMITTER && node.active &&
+            std::find(dftFrequencies.begin(), dftFrequencies.end(),
+                      node.frequency) == dftFrequencies.end()) {
+          dftFrequencies.push_back(node.frequency);
+        }
+      }
+      fdtdSolver.setDFTFrequencies(dftFrequencies);
+
+      // Moving a transmitter or changing its drive invalidates the steady
+      // state (and wakes a solver halted on convergence)
+      std::vector<glm::ivec3> transmitterCells;
+      for (const auto &node : nodeManager.getNodes()) {
+        if (node.type == NodeType::TRANSMITTER && node.active) {
+          transmitterCells.push_back(worldToGrid(node.position, fdtdGridCenter,
+                                                 fdtdGridHalfSize,
+                                                 fdtdSolver.getGridSize()));
+        }
+      }
+      if (transmitterCells != lastTransmitterCells ||
+          appState.fdtdEmissionStrength != lastEmissionStrength) {
+        fdtdSolver.resetConvergence();
+        lastTransmitterCells = transmitterCells;
+        lastEmissionStrength = appState.fdtdEmissionStrength;
+      }
     }
 
-    // Update FDTD simulation if enabled
-    if (appState.fdtdEnabled && !appState.fdtdPaused) {
-      for (int i = 0; i < appState.fdtdSimulationSpeed; i++) {
+    profiler.endCpu();
+    profiler.beginCpu("FDTD stepping");
+
+    // Update FDTD simulation if enabled, as many steps as the scheduler's
+    // rate owes this frame
+    if (appState.fdtdEnabled && !appState.fdtdPaused &&
+        !fdtdSolver.isHalted()) {
+      int steps = simulationScheduler.beginBatch(deltaTime);
+      for (int i = 0; i < steps; i++) {
         // Add continuous oscillating source if enabled
         if (appState.fdtdContinuousEmission) {
           fdtdSolver.clearEmission();
@@ -578,7 +738,7 @@ int main() {
           const float c = 3.0e8f;
 
           // Time step increment (arbitrary time scale for visualization)
-          const float dt = 1e-11f; // 10 picoseconds per simulation step
+          const float dt = fdtdSolver.getTimeStep();
           appState.fdtdEmissionPhase += 2.0f * M_PI * dt;
 
           // Place emission sources at all active transmitter node positions
@@ -593,29 +753,42 @@ int main() {
                            (2.0f * M_PI)) *
                   appState.fdtdEmissionStrength;
 
-              // Convert world position to grid coordinates
-              glm::vec3 localPos = node.position - fdtdGridCenter;
-              glm::vec3 gridPos = (localPos / fdtdGridHalfSize) * 0.5f + 0.5f;
-
-              // Convert to integer grid indices (use dynamic grid size)
-              int currentGridSize = fdtdSolver.getGridSize();
-              int sx = static_cast<int>(gridPos.x * currentGridSize);
-              int sy = static_cast<int>(gridPos.y * currentGridSize);
-              int sz = static_cast<int>(gridPos.z * currentGridSize);
-
-              // Clamp to grid bounds
-              sx = glm::clamp(sx, 0, currentGridSize - 1);
-              sy = glm::clamp(sy, 0, currentGridSize - 1);
-              sz = glm::clamp(sz, 0, currentGridSize - 1);
+              // Convert world position to grid indices (dynamic grid size)
+              glm::ivec3 cell =
+                  worldToGrid(node.position, fdtdGridCenter, fdtdGridHalfSize,
+                              fdtdSolver.getGridSize());
 
-              fdtdSolver.addEmissionSource(sx, sy, sz, oscillation);
+              fdtdSolver.addEmissionSource(cell.x, cell.y, cell.z,
+                                           oscillation);
             }
           }
         }
         fdtdSolver.update();
       }
+      size_t gridSize = fdtdSolver.getGridSize();
+      simulationScheduler.endBatch(gridSize * gridSize * gridSize);
+    } else {
+      simulationScheduler.reset();
+    }
+
+    // Copies from earlier frames are delivered as they complete; a new one
+    // is queued when the interval has passed and a buffer is free
+    fieldReadback.poll();
+    if (appState.fdtdEnabled && fieldRecorder.isRecording()) {
+      int step = fdtdSolver.getStepCount();
+      if ((lastRecordedStep < 0 ||
+           step - lastRecordedStep >= fieldRecorder.getInterval()) &&
+          fieldReadback.request(fdtdSolver.getEzTexture(), GL_RED,
+                                glm::ivec3(fdtdSolver.getGridSize()), step)) {
+        lastRecordedStep = step;
+      }
+    } else {
+      lastRecordedStep = -1;
     }
 
+    profiler.endCpu();
+    profiler.beginCpu("Picking");
+
     if (nodeManager.isPlacementMode() && !mouseEnabled &&
         !uiManager.wantCaptureMouse()) {
       double xpos, ypos;
@@ -628,7 +801,7 @@ int main() {
 
       bool hit;
       glm::vec3 position =
-          nodeManager.pickPosition(rayOrigin, rayDirection, &spatialIndex, hit);
+          nodeManager.pickPosition(rayOrigin, rayDirection, geometry, hit);
 
       appState.placementPreviewPos = position;
       appState.showPlacementPreview = true;
@@ -636,12 +809,18 @@ int main() {
       appState.showPlacementPreview = false;
     }
 
+    profiler.endCpu();
+    profiler.beginCpu("Render");
+
     glm::mat4 view = camera.getViewMatrix();
     glm::mat4 projection = camera.getProjectionMatrix();
     glm::mat4 model = glm::mat4(1.0f);
 
+    profiler.beginGpu("Scene");
     renderer.render(view, projection, model);
+    profiler.endGpu();
 
+    profiler.beginGpu("Nodes");
     int selectedNodeId = nodeManager.getSelectedNodeId();
     nodeRenderer.render(radioSystem, view, projection, selectedNodeId);
 
@@ -653,6 +832,7 @@ int main() {
                                  camera);
       }
     }
+    profiler.endGpu();
 
     // Render FDTD volume if enabled
     if (appState.fdtdEnabled) {
@@ -661,10 +841,27 @@ int main() {
       glDepthMask(
           GL_FALSE); // Don't write to depth buffer for transparent volume
 
+      int dftIndex = volumeRenderer.getDFTIndex();
+      if (dftIndex < fdtdSolver.getDFTFrequencyCount()) {
+        volumeRenderer.setDFTField(fdtdSolver.getDFTTexture(dftIndex),
+                                   fdtdSolver.getDFTRegionMin(),
+                                   fdtdSolver.getDFTRegionSize(),
+                                   fdtdSolver.getDFTNormalization());
+      } else {
+        volumeRenderer.setDFTField(0, glm::ivec3(0), glm::ivec3(0), 0.0f);
+      }
+
+      fdtdSolver.updateBrickVolume();
+      volumeRenderer.setBrickVolume(fdtdSolver.getBrickTexture(),
+                                    FDTDSolver::BRICK_SIZE);
+      volumeRenderer.setSceneDepth(renderer.resolveSceneDepth());
+
+      profiler.beginGpu("Volume raymarch");
       volumeRenderer.render(
-          fdtdSolver.getEzTexture(), fdtdSolver.getEpsilonTexture(),
+          fdtdSolver.getEzTexture(), fdtdSolver.getEdgeMaskTexture(),
           fdtdSolver.getEmissionTexture(), view, projection, fdtdGridCenter,
           fdtdGridHalfSize, fdtdSolver.getGridSize());
+      profiler.endGpu();
 
       glDepthMask(GL_TRUE);
       glDisable(GL_BLEND);
@@ -684,10 +881,15 @@ int main() {
         previewColor = glm::vec3(0.3f, 0.3f, 1.0f);
         break;
       }
+      profiler.beginGpu("Nodes");
       nodeRenderer.renderPlacementPreview(appState.placementPreviewPos,
                                           previewColor, view, projection);
+      profiler.endGpu();
     }
 
+    profiler.endCpu();
+    profiler.beginCpu("UI");
+
     // Update scene data for save/load
     sceneData.cameraPosition = camera.getPosition();
     sceneData.cameraYaw = camera.getYaw();
@@ -703,7 +905,7 @@ int main() {
     uiManager.beginFrame();
     uiManager.render(camera, fps, deltaTime, &nodeManager);
     uiManager.renderFDTDPanel(
-        appState.fdtdEnabled, appState.fdtdPaused, appState.fdtdSimulationSpeed,
+        appState.fdtdEnabled, appState.fdtdPaused,
         appState.fdtdEmissionStrength, appState.fdtdContinuousEmission,
         fdtdGridCenter, fdtdGridHalfSize, appState.fdtdAutoCenterGrid,
         &fdtdSolver, &volumeRenderer);
@@ -724,22 +926,42 @@ int main() {
       uiManager.clearSceneLoadedFlag();
     }
 
+    profiler.beginGpu("UI");
     uiManager.endFrame();
+    profiler.endGpu();
 
     // Update renderer with visual settings
     renderer.setVisualSettings(uiManager.visualSettings);
 
+    profiler.endCpu();
+    profiler.endFrame();
+
     glfwSwapBuffers(window);
     glfwPollEvents();
+
+    if (firstFrame) {
+      firstFrame = false;
+      std::cout << "First frame after "
+                << (Tracer::nowNs() - startupStartNs) / 1000000 << " ms"
+                << std::endl;
+    }
   }
 
   renderer.cleanup();
   nodeRenderer.cleanup();
   fdtdSolver.cleanup();
+  profiler.cleanup();
+  simulationScheduler.cleanup();
+  fieldReadback.flush();
+  fieldRecorder.stop();
+  fieldReadback.cleanup();
   volumeRenderer.cleanup();
   uiManager.cleanup();
   glfwTerminate();
 
+  if (!tracePath.empty())
+    Tracer::write(tracePath);
+
   std::cout << "Application closed successfully." << std::endl;
   return 0;
 }
\ No newline at end of file
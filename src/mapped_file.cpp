@@ -0,0 +1,77 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string &path) {
+  close();
+
+#ifndef _WIN32
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  length = static_cast<size_t>(info.st_size);
+  if (length > 0) {
+    void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      std::cerr << "Failed to map file: " << path << std::endl;
+      ::close(fd);
+      length = 0;
+      return false;
+    }
+    // Parsers walk the file front to back, one chunk per thread
+    madvise(address, length, MADV_WILLNEED);
+    view = static_cast<const char *>(address);
+    mapped = true;
+  }
+  // The mapping stays valid after the descriptor is closed
+  ::close(fd);
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+    return false;
+
+  length = static_cast<size_t>(file.tellg());
+  buffer.resize(length);
+  file.seekg(0);
+  if (length > 0 && !file.read(buffer.data(), length)) {
+    std::cerr << "Failed to read file: " << path << std::endl;
+    buffer.clear();
+    length = 0;
+    return false;
+  }
+  view = buffer.data();
+#endif
+
+  opened = true;
+  return true;
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+  if (mapped)
+    munmap(const_cast<char *>(view), length);
+#endif
+  buffer.clear();
+  buffer.shrink_to_fit();
+  view = nullptr;
+  length = 0;
+  opened = false;
+  mapped = false;
+}
@@ -0,0 +1,351 @@
+#include "mesh_cache.h"
+#include "mapped_file.h"
+#include "model_loader.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+const char MESH_CACHE_MAGIC[4] = {'H', 'M', 'S', 'H'};
+const uint32_t MESH_CACHE_VERSION = 3;
+
+// 64 bytes, no padding. Followed by vertexCount quantized positions (four
+// uint16 each, the last unused so the arrays stay 8-byte aligned),
+// vertexCount oct-encoded normals (two int16 each), indexCount uint32
+// indices and the LOD section
+struct MeshCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t fileSize;
+  int64_t modifiedTime;
+  uint64_t sampleHash;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+static_assert(sizeof(MeshCacheHeader) == 64, "Unexpected header padding");
+
+// LOD section: the extra vertices (encoded like the mesh's, within the same
+// bounds), their uint32 indices, then the clusters and levels as stored in
+// MeshLod
+struct MeshCacheLodHeader {
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t clusterCount;
+  uint32_t levelCount;
+};
+static_assert(sizeof(MeshCluster) == 32, "Unexpected MeshCluster layout");
+static_assert(sizeof(LodLevel) == 12, "Unexpected LodLevel layout");
+
+const size_t HASH_SAMPLES = 64;
+const size_t HASH_SAMPLE_BYTES = 4096;
+
+uint64_t fnv1a(const char *data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+int16_t toSnorm16(float value) {
+  return static_cast<int16_t>(
+      std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+float fromSnorm16(int16_t value) {
+  return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+}
+
+// Octahedral normal encoding: project onto the octahedron |x|+|y|+|z| = 1
+// and fold the lower half over the diagonals
+void encodeNormal(const glm::vec3 &normal, int16_t out[2]) {
+  glm::vec3 n =
+      normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+  glm::vec2 e(n.x, n.y);
+  if (n.z < 0.0f) {
+    e = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                  (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  out[0] = toSnorm16(e.x);
+  out[1] = toSnorm16(e.y);
+}
+
+glm::vec3 decodeNormal(const int16_t in[2]) {
+  glm::vec2 e(fromSnorm16(in[0]), fromSnorm16(in[1]));
+  glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+  if (n.z < 0.0f) {
+    float x = n.x;
+    n.x = (1.0f - std::abs(n.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    n.y = (1.0f - std::abs(x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+  }
+  return glm::normalize(n);
+}
+
+void encodeVertices(const std::vector<float> &vertices,
+                    const glm::vec3 &boundsMin, const glm::vec3 &extent,
+                    std::vector<uint16_t> &positions,
+                    std::vector<int16_t> &normals) {
+  const size_t vertexCount = vertices.size() / 6;
+  positions.assign(vertexCount * 4, 0);
+  normals.resize(vertexCount * 2);
+  for (size_t i = 0; i < vertexCount; i++) {
+    const float *v = &vertices[i * 6];
+    for (int axis = 0; axis < 3; axis++) {
+      float t = extent[axis] > 0.0f
+                    ? (v[axis] - boundsMin[axis]) / extent[axis]
+                    : 0.0f;
+      positions[i * 4 + axis] = static_cast<uint16_t>(
+          std::lround(std::clamp(t, 0.0f, 1.0f) * 65535.0f));
+    }
+    encodeNormal(glm::vec3(v[3], v[4], v[5]), &normals[i * 2]);
+  }
+}
+
+void decodeVertices(const uint16_t *positions, const int16_t *normals,
+                    size_t vertexCount, const glm::vec3 &boundsMin,
+                    const glm::vec3 &scale, std::vector<float> &vertices) {
+  vertices.resize(vertexCount * 6);
+  const long long vertexTotal = static_cast<long long>(vertexCount);
+  #pragma omp parallel for
+  for (long long i = 0; i < vertexTotal; i++) {
+    float *out = &vertices[i * 6];
+    for (int axis = 0; axis < 3; axis++)
+      out[axis] = boundsMin[axis] + positions[i * 4 + axis] * scale[axis];
+    glm::vec3 normal = decodeNormal(&normals[i * 2]);
+    out[3] = normal.x;
+    out[4] = normal.y;
+    out[5] = normal.z;
+  }
+}
+
+} // namespace
+
+bool MeshCacheKey::fromFile(const std::string &path, MeshCacheKey &key) {
+  std::error_code error;
+  auto modified = std::filesystem::last_write_time(path, error);
+  if (error)
+    return false;
+
+  // Plain reads rather than a mapping, whose read-ahead hint would page in
+  // the whole file: only the samples are read
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+    return false;
+
+  const size_t size = static_cast<size_t>(file.tellg());
+  key.fileSize = size;
+  key.modifiedTime = static_cast<int64_t>(modified.time_since_epoch().count());
+
+  uint64_t hash = fnv1a(reinterpret_cast<const char *>(&key.fileSize),
+                        sizeof(key.fileSize), 14695981039346656037ull);
+  std::vector<char> sample(std::min(size, HASH_SAMPLES * HASH_SAMPLE_BYTES));
+  if (size <= HASH_SAMPLES * HASH_SAMPLE_BYTES) {
+    file.seekg(0);
+    if (!file.read(sample.data(), size))
+      return false;
+    hash = fnv1a(sample.data(), size, hash);
+  } else {
+    size_t stride = (size - HASH_SAMPLE_BYTES) / (HASH_SAMPLES - 1);
+    for (size_t i = 0; i < HASH_SAMPLES; i++) {
+      file.seekg(static_cast<std::streamoff>(i * stride));
+      if (!file.read(sample.data(), HASH_SAMPLE_BYTES))
+        return false;
+      hash = fnv1a(sample.data(), HASH_SAMPLE_BYTES, hash);
+    }
+  }
+  key.sampleHash = hash;
+  return true;
+}
+
+bool MeshCache::save(const std::string &path, const ModelData &data,
+                     const MeshCacheKey &key) {
+  TRACE_SCOPE("MeshCache::save");
+  const size_t vertexCount = data.vertices.size() / 6;
+
+  MeshCacheHeader header = {};
+  std::memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+  header.version = MESH_CACHE_VERSION;
+  header.fileSize = key.fileSize;
+  header.modifiedTime = key.modifiedTime;
+  header.sampleHash = key.sampleHash;
+  header.vertexCount = static_cast<uint32_t>(vertexCount);
+  header.indexCount = static_cast<uint32_t>(data.indices.size());
+
+  glm::vec3 boundsMin(vertexCount > 0 ? FLT_MAX : 0.0f);
+  glm::vec3 boundsMax(vertexCount > 0 ? -FLT_MAX : 0.0f);
+  for (size_t i = 0; i < vertexCount; i++) {
+    glm::vec3 p(data.vertices[i * 6 + 0], data.vertices[i * 6 + 1],
+                data.vertices[i * 6 + 2]);
+    boundsMin = glm::min(boundsMin, p);
+    boundsMax = glm::max(boundsMax, p);
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    header.boundsMin[axis] = boundsMin[axis];
+    header.boundsMax[axis] = boundsMax[axis];
+  }
+
+  std::vector<uint16_t> positions, lodPositions;
+  std::vector<int16_t> normals, lodNormals;
+  glm::vec3 extent = boundsMax - boundsMin;
+  encodeVertices(data.vertices, boundsMin, extent, positions, normals);
+  // LOD vertices reuse the mesh's positions, so the same bounds hold
+  encodeVertices(data.lod.vertices, boundsMin, extent, lodPositions,
+                 lodNormals);
+
+  MeshCacheLodHeader lodHeader;
+  lodHeader.vertexCount = static_cast<uint32_t>(data.lod.vertices.size() / 6);
+  lodHeader.indexCount = static_cast<uint32_t>(data.lod.indices.size());
+  lodHeader.clusterCount = static_cast<uint32_t>(data.lod.clusters.size());
+  lodHeader.levelCount = static_cast<uint32_t>(data.lod.levels.size());
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(positions.data()),
+            positions.size() * sizeof(uint16_t));
+  out.write(reinterpret_cast<const char *>(normals.data()),
+            normals.size() * sizeof(int16_t));
+  out.write(reinterpret_cast<const char *>(data.indices.data()),
+            data.indices.size() * sizeof(unsigned int));
+  out.write(reinterpret_cast<const char *>(&lodHeader), sizeof(lodHeader));
+  out.write(reinterpret_cast<const char *>(lodPositions.data()),
+            lodPositions.size() * sizeof(uint16_t));
+  out.write(reinterpret_cast<const char *>(lodNormals.data()),
+            lodNormals.size() * sizeof(int16_t));
+  out.write(reinterpret_cast<const char *>(data.lod.indices.data()),
+            data.lod.indices.size() * sizeof(unsigned int));
+  out.write(reinterpret_cast<const char *>(data.lod.clusters.data()),
+            data.lod.clusters.size() * sizeof(MeshCluster));
+  out.write(reinterpret_cast<const char *>(data.lod.levels.data()),
+            data.lod.levels.size() * sizeof(LodLevel));
+  out.close();
+
+  std::cout << "Mesh cache saved to " << path << std::endl;
+  return true;
+}
+
+bool MeshCache::load(const std::string &path, const MeshCacheKey &key,
+                     ModelData &data) {
+  TRACE_SCOPE("MeshCache::load");
+  MappedFile file;
+  if (!file.open(path) || file.size() < sizeof(MeshCacheHeader))
+    return false;
+
+  MeshCacheHeader header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 ||
+      header.version != MESH_CACHE_VERSION) {
+    return false;
+  }
+  MeshCacheKey stored{header.fileSize, header.modifiedTime, header.sampleHash};
+  if (!(stored == key))
+    return false;
+
+  const size_t vertexCount = header.vertexCount;
+  const size_t indexCount = header.indexCount;
+  const size_t meshSize = sizeof(header) + vertexCount * 12 +
+                          indexCount * sizeof(uint32_t);
+  MeshCacheLodHeader lodHeader;
+  bool sized = file.size() >= meshSize + sizeof(lodHeader);
+  if (sized) {
+    std::memcpy(&lodHeader, file.data() + meshSize, sizeof(lodHeader));
+    size_t lodSize = sizeof(lodHeader) + size_t(lodHeader.vertexCount) * 12 +
+                     size_t(lodHeader.indexCount) * sizeof(uint32_t) +
+                     size_t(lodHeader.clusterCount) * sizeof(MeshCluster) +
+                     size_t(lodHeader.levelCount) * sizeof(LodLevel);
+    sized = file.size() == meshSize + lodSize;
+  }
+  if (!sized) {
+    std::cerr << "Mesh cache is truncated: " << path << std::endl;
+    return false;
+  }
+
+  // The header is 64 bytes and the mapping page-aligned, so every array is
+  // naturally aligned; the LOD section only needs 4-byte alignment
+  const char *body = file.data() + sizeof(header);
+  const uint16_t *positions = reinterpret_cast<const uint16_t *>(body);
+  const int16_t *normals =
+      reinterpret_cast<const int16_t *>(body + vertexCount * 8);
+  const uint32_t *indices =
+      reinterpret_cast<const uint32_t *>(body + vertexCount * 12);
+
+  const size_t lodVertexCount = lodHeader.vertexCount;
+  const char *lodBody = file.data() + meshSize + sizeof(lodHeader);
+  const uint16_t *lodPositions = reinterpret_cast<const uint16_t *>(lodBody);
+  const int16_t *lodNormals =
+      reinterpret_cast<const int16_t *>(lodBody + lodVertexCount * 8);
+  const uint32_t *lodIndices =
+      reinterpret_cast<const uint32_t *>(lodBody + lodVertexCount * 12);
+  const char *lodTables = reinterpret_cast<const char *>(
+      lodIndices + lodHeader.indexCount);
+
+  glm::vec3 boundsMin(header.boundsMin[0], header.boundsMin[1],
+                      header.boundsMin[2]);
+  glm::vec3 scale = (glm::vec3(header.boundsMax[0], header.boundsMax[1],
+                               header.boundsMax[2]) -
+                     boundsMin) /
+                    65535.0f;
+
+  decodeVertices(positions, normals, vertexCount, boundsMin, scale,
+                 data.vertices);
+  data.indices.assign(indices, indices + indexCount);
+  data.quantized = true;
+
+  MeshLod &lod = data.lod;
+  decodeVertices(lodPositions, lodNormals, lodVertexCount, boundsMin, scale,
+                 lod.vertices);
+  lod.indices.assign(lodIndices, lodIndices + lodHeader.indexCount);
+  lod.clusters.resize(lodHeader.clusterCount);
+  std::memcpy(lod.clusters.data(), lodTables,
+              lod.clusters.size() * sizeof(MeshCluster));
+  lod.levels.resize(lodHeader.levelCount);
+  std::memcpy(lod.levels.data(),
+              lodTables + lod.clusters.size() * sizeof(MeshCluster),
+              lod.levels.size() * sizeof(LodLevel));
+
+  // Indices, and the ranges that select them, must stay inside the buffers
+  // the renderer builds from both parts
+  const size_t totalVertices = vertexCount + lodVertexCount;
+  const size_t totalIndices = indexCount + lod.indices.size();
+  unsigned int maxIndex = 0;
+  for (unsigned int index : data.indices)
+    maxIndex = std::max(maxIndex, index);
+  unsigned int maxLodIndex = 0;
+  for (unsigned int index : lod.indices)
+    maxLodIndex = std::max(maxLodIndex, index);
+  bool valid = (indexCount == 0 || maxIndex < vertexCount) &&
+               (lod.indices.empty() || maxLodIndex < totalVertices);
+  for (const auto &cluster : lod.clusters) {
+    valid = valid && size_t(cluster.firstLevel) + cluster.levelCount <=
+                         lod.levels.size();
+  }
+  for (const auto &level : lod.levels) {
+    valid = valid &&
+            size_t(level.firstIndex) + level.indexCount <= totalIndices;
+  }
+  if (!valid) {
+    std::cerr << "Mesh cache has out-of-range indices: " << path << std::endl;
+    data = ModelData();
+    return false;
+  }
+
+  data.loaded = true;
+  std::cout << "Mesh loaded from cache " << path << " (" << vertexCount
+            << " vertices, " << indexCount / 3 << " triangles, "
+            << lod.clusters.size() << " LOD clusters)" << std::endl;
+  return true;
+}
@@ -0,0 +1,496 @@
+#include "mesh_lod.h"
+#include "model_loader.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+const size_t CLUSTER_TRIANGLES = 4096;
+const int MAX_LEVELS = 6;
+const size_t MIN_LEVEL_TRIANGLES = 16;
+// Open edges (building footprints, cut-off terrain) resist collapsing more
+// than flat interiors
+const double BOUNDARY_WEIGHT = 4.0;
+
+// Symmetric 4x4 plane quadric, upper triangle
+struct Quadric {
+  double a[10] = {};
+
+  void addPlane(const glm::dvec3 &n, double d, double weight) {
+    a[0] += weight * n.x * n.x;
+    a[1] += weight * n.x * n.y;
+    a[2] += weight * n.x * n.z;
+    a[3] += weight * n.x * d;
+    a[4] += weight * n.y * n.y;
+    a[5] += weight * n.y * n.z;
+    a[6] += weight * n.y * d;
+    a[7] += weight * n.z * n.z;
+    a[8] += weight * n.z * d;
+    a[9] += weight * d * d;
+  }
+
+  void add(const Quadric &other) {
+    for (int i = 0; i < 10; i++)
+      a[i] += other.a[i];
+  }
+
+  // Sum of squared distances from p to the accumulated planes
+  double evaluate(const glm::dvec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z +
+           2.0 * a[3] * x + a[4] * y * y + 2.0 * a[5] * y * z +
+           2.0 * a[6] * y + a[7] * z * z + 2.0 * a[8] * z + a[9];
+  }
+};
+
+struct Collapse {
+  double cost;
+  unsigned int from, to;
+  unsigned int fromVersion, toVersion;
+
+  bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+// Levels of one cluster in welded position ids; levels[0] is the input
+struct ClusterLevels {
+  std::vector<std::vector<glm::uvec3>> levels;
+  std::vector<float> errors;
+};
+
+void simplifyCluster(const std::vector<glm::vec3> &positions,
+                     const std::vector<uint8_t> &locked,
+                     const std::vector<glm::uvec3> &input,
+                     ClusterLevels &out) {
+  out.levels.assign(1, input);
+  out.errors.assign(1, 0.0f);
+  if (input.size() < 2 * MIN_LEVEL_TRIANGLES)
+    return;
+
+  // Cluster-local vertex numbering
+  std::unordered_map<unsigned int, unsigned int> localIds;
+  std::vector<unsigned int> globalIds;
+  std::vector<glm::uvec3> tris(input.size());
+  for (size_t t = 0; t < input.size(); t++) {
+    for (int k = 0; k < 3; k++) {
+      auto inserted = localIds.emplace(input[t][k],
+                                       static_cast<unsigned int>(
+                                           globalIds.size()));
+      if (inserted.second)
+        globalIds.push_back(input[t][k]);
+      tris[t][k] = inserted.first->second;
+    }
+  }
+
+  const size_t n = globalIds.size();
+  std::vector<glm::dvec3> p(n);
+  std::vector<Quadric> quadrics(n);
+  std::vector<std::vector<unsigned int>> adjacency(n);
+  glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+  for (size_t v = 0; v < n; v++) {
+    p[v] = glm::dvec3(positions[globalIds[v]]);
+    boundsMin = glm::min(boundsMin, positions[globalIds[v]]);
+    boundsMax = glm::max(boundsMax, positions[globalIds[v]]);
+  }
+  // A level whose error exceeds the cluster itself (typically one that
+  // dropped terrain) would never be selected
+  const double maxError = glm::length(boundsMax - boundsMin);
+
+  std::vector<bool> alive(tris.size(), true);
+  std::unordered_map<uint64_t, int> edgeUse;
+  for (size_t t = 0; t < tris.size(); t++) {
+    const glm::uvec3 &tri = tris[t];
+    glm::dvec3 normal =
+        glm::cross(p[tri[1]] - p[tri[0]], p[tri[2]] - p[tri[0]]);
+    double length = glm::length(normal);
+    if (length > 0.0) {
+      normal /= length;
+      double d = -glm::dot(normal, p[tri[0]]);
+      for (int k = 0; k < 3; k++)
+        quadrics[tri[k]].addPlane(normal, d, 1.0);
+    }
+    for (int k = 0; k < 3; k++) {
+      adjacency[tri[k]].push_back(static_cast<unsigned int>(t));
+      unsigned int a = tri[k], b = tri[(k + 1) % 3];
+      edgeUse[(uint64_t(std::min(a, b)) << 32) | std::max(a, b)]++;
+    }
+  }
+
+  // A plane through each open edge, perpendicular to its face
+  for (const auto &tri : tris) {
+    glm::dvec3 faceNormal =
+        glm::cross(p[tri[1]] - p[tri[0]], p[tri[2]] - p[tri[0]]);
+    for (int k = 0; k < 3; k++) {
+      unsigned int a = tri[k], b = tri[(k + 1) % 3];
+      if (edgeUse[(uint64_t(std::min(a, b)) << 32) | std::max(a, b)] != 1)
+        continue;
+      glm::dvec3 normal = glm::cross(p[b] - p[a], faceNormal);
+      double length = glm::length(normal);
+      if (length == 0.0)
+        continue;
+      normal /= length;
+      double d = -glm::dot(normal, p[a]);
+      quadrics[a].addPlane(normal, d, BOUNDARY_WEIGHT);
+      quadrics[b].addPlane(normal, d, BOUNDARY_WEIGHT);
+    }
+  }
+
+  std::vector<unsigned int> version(n, 0);
+  std::vector<bool> removed(n, false);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>>
+      heap;
+
+  // Half-edge collapse: `from` moves onto `to`, so no new positions appear
+  auto push = [&](unsigned int from, unsigned int to) {
+    if (locked[globalIds[from]])
+      return;
+    Quadric sum = quadrics[from];
+    sum.add(quadrics[to]);
+    heap.push({std::max(sum.evaluate(p[to]), 0.0), from, to, version[from],
+               version[to]});
+  };
+  for (const auto &tri : tris) {
+    for (int k = 0; k < 3; k++) {
+      push(tri[k], tri[(k + 1) % 3]);
+      push(tri[(k + 1) % 3], tri[k]);
+    }
+  }
+
+  // Reject collapses that flip a surviving triangle
+  auto canCollapse = [&](unsigned int from, unsigned int to) {
+    for (unsigned int t : adjacency[from]) {
+      const glm::uvec3 &tri = tris[t];
+      if (!alive[t] || tri[0] == to || tri[1] == to || tri[2] == to)
+        continue;
+      glm::dvec3 corners[3] = {p[tri[0]], p[tri[1]], p[tri[2]]};
+      glm::dvec3 before = glm::cross(corners[1] - corners[0],
+                                     corners[2] - corners[0]);
+      for (int k = 0; k < 3; k++) {
+        if (tri[k] == from)
+          corners[k] = p[to];
+      }
+      glm::dvec3 after = glm::cross(corners[1] - corners[0],
+                                    corners[2] - corners[0]);
+      if (glm::dot(before, after) <= 0.0)
+        return false;
+    }
+    return true;
+  };
+
+  size_t liveCount = tris.size();
+  double maxCost = 0.0;
+  for (int level = 1; level < MAX_LEVELS; level++) {
+    size_t target = liveCount / 2;
+    if (target < MIN_LEVEL_TRIANGLES)
+      break;
+    size_t before = liveCount;
+
+    while (liveCount > target && !heap.empty()) {
+      Collapse collapse = heap.top();
+      heap.pop();
+      unsigned int from = collapse.from, to = collapse.to;
+      if (removed[from] || removed[to] ||
+          collapse.fromVersion != version[from] ||
+          collapse.toVersion != version[to] || !canCollapse(from, to))
+        continue;
+
+      for (unsigned int t : adjacency[from]) {
+        if (!alive[t])
+          continue;
+        glm::uvec3 &tri = tris[t];
+        if (tri[0] == to || tri[1] == to || tri[2] == to) {
+          alive[t] = false;
+          liveCount--;
+          continue;
+        }
+        for (int k = 0; k < 3; k++) {
+          if (tri[k] == from)
+            tri[k] = to;
+        }
+        adjacency[to].push_back(t);
+      }
+      removed[from] = true;
+      adjacency[from].clear();
+      quadrics[to].add(quadrics[from]);
+      version[to]++;
+      maxCost = std::max(maxCost, collapse.cost);
+
+      auto &around = adjacency[to];
+      around.erase(std::remove_if(around.begin(), around.end(),
+                                  [&](unsigned int t) { return !alive[t]; }),
+                   around.end());
+      for (unsigned int t : around) {
+        for (int k = 0; k < 3; k++) {
+          unsigned int other = tris[t][k];
+          if (other != to) {
+            push(to, other);
+            push(other, to);
+          }
+        }
+      }
+    }
+
+    // Locked borders and flip checks can stall a cluster; a level that
+    // barely shrank is not worth its memory
+    if (liveCount > before - before / 8 || std::sqrt(maxCost) > maxError)
+      break;
+
+    std::vector<glm::uvec3> result;
+    result.reserve(liveCount);
+    for (size_t t = 0; t < tris.size(); t++) {
+      if (alive[t]) {
+        result.emplace_back(globalIds[tris[t][0]], globalIds[tris[t][1]],
+                            globalIds[tris[t][2]]);
+      }
+    }
+    out.levels.push_back(std::move(result));
+    out.errors.push_back(static_cast<float>(std::sqrt(maxCost)));
+  }
+}
+
+// Vertices and indices of one cluster's simplified levels. Indices are local
+// to `vertices` until the clusters are concatenated
+struct ClusterOutput {
+  std::vector<float> vertices;
+  std::vector<unsigned int> indices;
+  std::vector<LodLevel> levels; // firstIndex local to `indices`
+};
+
+void emitLevels(const std::vector<glm::vec3> &positions,
+                const ClusterLevels &levels, ClusterOutput &out) {
+  // Flat shading, like the loader: each corner takes its face's normal, and
+  // corners sharing a position and normal share a vertex
+  std::unordered_map<unsigned int, std::vector<std::pair<uint64_t, unsigned>>>
+      vertexIds;
+  for (size_t l = 1; l < levels.levels.size(); l++) {
+    LodLevel level;
+    level.firstIndex = static_cast<unsigned int>(out.indices.size());
+    level.error = levels.errors[l];
+
+    for (const auto &tri : levels.levels[l]) {
+      glm::vec3 a = positions[tri[0]], b = positions[tri[1]],
+                c = positions[tri[2]];
+      glm::vec3 normal = glm::cross(b - a, c - a);
+      float length = glm::length(normal);
+      if (length == 0.0f)
+        continue;
+      normal /= length;
+
+      uint64_t normalKey = 0;
+      for (int axis = 0; axis < 3; axis++) {
+        uint16_t q = static_cast<uint16_t>(
+            static_cast<int16_t>(std::lround(normal[axis] * 32767.0f)));
+        normalKey |= uint64_t(q) << (16 * axis);
+      }
+
+      for (int k = 0; k < 3; k++) {
+        auto &candidates = vertexIds[tri[k]];
+        auto match = std::find_if(
+            candidates.begin(), candidates.end(),
+            [&](const auto &entry) { return entry.first == normalKey; });
+        if (match == candidates.end()) {
+          unsigned int id = static_cast<unsigned int>(out.vertices.size() / 6);
+          const glm::vec3 &v = positions[tri[k]];
+          out.vertices.insert(out.vertices.end(), {v.x, v.y, v.z, normal.x,
+                                                   normal.y, normal.z});
+          candidates.emplace_back(normalKey, id);
+          out.indices.push_back(id);
+        } else {
+          out.indices.push_back(match->second);
+        }
+      }
+    }
+
+    level.indexCount =
+        static_cast<unsigned int>(out.indices.size()) - level.firstIndex;
+    out.levels.push_back(level);
+  }
+}
+
+} // namespace
+
+void MeshLodBuilder::build(ModelData &data) {
+  TRACE_SCOPE("MeshLodBuilder::build");
+  data.lod = MeshLod();
+
+  const size_t vertexCount = data.vertices.size() / 6;
+  const size_t triangleCount = data.indices.size() / 3;
+  if (triangleCount == 0)
+    return;
+
+  // Weld vertices that differ only by normal, so the simplifier sees the
+  // surface's connectivity rather than the flat-shading seams
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> positionOf(vertexCount);
+  {
+    std::unordered_map<uint64_t, std::vector<unsigned int>> buckets;
+    buckets.reserve(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+      glm::vec3 position(data.vertices[v * 6 + 0], data.vertices[v * 6 + 1],
+                         data.vertices[v * 6 + 2]);
+      uint32_t bits[3];
+      std::memcpy(bits, &position, sizeof(bits));
+      uint64_t hash = (uint64_t(bits[0]) * 73856093u) ^
+                      (uint64_t(bits[1]) * 19349663u) ^
+                      (uint64_t(bits[2]) * 83492791u);
+      auto &bucket = buckets[hash];
+      unsigned int id = static_cast<unsigned int>(positions.size());
+      for (unsigned int candidate : bucket) {
+        if (positions[candidate] == position) {
+          id = candidate;
+          break;
+        }
+      }
+      if (id == positions.size()) {
+        positions.push_back(position);
+        bucket.push_back(id);
+      }
+      positionOf[v] = id;
+    }
+  }
+
+  // Square XZ cells sized for about CLUSTER_TRIANGLES triangles each on an
+  // even spread
+  glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+  for (const auto &position : positions) {
+    boundsMin = glm::min(boundsMin, position);
+    boundsMax = glm::max(boundsMax, position);
+  }
+  glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(1e-3f));
+  float cells = std::max(1.0f, static_cast<float>(triangleCount) /
+                                   static_cast<float>(CLUSTER_TRIANGLES));
+  float cellSize = std::sqrt(extent.x * extent.z / cells);
+  int nx = std::max(1, static_cast<int>(std::ceil(extent.x / cellSize)));
+  int nz = std::max(1, static_cast<int>(std::ceil(extent.z / cellSize)));
+
+  std::vector<int> clusterOf(triangleCount);
+  std::vector<unsigned int> clusterCounts(size_t(nx) * nz + 1, 0);
+  for (size_t t = 0; t < triangleCount; t++) {
+    glm::vec3 centroid(0.0f);
+    for (int k = 0; k < 3; k++)
+      centroid += positions[positionOf[data.indices[t * 3 + k]]];
+    centroid /= 3.0f;
+    int cx = std::clamp(
+        static_cast<int>((centroid.x - boundsMin.x) / cellSize), 0, nx - 1);
+    int cz = std::clamp(
+        static_cast<int>((centroid.z - boundsMin.z) / cellSize), 0, nz - 1);
+    clusterOf[t] = cz * nx + cx;
+    clusterCounts[clusterOf[t] + 1]++;
+  }
+  for (size_t c = 1; c < clusterCounts.size(); c++)
+    clusterCounts[c] += clusterCounts[c - 1];
+
+  // Positions used by more than one cluster are locked
+  std::vector<int> owner(positions.size(), -1);
+  std::vector<uint8_t> locked(positions.size(), 0);
+  for (size_t t = 0; t < triangleCount; t++) {
+    for (int k = 0; k < 3; k++) {
+      unsigned int id = positionOf[data.indices[t * 3 + k]];
+      if (owner[id] < 0)
+        owner[id] = clusterOf[t];
+      else if (owner[id] != clusterOf[t])
+        locked[id] = 1;
+    }
+  }
+
+  // Counting sort the triangles by cluster so each is one index range
+  std::vector<unsigned int> sorted(data.indices.size());
+  {
+    std::vector<unsigned int> cursor(clusterCounts.begin(),
+                                     clusterCounts.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+      unsigned int slot = cursor[clusterOf[t]]++;
+      for (int k = 0; k < 3; k++)
+        sorted[slot * 3 + k] = data.indices[t * 3 + k];
+    }
+  }
+  data.indices.swap(sorted);
+
+  std::vector<int> nonEmpty;
+  for (int c = 0; c < nx * nz; c++) {
+    if (clusterCounts[c + 1] > clusterCounts[c])
+      nonEmpty.push_back(c);
+  }
+
+  std::vector<ClusterOutput> outputs(nonEmpty.size());
+  std::vector<MeshCluster> clusters(nonEmpty.size());
+  const long long clusterTotal = static_cast<long long>(nonEmpty.size());
+  #pragma omp parallel
+  {
+    TRACE_SCOPE("Simplify clusters");
+    #pragma omp for schedule(dynamic)
+    for (long long i = 0; i < clusterTotal; i++) {
+      int c = nonEmpty[i];
+      unsigned int first = clusterCounts[c], last = clusterCounts[c + 1];
+
+      std::vector<glm::uvec3> input;
+      input.reserve(last - first);
+      MeshCluster &cluster = clusters[i];
+      cluster.boundsMin = glm::vec3(FLT_MAX);
+      cluster.boundsMax = glm::vec3(-FLT_MAX);
+      for (unsigned int t = first; t < last; t++) {
+        glm::uvec3 tri;
+        for (int k = 0; k < 3; k++) {
+          tri[k] = positionOf[data.indices[t * 3 + k]];
+          cluster.boundsMin = glm::min(cluster.boundsMin, positions[tri[k]]);
+          cluster.boundsMax = glm::max(cluster.boundsMax, positions[tri[k]]);
+        }
+        input.push_back(tri);
+      }
+
+      ClusterLevels levels;
+      simplifyCluster(positions, locked, input, levels);
+      emitLevels(positions, levels, outputs[i]);
+    }
+  }
+
+  // Concatenate, moving local vertex and index numbers into the combined
+  // buffers' ranges
+  MeshLod &lod = data.lod;
+  size_t vertexBase = vertexCount;
+  size_t indexBase = data.indices.size();
+  for (size_t i = 0; i < outputs.size(); i++) {
+    const int c = nonEmpty[i];
+    ClusterOutput &output = outputs[i];
+    MeshCluster &cluster = clusters[i];
+    cluster.firstLevel = static_cast<unsigned int>(lod.levels.size());
+    cluster.levelCount = static_cast<unsigned int>(output.levels.size()) + 1;
+
+    LodLevel full;
+    full.firstIndex = clusterCounts[c] * 3;
+    full.indexCount = (clusterCounts[c + 1] - clusterCounts[c]) * 3;
+    full.error = 0.0f;
+    lod.levels.push_back(full);
+
+    const size_t lodIndexStart = indexBase + lod.indices.size();
+    for (LodLevel level : output.levels) {
+      level.firstIndex += static_cast<unsigned int>(lodIndexStart);
+      lod.levels.push_back(level);
+    }
+
+    const unsigned int vertexOffset =
+        static_cast<unsigned int>(vertexBase + lod.vertices.size() / 6);
+    for (unsigned int index : output.indices)
+      lod.indices.push_back(index + vertexOffset);
+    lod.vertices.insert(lod.vertices.end(), output.vertices.begin(),
+                        output.vertices.end());
+    lod.clusters.push_back(cluster);
+    output = ClusterOutput();
+  }
+
+  size_t coarsest = 0;
+  for (const auto &cluster : lod.clusters)
+    coarsest += lod.levels[cluster.firstLevel + cluster.levelCount - 1]
+                    .indexCount /
+                3;
+  std::cout << "Built LOD for " << lod.clusters.size() << " clusters ("
+            << triangleCount << " triangles at full detail, " << coarsest
+            << " at the coarsest level)" << std::endl;
+}
@@ -1,149 +1,492 @@
 #include "model_loader.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "trace.h"
 
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <glm/glm.hpp>
 #include <iostream>
-#include <sstream>
-#include <unordered_map>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// Slice of the file that starts at a line start and ends after a newline
+// (or at the end of the file)
+struct ObjChunk {
+  const char *begin;
+  const char *end;
+  size_t vertexCount = 0;
+  size_t normalCount = 0;
+  size_t faceCount = 0;
+  // Offsets of this chunk's first entries in the shared arrays
+  size_t vertexOffset = 0;
+  size_t normalOffset = 0;
+  size_t faceOffset = 0;
+};
+
+enum class LineType { OTHER, VERTEX, NORMAL, FACE };
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+inline const char *skipBlanks(const char *p, const char *end) {
+  while (p < end && isBlank(*p))
+    p++;
+  return p;
+}
+
+inline const char *lineEnd(const char *p, const char *end) {
+  const void *newline = std::memchr(p, '\n', end - p);
+  return newline ? static_cast<const char *>(newline) : end;
+}
+
+// Sets `p` past the keyword when the line is one we parse
+inline LineType classifyLine(const char *&p, const char *end) {
+  p = skipBlanks(p, end);
+  if (end - p < 2)
+    return LineType::OTHER;
+  if (p[0] == 'v') {
+    if (isBlank(p[1])) {
+      p += 2;
+      return LineType::VERTEX;
+    }
+    if (p[1] == 'n' && end - p > 2 && isBlank(p[2])) {
+      p += 3;
+      return LineType::NORMAL;
+    }
+  } else if (p[0] == 'f' && isBlank(p[1])) {
+    p += 2;
+    return LineType::FACE;
+  }
+  return LineType::OTHER;
+}
+
+// Decimal float parser for OBJ coordinates: [sign] digits [. digits]
+// [e [sign] digits]. Digits beyond what a uint64 holds only shift the
+// exponent, which is far below float precision. Returns false (and leaves
+// `value` untouched) when no number starts at `p`
+bool parseFloat(const char *&p, const char *end, float &value) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char *s = skipBlanks(p, end);
+  bool negative = false;
+  if (s < end && (*s == '-' || *s == '+')) {
+    negative = *s == '-';
+    s++;
+  }
+
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+  for (; s < end && *s >= '0' && *s <= '9'; s++) {
+    anyDigits = true;
+    if (mantissa < 1000000000000000000ull)
+      mantissa = mantissa * 10 + (*s - '0');
+    else
+      exponent++;
+  }
+  if (s < end && *s == '.') {
+    s++;
+    for (; s < end && *s >= '0' && *s <= '9'; s++) {
+      anyDigits = true;
+      if (mantissa < 1000000000000000000ull) {
+        mantissa = mantissa * 10 + (*s - '0');
+        exponent--;
+      }
+    }
+  }
+  if (!anyDigits)
+    return false;
+
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    const char *e = s + 1;
+    bool negativeExponent = false;
+    if (e < end && (*e == '-' || *e == '+')) {
+      negativeExponent = *e == '-';
+      e++;
+    }
+    if (e < end && *e >= '0' && *e <= '9') {
+      int digits = 0;
+      for (; e < end && *e >= '0' && *e <= '9'; e++)
+        digits = std::min(digits * 10 + (*e - '0'), 10000);
+      exponent += negativeExponent ? -digits : digits;
+      s = e;
+    }
+  }
+
+  double result = static_cast<double>(mantissa);
+  if (exponent < 0) {
+    for (; exponent < -22; exponent += 22)
+      result /= powers[22];
+    result /= powers[-exponent];
+  } else {
+    for (; exponent > 22; exponent -= 22)
+      result *= powers[22];
+    result *= powers[exponent];
+  }
+
+  value = static_cast<float>(negative ? -result : result);
+  p = s;
+  return true;
+}
+
+void parseVec3(const char *p, const char *end, glm::vec3 &out) {
+  out = glm::vec3(0.0f);
+  if (parseFloat(p, end, out.x) && parseFloat(p, end, out.y))
+    parseFloat(p, end, out.z);
+}
+
+// OBJ indices are 1-based, or negative to count back from the last element
+// defined so far. Returns -1 when absent or zero
+inline int resolveIndex(long long index, size_t definedSoFar) {
+  if (index > 0)
+    return static_cast<int>(index - 1);
+  if (index < 0)
+    return static_cast<int>(static_cast<long long>(definedSoFar) + index);
+  return -1;
+}
+
+// Reads one "v", "v/t", "v/t/n" or "v//n" corner
+bool parseCorner(const char *&p, const char *end, size_t verticesSoFar,
+                 size_t normalsSoFar, int &vertex, int &normal) {
+  p = skipBlanks(p, end);
+  long long v = 0;
+  auto [next, error] = std::from_chars(p, end, v);
+  if (error != std::errc())
+    return false;
+  p = next;
+  vertex = resolveIndex(v, verticesSoFar);
+  normal = -1;
+
+  if (p < end && *p == '/') {
+    p++;
+    long long unused = 0;
+    p = std::from_chars(p, end, unused).ptr; // Texture coordinate
+    if (p < end && *p == '/') {
+      p++;
+      long long n = 0;
+      auto [afterNormal, normalError] = std::from_chars(p, end, n);
+      if (normalError == std::errc()) {
+        normal = resolveIndex(n, normalsSoFar);
+        p = afterNormal;
+      }
+    }
+  }
+  // Skip anything else in the corner token
+  while (p < end && !isBlank(*p) && *p != '\r')
+    p++;
+  return true;
+}
+
+std::vector<ObjChunk> splitChunks(const char *data, size_t size,
+                                  size_t chunkCount) {
+  std::vector<ObjChunk> chunks;
+  const char *end = data + size;
+  const char *begin = data;
+  for (size_t i = 1; i <= chunkCount && begin < end; i++) {
+    const char *target = data + size / chunkCount * i;
+    const char *chunkEnd = end;
+    if (i < chunkCount && target > begin && target < end) {
+      chunkEnd = lineEnd(target, end);
+      if (chunkEnd < end)
+        chunkEnd++;
+    }
+    if (chunkEnd > begin)
+      chunks.push_back({begin, chunkEnd});
+    begin = chunkEnd;
+  }
+  return chunks;
+}
+
+// Dedup key for a unit normal: each component quantized to 16 bits, so
+// normals that differ only by rounding (e.g. two triangles of one wall)
+// share a vertex
+inline uint64_t normalKey(const glm::vec3 &normal) {
+  auto quantize = [](float value) {
+    return static_cast<uint64_t>(
+        static_cast<uint16_t>(static_cast<int>(std::lround(value * 32767.0f))));
+  };
+  return quantize(normal.x) | quantize(normal.y) << 16 |
+         quantize(normal.z) << 32;
+}
+
+} // namespace
 
 ModelData ModelLoader::loadOBJ(const std::string &filepath) {
+  TRACE_SCOPE("ModelLoader::loadOBJ");
   ModelData data;
-  std::ifstream file(filepath);
+  MappedFile file;
 
-  if (!file.is_open()) {
+  if (!file.open(filepath)) {
     std::cerr << "Failed to open OBJ file: " << filepath << std::endl;
     return {};
   }
 
   std::cout << "Loading OBJ model: " << filepath << std::endl;
 
-  std::vector<std::string> lines;
-  std::string line;
-  while (std::getline(file, line)) {
-    lines.push_back(std::move(line));
+  // Several chunks per thread so uneven sections (e.g. all faces at the end)
+  // still balance under dynamic scheduling
+  int threadCount = 1;
+#ifdef _OPENMP
+  threadCount = omp_get_max_threads();
+#endif
+  size_t chunkCount = std::max<size_t>(
+      1, std::min<size_t>(threadCount * 8, file.size() / (64 * 1024)));
+  std::vector<ObjChunk> chunks =
+      splitChunks(file.data(), file.size(), chunkCount);
+  const int chunkTotal = static_cast<int>(chunks.size());
+
+  // Pass 1: count each chunk's entries so pass 2 can write straight into
+  // preallocated arrays
+  #pragma omp parallel
+  {
+    TRACE_SCOPE("Count lines");
+    #pragma omp for schedule(dynamic)
+    for (int c = 0; c < chunkTotal; c++) {
+      ObjChunk &chunk = chunks[c];
+      for (const char *line = chunk.begin; line < chunk.end;) {
+        const char *end = lineEnd(line, chunk.end);
+        const char *p = line;
+        switch (classifyLine(p, end)) {
+        case LineType::VERTEX:
+          chunk.vertexCount++;
+          break;
+        case LineType::NORMAL:
+          chunk.normalCount++;
+          break;
+        case LineType::FACE:
+          chunk.faceCount++;
+          break;
+        default:
+          break;
+        }
+        line = end < chunk.end ? end + 1 : chunk.end;
+      }
+    }
+  }
+
+  size_t vertexTotal = 0, normalTotal = 0, faceTotal = 0;
+  for (ObjChunk &chunk : chunks) {
+    chunk.vertexOffset = vertexTotal;
+    chunk.normalOffset = normalTotal;
+    chunk.faceOffset = faceTotal;
+    vertexTotal += chunk.vertexCount;
+    normalTotal += chunk.normalCount;
+    faceTotal += chunk.faceCount;
+  }
+
+  std::vector<glm::vec3> positions(vertexTotal);
+  std::vector<glm::vec3> normals(normalTotal);
+  std::vector<int> faceVertices(faceTotal * 3);
+  std::vector<int> faceNormals(faceTotal * 3);
+
+  // Pass 2: parse in place. Polygons keep their first three corners
+  #pragma omp parallel
+  {
+    TRACE_SCOPE("Parse chunks");
+    #pragma omp for schedule(dynamic)
+    for (int c = 0; c < chunkTotal; c++) {
+      const ObjChunk &chunk = chunks[c];
+      size_t v = chunk.vertexOffset;
+      size_t n = chunk.normalOffset;
+      size_t f = chunk.faceOffset;
+      for (const char *line = chunk.begin; line < chunk.end;) {
+        const char *end = lineEnd(line, chunk.end);
+        const char *p = line;
+        switch (classifyLine(p, end)) {
+        case LineType::VERTEX:
+          parseVec3(p, end, positions[v++]);
+          break;
+        case LineType::NORMAL:
+          parseVec3(p, end, normals[n++]);
+          break;
+        case LineType::FACE: {
+          int *corners = &faceVertices[f * 3];
+          int *cornerNormals = &faceNormals[f * 3];
+          for (int k = 0; k < 3; k++) {
+            corners[k] = -1;
+            cornerNormals[k] = -1;
+          }
+          for (int k = 0; k < 3; k++) {
+            if (!parseCorner(p, end, v, n, corners[k], cornerNormals[k]))
+              break;
+          }
+          f++;
+          break;
+        }
+        default:
+          break;
+        }
+        line = end < chunk.end ? end + 1 : chunk.end;
+      }
+    }
   }
   file.close();
 
-  std::vector<int> line_types(lines.size());
-  std::vector<size_t> v_indices, vn_indices, f_indices;
-
-  for (size_t i = 0; i < lines.size(); i++) {
-    const std::string &line = lines[i];
-    if (line.empty()) continue;
-    if (line[0] == 'v' && line.size() > 1) {
-      if (line[1] == 'n') {
-        line_types[i] = 2;
-        vn_indices.push_back(i);
-      } else if (line[1] == ' ') {
-        line_types[i] = 1;
-        v_indices.push_back(i);
-      }
-    } else if (line[0] == 'f' && line.size() > 1 && line[1] == ' ') {
-      line_types[i] = 3;
-      f_indices.push_back(i);
-    }
-  }
-
-  std::vector<glm::vec3> temp_vertices(v_indices.size());
-  std::vector<glm::vec3> temp_normals(vn_indices.size());
-  std::vector<unsigned int> vertex_indices(f_indices.size() * 3);
-  std::vector<unsigned int> normal_indices(f_indices.size() * 3);
-
-  #pragma omp parallel for
-  for (size_t i = 0; i < v_indices.size(); i++) {
-    std::istringstream iss(lines[v_indices[i]]);
-    std::string prefix;
-    float x, y, z;
-    iss >> prefix >> x >> y >> z;
-    temp_vertices[i] = glm::vec3(x, y, z);
-  }
-
-  #pragma omp parallel for
-  for (size_t i = 0; i < vn_indices.size(); i++) {
-    std::istringstream iss(lines[vn_indices[i]]);
-    std::string prefix;
-    float nx, ny, nz;
-    iss >> prefix >> nx >> ny >> nz;
-    temp_normals[i] = glm::vec3(nx, ny, nz);
-  }
-
-  auto parse_face_vertex = [](const std::string &vertex_str) -> std::pair<int, int> {
-    size_t first_slash = vertex_str.find('/');
-    int v_idx = std::stoi(vertex_str.substr(0, first_slash)) - 1;
-
-    int n_idx = -1;
-    if (first_slash != std::string::npos) {
-      size_t second_slash = vertex_str.find('/', first_slash + 1);
-      if (second_slash != std::string::npos &&
-          second_slash + 1 < vertex_str.length()) {
-        n_idx = std::stoi(vertex_str.substr(second_slash + 1)) - 1;
-      }
-    }
-    return {v_idx, n_idx};
-  };
-
-  #pragma omp parallel for
-  for (size_t i = 0; i < f_indices.size(); i++) {
-    std::istringstream iss(lines[f_indices[i]]);
-    std::string prefix, vertex1, vertex2, vertex3;
-    iss >> prefix >> vertex1 >> vertex2 >> vertex3;
-
-    auto [v1, n1] = parse_face_vertex(vertex1);
-    auto [v2, n2] = parse_face_vertex(vertex2);
-    auto [v3, n3] = parse_face_vertex(vertex3);
-
-    vertex_indices[i * 3 + 0] = v1;
-    vertex_indices[i * 3 + 1] = v2;
-    vertex_indices[i * 3 + 2] = v3;
-
-    normal_indices[i * 3 + 0] = n1;
-    normal_indices[i * 3 + 1] = n2;
-    normal_indices[i * 3 + 2] = n3;
-  }
-
-  std::cout << "Loaded " << temp_vertices.size() << " vertices, "
-            << vertex_indices.size() / 3 << " triangles" << std::endl;
-
-  bool has_normals = !temp_normals.empty() && normal_indices[0] >= 0;
+  // Drop faces with missing or out-of-range corners
+  size_t triangleCount = 0;
+  size_t invalidFaces = 0;
+  for (size_t i = 0; i < faceTotal; i++) {
+    bool valid = true;
+    for (int k = 0; k < 3; k++) {
+      int corner = faceVertices[i * 3 + k];
+      int normal = faceNormals[i * 3 + k];
+      if (corner < 0 || corner >= static_cast<int>(vertexTotal))
+        valid = false;
+      if (normal >= static_cast<int>(normalTotal))
+        faceNormals[i * 3 + k] = -1;
+    }
+    if (!valid) {
+      invalidFaces++;
+      continue;
+    }
+    if (triangleCount != i) {
+      std::copy_n(&faceVertices[i * 3], 3, &faceVertices[triangleCount * 3]);
+      std::copy_n(&faceNormals[i * 3], 3, &faceNormals[triangleCount * 3]);
+    }
+    triangleCount++;
+  }
+  if (invalidFaces > 0) {
+    std::cerr << "Skipped " << invalidFaces
+              << " faces with missing or out-of-range vertices" << std::endl;
+  }
+
+  std::cout << "Loaded " << vertexTotal << " vertices, " << triangleCount
+            << " triangles" << std::endl;
+
+  bool has_normals =
+      std::any_of(faceNormals.begin(), faceNormals.begin() + triangleCount * 3,
+                  [](int normal) { return normal >= 0; });
 
   if (!has_normals) {
     std::cout << "No normals found, generating flat normals..." << std::endl;
   }
 
-  for (size_t i = 0; i < vertex_indices.size(); i += 3) {
-    glm::vec3 v0 = temp_vertices[vertex_indices[i]];
-    glm::vec3 v1 = temp_vertices[vertex_indices[i + 1]];
-    glm::vec3 v2 = temp_vertices[vertex_indices[i + 2]];
-
-    glm::vec3 normal;
-    if (has_normals) {
-      glm::vec3 n0 = (normal_indices[i] >= 0) ? temp_normals[normal_indices[i]]
-                                              : glm::vec3(0, 1, 0);
-      glm::vec3 n1 = (normal_indices[i + 1] >= 0)
-                         ? temp_normals[normal_indices[i + 1]]
-                         : glm::vec3(0, 1, 0);
-      glm::vec3 n2 = (normal_indices[i + 2] >= 0)
-                         ? temp_normals[normal_indices[i + 2]]
-                         : glm::vec3(0, 1, 0);
-      normal = glm::normalize(n0 + n1 + n2);
-    } else {
-      glm::vec3 edge1 = v1 - v0;
-      glm::vec3 edge2 = v2 - v0;
-      normal = glm::normalize(glm::cross(edge1, edge2));
+  // Shading stays flat: each triangle gets one normal, from its corners'
+  // normals if any corner references one, otherwise from its winding
+  const long long triangleTotal = static_cast<long long>(triangleCount);
+  std::vector<glm::vec3> faceNormalList(triangleCount);
+  std::vector<uint64_t> faceNormalKeys(triangleCount);
+
+  #pragma omp parallel
+  {
+    TRACE_SCOPE("Face normals");
+    #pragma omp for
+    for (long long t = 0; t < triangleTotal; t++) {
+      const int *corners = &faceVertices[t * 3];
+      const int *cornerNormals = &faceNormals[t * 3];
+
+      glm::vec3 direction;
+      if (cornerNormals[0] >= 0 || cornerNormals[1] >= 0 ||
+          cornerNormals[2] >= 0) {
+        direction = glm::vec3(0.0f);
+        for (int k = 0; k < 3; k++) {
+          direction += cornerNormals[k] >= 0 ? normals[cornerNormals[k]]
+                                             : glm::vec3(0, 1, 0);
+        }
+      } else {
+        glm::vec3 v0 = positions[corners[0]];
+        direction = glm::cross(positions[corners[1]] - v0,
+                               positions[corners[2]] - v0);
+      }
+      float length = glm::length(direction);
+      glm::vec3 normal =
+          length > 0.0f ? direction / length : glm::vec3(0, 1, 0);
+
+      faceNormalList[t] = normal;
+      faceNormalKeys[t] = normalKey(normal);
+    }
+  }
+
+  // Group corners by OBJ position so each group can be deduplicated on its
+  // own: corners sharing a position and (quantized) normal become one vertex
+  const size_t cornerCount = triangleCount * 3;
+  std::vector<unsigned int> groupStart(vertexTotal + 1, 0);
+  std::vector<unsigned int> groupCorners(cornerCount);
+  {
+    TRACE_SCOPE("Group corners");
+    for (size_t c = 0; c < cornerCount; c++)
+      groupStart[faceVertices[c] + 1]++;
+    for (size_t p = 0; p < vertexTotal; p++)
+      groupStart[p + 1] += groupStart[p];
+    std::vector<unsigned int> fill(groupStart.begin(), groupStart.end() - 1);
+    for (size_t c = 0; c < cornerCount; c++)
+      groupCorners[fill[faceVertices[c]]++] = static_cast<unsigned int>(c);
+  }
+
+  // Pass 1 numbers the distinct normals within each group; pass 2 places the
+  // groups' vertices after a prefix sum and writes vertices and indices. A
+  // position with more than 256 distinct normals (a finely tessellated apex)
+  // reuses its last vertex for the rest
+  const long long positionTotal = static_cast<long long>(vertexTotal);
+  std::vector<unsigned char> cornerSlot(cornerCount);
+  std::vector<unsigned int> vertexStart(vertexTotal + 1, 0);
+
+  #pragma omp parallel
+  {
+    TRACE_SCOPE("Deduplicate vertices");
+    std::vector<uint64_t> seen;
+    #pragma omp for schedule(dynamic, 1024)
+    for (long long p = 0; p < positionTotal; p++) {
+      seen.clear();
+      for (unsigned int i = groupStart[p]; i < groupStart[p + 1]; i++) {
+        unsigned int corner = groupCorners[i];
+        uint64_t key = faceNormalKeys[corner / 3];
+        size_t slot =
+            std::find(seen.begin(), seen.end(), key) - seen.begin();
+        if (slot == seen.size())
+          seen.push_back(key);
+        cornerSlot[corner] = static_cast<unsigned char>(
+            std::min<size_t>(slot, 255));
+      }
+      vertexStart[p + 1] = static_cast<unsigned int>(
+          std::min<size_t>(seen.size(), 256));
     }
+  }
 
-    for (int j = 0; j < 3; j++) {
-      glm::vec3 vertex = (j == 0) ? v0 : (j == 1) ? v1 : v2;
+  for (size_t p = 0; p < vertexTotal; p++)
+    vertexStart[p + 1] += vertexStart[p];
+  const size_t uniqueVertices = vertexStart[vertexTotal];
 
-      data.vertices.push_back(vertex.x);
-      data.vertices.push_back(vertex.y);
-      data.vertices.push_back(vertex.z);
+  data.vertices.resize(uniqueVertices * 6);
+  data.indices.resize(cornerCount);
 
-      data.vertices.push_back(normal.x);
-      data.vertices.push_back(normal.y);
-      data.vertices.push_back(normal.z);
+  #pragma omp parallel
+  {
+    TRACE_SCOPE("Build vertex buffer");
+    #pragma omp for schedule(dynamic, 1024)
+    for (long long p = 0; p < positionTotal; p++) {
+      unsigned int written = 0;
+      for (unsigned int i = groupStart[p]; i < groupStart[p + 1]; i++) {
+        unsigned int corner = groupCorners[i];
+        unsigned int slot = cornerSlot[corner];
+        unsigned int vertex = vertexStart[p] + slot;
+        data.indices[corner] = vertex;
 
-      data.indices.push_back(static_cast<unsigned int>(data.indices.size()));
+        // Slots are numbered in first-seen order
+        if (slot == written) {
+          const glm::vec3 &position = positions[p];
+          const glm::vec3 &normal = faceNormalList[corner / 3];
+          float *out = &data.vertices[vertex * 6];
+          out[0] = position.x;
+          out[1] = position.y;
+          out[2] = position.z;
+          out[3] = normal.x;
+          out[4] = normal.y;
+          out[5] = normal.z;
+          written++;
+        }
+      }
     }
   }
 
@@ -154,3 +497,28 @@ ModelData ModelLoader::loadOBJ(const std::string &filepath) {
 
   return data;
 }
+
+ModelData ModelLoader::loadOBJCached(const std::string &filepath,
+                                     const std::string &cachePath) {
+  std::string path = cachePath;
+  if (path.empty()) {
+    path = std::filesystem::path(filepath).replace_extension(".hmesh").string();
+  }
+
+  MeshCacheKey key;
+  if (!MeshCacheKey::fromFile(filepath, key)) {
+    std::cerr << "Failed to open OBJ file: " << filepath << std::endl;
+    return {};
+  }
+
+  ModelData data;
+  if (MeshCache::load(path, key, data))
+    return data;
+
+  data = loadOBJ(filepath);
+  if (data.loaded) {
+    MeshLodBuilder::build(data);
+    MeshCache::save(path, data, key);
+  }
+  return data;
+}
@@ -1,6 +1,6 @@
 #include "node_manager.h"
 #include "camera.h"
-#include "spatial_index.h"
+#include "scene_geometry.h"
 #include <algorithm>
 #include <limits>
 
@@ -73,8 +73,9 @@ void NodeManager::moveSelectedNode(const glm::vec3 &newPosition) {
 
 void NodeManager::setNodePosition(int id, const glm::vec3 &position) {
   RadioSource *node = radioSystem.getSourceById(id);
-  if (node) {
+  if (node && node->position != position) {
     node->position = position;
+    radioSystem.invalidateSource(id);
   }
 }
 
@@ -104,7 +105,7 @@ int NodeManager::pickNode(const glm::vec3 &rayOrigin,
 
 glm::vec3 NodeManager::pickPosition(const glm::vec3 &rayOrigin,
                                     const glm::vec3 &rayDirection,
-                                    const SpatialIndex *spatialIndex,
+                                    const SceneGeometry *spatialIndex,
                                     bool &hit) {
   hit = false;
 
@@ -2,24 +2,34 @@
 #include "camera.h"
 #include "radio_system.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 
 const std::string NodeRenderer::nodeVertexShader = R"(
 #version 330 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
+// Per instance: position and scale, color and selection flag
+layout(location = 2) in vec4 instancePositionScale;
+layout(location = 3) in vec4 instanceColorSelected;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 out vec3 FragPos;
 out vec3 Normal;
+flat out vec3 NodeColor;
+flat out float Selected;
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = aPos * instancePositionScale.w + instancePositionScale.xyz;
+    // Uniform scaling leaves normals as they are
+    Normal = aNormal;
+    NodeColor = instanceColorSelected.rgb;
+    Selected = instanceColorSelected.a;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
 )";
@@ -30,20 +40,20 @@ out vec4 FragColor;
 
 in vec3 FragPos;
 in vec3 Normal;
+flat in vec3 NodeColor;
+flat in float Selected;
 
-uniform vec3 nodeColor;
-uniform bool isSelected;
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
 void main() {
     float ambientStrength = 0.3;
-    vec3 ambient = ambientStrength * nodeColor;
+    vec3 ambient = ambientStrength * NodeColor;
     
     vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(lightPos - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * nodeColor;
+    vec3 diffuse = diff * NodeColor;
     
     float specularStrength = 0.5;
     vec3 viewDir = normalize(viewPos - FragPos);
@@ -53,7 +63,7 @@ void main() {
     
     vec3 result = ambient + diffuse + specular;
     
-    if (isSelected) {
+    if (Selected > 0.5) {
         result = mix(result, vec3(1.0, 1.0, 0.0), 0.4);
     }
     
@@ -63,7 +73,9 @@ void main() {
 
 NodeRenderer::NodeRenderer()
     : nodeShaderProgram(0), sphereVAO(0), sphereVBO(0), sphereEBO(0),
-      sphereIndexCount(0), gizmoShaderProgram(0), gizmoVAO(0), gizmoVBO(0) {}
+      sphereIndexCount(0), instanceVBO(0), instanceCapacity(0),
+      previewVAO(0), previewInstanceVBO(0), gizmoShaderProgram(0),
+      gizmoVAO(0), gizmoVBO(0) {}
 
 NodeRenderer::~NodeRenderer() { cleanup(); }
 
@@ -73,6 +85,11 @@ bool NodeRenderer::initialize() {
     std::cerr << "Failed to create node shader program" << std::endl;
     return false;
   }
+  nodeUniforms.view = glGetUniformLocation(nodeShaderProgram, "view");
+  nodeUniforms.projection =
+      glGetUniformLocation(nodeShaderProgram, "projection");
+  nodeUniforms.lightPos = glGetUniformLocation(nodeShaderProgram, "lightPos");
+  nodeUniforms.viewPos = glGetUniformLocation(nodeShaderProgram, "viewPos");
 
   gizmoShaderProgram =
       createShaderProgram(gizmoVertexShader, gizmoFragmentShader);
@@ -80,6 +97,13 @@ bool NodeRenderer::initialize() {
     std::cerr << "Failed to create gizmo shader program" << std::endl;
     return false;
   }
+  gizmoUniforms.view = glGetUniformLocation(gizmoShaderProgram, "view");
+  gizmoUniforms.projection =
+      glGetUniformLocation(gizmoShaderProgram, "projection");
+  gizmoUniforms.gizmoPosition =
+      glGetUniformLocation(gizmoShaderProgram, "gizmoPosition");
+  gizmoUniforms.axisColor =
+      glGetUniformLocation(gizmoShaderProgram, "axisColor");
 
   createSphere(8.0f, 16);
   createGizmo();
@@ -133,12 +157,9 @@ void NodeRenderer::createSphere(float radius, int segments) {
 
   sphereIndexCount = indices.size();
 
-  glGenVertexArrays(1, &sphereVAO);
   glGenBuffers(1, &sphereVBO);
   glGenBuffers(1, &sphereEBO);
 
-  glBindVertexArray(sphereVAO);
-
   glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
   glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
                vertices.data(), GL_STATIC_DRAW);
@@ -146,6 +167,21 @@ void NodeRenderer::createSphere(float radius, int segments) {
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
                indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  createInstancedVAO(sphereVAO, instanceVBO, 0);
+  createInstancedVAO(previewVAO, previewInstanceVBO, 1);
+}
+
+void NodeRenderer::createInstancedVAO(GLuint &vao, GLuint &instanceBuffer,
+                                      size_t instanceCount) {
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &instanceBuffer);
+
+  glBindVertexArray(vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
   glEnableVertexAttribArray(0);
@@ -154,47 +190,76 @@ void NodeRenderer::createSphere(float radius, int segments) {
                         (void *)(3 * sizeof(float)));
   glEnableVertexAttribArray(1);
 
-  glBindVertexArray(0);
-}
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, instanceCount * sizeof(NodeInstance), nullptr,
+               GL_DYNAMIC_DRAW);
 
-void NodeRenderer::render(const RadioSystem &radioSystem, const glm::mat4 &view,
-                          const glm::mat4 &projection, int selectedNodeId) {
-  glUseProgram(nodeShaderProgram);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(NodeInstance),
+                        (void *)offsetof(NodeInstance, position));
+  glVertexAttribDivisor(2, 1);
+  glEnableVertexAttribArray(2);
 
-  GLint projLoc = glGetUniformLocation(nodeShaderProgram, "projection");
-  GLint viewLoc = glGetUniformLocation(nodeShaderProgram, "view");
-  glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection[0][0]);
-  glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
+  glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(NodeInstance),
+                        (void *)offsetof(NodeInstance, color));
+  glVertexAttribDivisor(3, 1);
+  glEnableVertexAttribArray(3);
 
-  glm::vec3 cameraPos = glm::vec3(glm::inverse(view)[3]);
-  GLint lightPosLoc = glGetUniformLocation(nodeShaderProgram, "lightPos");
-  GLint viewPosLoc = glGetUniformLocation(nodeShaderProgram, "viewPos");
-  glUniform3fv(lightPosLoc, 1, &cameraPos[0]);
-  glUniform3fv(viewPosLoc, 1, &cameraPos[0]);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-  const auto &sources = radioSystem.getSources();
-  for (const auto &node : sources) {
+void NodeRenderer::updateInstances(const RadioSystem &radioSystem,
+                                   int selectedNodeId) {
+  frameInstances.clear();
+  for (const auto &node : radioSystem.getSources()) {
     if (!node.visible)
       continue;
+    bool isSelected = (node.id == selectedNodeId);
+    frameInstances.push_back({node.position, isSelected ? 1.2f : 1.0f,
+                              node.color, isSelected ? 1.0f : 0.0f});
+  }
 
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, node.position);
+  // Only upload when a node was added, removed, moved or restyled
+  if (frameInstances.size() == instances.size() &&
+      std::memcmp(frameInstances.data(), instances.data(),
+                  instances.size() * sizeof(NodeInstance)) == 0)
+    return;
+  instances.swap(frameInstances);
 
-    bool isSelected = (node.id == selectedNodeId);
-    float scale = isSelected ? 1.2f : 1.0f;
-    model = glm::scale(model, glm::vec3(scale));
+  glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+  if (instances.size() > instanceCapacity) {
+    instanceCapacity = std::max(instances.size(), instanceCapacity * 2);
+    glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(NodeInstance),
+                 nullptr, GL_DYNAMIC_DRAW);
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(NodeInstance),
+                  instances.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    GLint modelLoc = glGetUniformLocation(nodeShaderProgram, "model");
-    GLint colorLoc = glGetUniformLocation(nodeShaderProgram, "nodeColor");
-    GLint selectedLoc = glGetUniformLocation(nodeShaderProgram, "isSelected");
+void NodeRenderer::setNodeUniforms(const glm::mat4 &view,
+                                   const glm::mat4 &projection) {
+  glUniformMatrix4fv(nodeUniforms.projection, 1, GL_FALSE, &projection[0][0]);
+  glUniformMatrix4fv(nodeUniforms.view, 1, GL_FALSE, &view[0][0]);
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-    glUniform3fv(colorLoc, 1, &node.color[0]);
-    glUniform1i(selectedLoc, isSelected ? 1 : 0);
+  glm::vec3 cameraPos = glm::vec3(glm::inverse(view)[3]);
+  glUniform3fv(nodeUniforms.lightPos, 1, &cameraPos[0]);
+  glUniform3fv(nodeUniforms.viewPos, 1, &cameraPos[0]);
+}
 
-    glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
-  }
+void NodeRenderer::render(const RadioSystem &radioSystem, const glm::mat4 &view,
+                          const glm::mat4 &projection, int selectedNodeId) {
+  updateInstances(radioSystem, selectedNodeId);
+  if (instances.empty())
+    return;
+
+  glUseProgram(nodeShaderProgram);
+  setNodeUniforms(view, projection);
+
+  glBindVertexArray(sphereVAO);
+  glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(sphereIndexCount),
+                          GL_UNSIGNED_INT, 0,
+                          static_cast<GLsizei>(instances.size()));
 
   glBindVertexArray(0);
   glUseProgram(0);
@@ -205,39 +270,23 @@ void NodeRenderer::renderPlacementPreview(const glm::vec3 &position,
                                           const glm::mat4 &view,
                                           const glm::mat4 &projection) {
   glUseProgram(nodeShaderProgram);
-
-  GLint projLoc = glGetUniformLocation(nodeShaderProgram, "projection");
-  GLint viewLoc = glGetUniformLocation(nodeShaderProgram, "view");
-  glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection[0][0]);
-  glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
-
-  glm::vec3 cameraPos = glm::vec3(glm::inverse(view)[3]);
-  GLint lightPosLoc = glGetUniformLocation(nodeShaderProgram, "lightPos");
-  GLint viewPosLoc = glGetUniformLocation(nodeShaderProgram, "viewPos");
-  glUniform3fv(lightPosLoc, 1, &cameraPos[0]);
-  glUniform3fv(viewPosLoc, 1, &cameraPos[0]);
+  setNodeUniforms(view, projection);
 
   float time = glfwGetTime();
   float pulseScale = 1.0f + 0.1f * sin(time * 3.0f);
 
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::translate(model, position);
-  model = glm::scale(model, glm::vec3(pulseScale));
-
-  GLint modelLoc = glGetUniformLocation(nodeShaderProgram, "model");
-  GLint colorLoc = glGetUniformLocation(nodeShaderProgram, "nodeColor");
-  GLint selectedLoc = glGetUniformLocation(nodeShaderProgram, "isSelected");
-
   glm::vec3 previewColor = color * 0.7f + glm::vec3(0.3f);
-  glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-  glUniform3fv(colorLoc, 1, &previewColor[0]);
-  glUniform1i(selectedLoc, 0);
+  NodeInstance preview = {position, pulseScale, previewColor, 0.0f};
+  glBindBuffer(GL_ARRAY_BUFFER, previewInstanceVBO);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(preview), &preview);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  glBindVertexArray(sphereVAO);
-  glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
+  glBindVertexArray(previewVAO);
+  glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(sphereIndexCount),
+                          GL_UNSIGNED_INT, 0, 1);
 
   glDisable(GL_BLEND);
   glBindVertexArray(0);
@@ -257,6 +306,20 @@ void NodeRenderer::cleanup() {
     glDeleteBuffers(1, &sphereEBO);
     sphereEBO = 0;
   }
+  if (instanceVBO != 0) {
+    glDeleteBuffers(1, &instanceVBO);
+    instanceVBO = 0;
+  }
+  if (previewVAO != 0) {
+    glDeleteVertexArrays(1, &previewVAO);
+    previewVAO = 0;
+  }
+  if (previewInstanceVBO != 0) {
+    glDeleteBuffers(1, &previewInstanceVBO);
+    previewInstanceVBO = 0;
+  }
+  instanceCapacity = 0;
+  instances.clear();
   if (nodeShaderProgram != 0) {
     glDeleteProgram(nodeShaderProgram);
     nodeShaderProgram = 0;
@@ -398,29 +461,23 @@ void NodeRenderer::renderGizmo(const glm::vec3 &position, const glm::mat4 &view,
 
   glUseProgram(gizmoShaderProgram);
 
-  glUniformMatrix4fv(glGetUniformLocation(gizmoShaderProgram, "view"), 1,
-                     GL_FALSE, &view[0][0]);
-  glUniformMatrix4fv(glGetUniformLocation(gizmoShaderProgram, "projection"), 1,
-                     GL_FALSE, &projection[0][0]);
-  glUniform3fv(glGetUniformLocation(gizmoShaderProgram, "gizmoPosition"), 1,
-               &position[0]);
+  glUniformMatrix4fv(gizmoUniforms.view, 1, GL_FALSE, &view[0][0]);
+  glUniformMatrix4fv(gizmoUniforms.projection, 1, GL_FALSE, &projection[0][0]);
+  glUniform3fv(gizmoUniforms.gizmoPosition, 1, &position[0]);
 
   glBindVertexArray(gizmoVAO);
   glLineWidth(4.0f);
 
   // Draw X axis (red)
-  glUniform3f(glGetUniformLocation(gizmoShaderProgram, "axisColor"), 1.0f, 0.0f,
-              0.0f);
+  glUniform3f(gizmoUniforms.axisColor, 1.0f, 0.0f, 0.0f);
   glDrawArrays(GL_LINES, 0, 2);
 
   // Draw Y axis (green)
-  glUniform3f(glGetUniformLocation(gizmoShaderProgram, "axisColor"), 0.0f, 1.0f,
-              0.0f);
+  glUniform3f(gizmoUniforms.axisColor, 0.0f, 1.0f, 0.0f);
   glDrawArrays(GL_LINES, 2, 2);
 
   // Draw Z axis (blue)
-  glUniform3f(glGetUniformLocation(gizmoShaderProgram, "axisColor"), 0.0f, 0.0f,
-              1.0f);
+  glUniform3f(gizmoUniforms.axisColor, 0.0f, 0.0f, 1.0f);
   glDrawArrays(GL_LINES, 4, 2);
 
   glLineWidth(1.0f);
@@ -0,0 +1,561 @@
+#include "parameter_sweep.h"
+#include "cpu_fdtd_solver.h"
+#include "image_method_solver.h"
+#include "radio_system.h"
+#include "scene_geometry.h"
+#include "scene_serializer.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// Metrics that were not computed are left empty
+std::string formatMetric(float value) {
+  if (std::isnan(value))
+    return "";
+  std::ostringstream oss;
+  oss << value;
+  return oss.str();
+}
+
+const RadioSource *findSource(const RadioSystem &radioSystem, int id) {
+  for (const auto &node : radioSystem.getSources()) {
+    if (node.id == id)
+      return &node;
+  }
+  return nullptr;
+}
+
+// Reset the worker's nodes to the scene, then apply the variant on top
+void applyVariant(const SweepVariant &variant, const RadioSystem &scene,
+                  RadioSystem &radioSystem) {
+  const auto &base = scene.getSources();
+  auto &sources = radioSystem.getSources();
+  for (size_t i = 0; i < sources.size(); i++) {
+    RadioSource &node = sources[i];
+    node.position = base[i].position;
+    node.frequency = base[i].frequency;
+    if (node.type == NodeType::TRANSMITTER && !std::isnan(variant.frequency))
+      node.frequency = variant.frequency;
+
+    for (const auto &position : variant.positions) {
+      if (position.first == node.name)
+        node.position = position.second;
+    }
+  }
+}
+
+void evaluateRays(RadioSystem &radioSystem, ImageMethodSolver &linkSolver,
+                  const SceneGeometry &spatialIndex,
+                  std::vector<ReceiverMetrics> &metrics) {
+  radioSystem.computeSignalPropagation(&spatialIndex);
+  linkSolver.computeLinks(radioSystem, spatialIndex);
+
+  const CoverageMap &coverage = radioSystem.getCoverage();
+  for (auto &receiver : metrics) {
+    const RadioSource *node = findSource(radioSystem, receiver.receiverId);
+    int cell = coverage.cellIndex(node->position);
+    receiver.coverage = cell >= 0 ? coverage.values[cell] : 0.0f;
+
+    double totalGain = 0.0;
+    for (const auto &link : linkSolver.getLinks()) {
+      if (link.receiverId != receiver.receiverId)
+        continue;
+      totalGain += std::pow(10.0, link.totalGainDb / 10.0);
+      if (link.paths.empty())
+        continue;
+      if (receiver.bestTransmitterId < 0 ||
+          link.bestLossDb < receiver.bestLossDb) {
+        receiver.bestTransmitterId = link.transmitterId;
+        receiver.lineOfSight = link.lineOfSight;
+        receiver.paths = static_cast<int>(link.paths.size());
+        receiver.bestLossDb = link.bestLossDb;
+      }
+    }
+    receiver.totalGainDb =
+        totalGain > 0.0 ? static_cast<float>(10.0 * std::log10(totalGain))
+                        : -300.0f;
+  }
+}
+
+void evaluateFDTD(const SweepSettings &settings, const RadioSystem &radioSystem,
+                  const std::vector<unsigned char> &occupancy,
+                  float materialEpsilon, float conductivity,
+                  const glm::vec3 &gridCenter, const glm::vec3 &gridHalfSize,
+                  CPUFDTDSolver &solver,
+                  std::vector<ReceiverMetrics> &metrics) {
+  const int gridSize = solver.getGridSize();
+  solver.reset();
+  solver.applyMaterial(occupancy, materialEpsilon);
+  solver.setConductivity(conductivity);
+
+  std::vector<glm::ivec3> sourceCells;
+  std::vector<float> sourceFrequencies;
+  std::vector<float> frequencies;
+  for (const auto &node : radioSystem.getSources()) {
+    if (!node.active || node.type != NodeType::TRANSMITTER)
+      continue;
+    sourceCells.push_back(
+        worldToGrid(node.position, gridCenter, gridHalfSize, gridSize));
+    sourceFrequencies.push_back(node.frequency);
+    if (std::find(frequencies.begin(), frequencies.end(), node.frequency) ==
+        frequencies.end()) {
+      frequencies.push_back(node.frequency);
+    }
+  }
+
+  std::vector<FDTDProbe> probes;
+  for (const auto &receiver : metrics) {
+    const RadioSource *node = findSource(radioSystem, receiver.receiverId);
+    probes.push_back({receiver.receiverId,
+                      worldToGrid(node->position, gridCenter, gridHalfSize,
+                                  gridSize)});
+  }
+  solver.setProbes(probes);
+  solver.setDFTFrequencies(frequencies);
+
+  for (int step = 0; step < settings.steps; step++) {
+    // Same continuous-wave drive as the viewer
+    solver.clearEmission();
+    double time = (step + 1) * static_cast<double>(solver.getTimeStep());
+    for (size_t t = 0; t < sourceCells.size(); t++) {
+      float oscillation = static_cast<float>(
+          std::sin(2.0 * M_PI * sourceFrequencies[t] * time) *
+          settings.emissionStrength);
+      solver.addEmissionSource(sourceCells[t].x, sourceCells[t].y,
+                               sourceCells[t].z, oscillation);
+    }
+    solver.update();
+  }
+
+  for (int p = 0; p < solver.getProbeCount(); p++) {
+    ReceiverMetrics &receiver = metrics[p];
+    receiver.rssiDb = solver.getProbeRSSI(p);
+    for (int f = 0; f < solver.getDFTFrequencyCount(); f++) {
+      float amplitude =
+          glm::length(solver.getDFTPhasor(f, solver.getProbe(p).cell));
+      receiver.dftFrequency[f] = solver.getDFTFrequency(f);
+      receiver.dftAmplitudeDb[f] =
+          amplitude > 0.0f ? 20.0f * std::log10(amplitude) : -300.0f;
+    }
+  }
+}
+
+} // namespace
+
+bool ParameterSweep::loadFile(const std::string &path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for reading: " << path << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    size_t comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream iss(line);
+    std::string keyword;
+    if (!(iss >> keyword))
+      continue;
+
+    std::vector<std::string> tokens;
+    for (std::string token; iss >> token;)
+      tokens.push_back(token);
+
+    SweepAxis axis;
+    bool valid = !tokens.empty();
+    if (keyword == "frequency" || keyword == "conductivity" ||
+        keyword == "material_epsilon") {
+      axis.parameter = keyword == "frequency"
+                           ? SweepAxis::Parameter::FREQUENCY
+                       : keyword == "conductivity"
+                           ? SweepAxis::Parameter::CONDUCTIVITY
+                           : SweepAxis::Parameter::MATERIAL_EPSILON;
+      for (const auto &token : tokens) {
+        float value = 0.0f;
+        valid = valid && SceneSerializer::parseFloat(token, value);
+        axis.values.push_back(value);
+      }
+    } else if (keyword == "position") {
+      axis.parameter = SweepAxis::Parameter::POSITION;
+      valid = tokens.size() >= 2;
+      for (size_t i = 1; valid && i < tokens.size(); i++) {
+        glm::vec3 position;
+        valid = SceneSerializer::parseVec3(tokens[i], position);
+        axis.positions.push_back(position);
+      }
+      if (valid)
+        axis.nodeName = tokens[0];
+    } else if (keyword == "position_grid") {
+      axis.parameter = SweepAxis::Parameter::POSITION;
+      glm::vec3 minPos, maxPos, counts;
+      valid = tokens.size() == 4 &&
+              SceneSerializer::parseVec3(tokens[1], minPos) &&
+              SceneSerializer::parseVec3(tokens[2], maxPos) &&
+              SceneSerializer::parseVec3(tokens[3], counts);
+      if (valid) {
+        axis.nodeName = tokens[0];
+        int nx = std::max(static_cast<int>(counts.x), 1);
+        int ny = std::max(static_cast<int>(counts.y), 1);
+        int nz = std::max(static_cast<int>(counts.z), 1);
+        // A single sample along an axis sits in the middle of the range
+        auto sample = [](float lo, float hi, int i, int n) {
+          return n > 1 ? lo + (hi - lo) * i / (n - 1) : (lo + hi) * 0.5f;
+        };
+        for (int z = 0; z < nz; z++) {
+          for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+              axis.positions.emplace_back(sample(minPos.x, maxPos.x, x, nx),
+                                          sample(minPos.y, maxPos.y, y, ny),
+                                          sample(minPos.z, maxPos.z, z, nz));
+            }
+          }
+        }
+      }
+    } else {
+      std::cerr << path << ":" << lineNumber << ": unknown sweep parameter '"
+                << keyword << "'" << std::endl;
+      return false;
+    }
+
+    if (!valid) {
+      std::cerr << path << ":" << lineNumber << ": invalid values for "
+                << keyword << std::endl;
+      return false;
+    }
+    axes.push_back(axis);
+  }
+
+  std::cout << "Loaded sweep with " << axes.size() << " axes ("
+            << getVariantCount() << " variants)" << std::endl;
+  return true;
+}
+
+size_t ParameterSweep::getVariantCount() const {
+  size_t count = 1;
+  for (const auto &axis : axes)
+    count *= axis.size();
+  return count;
+}
+
+std::vector<size_t> ParameterSweep::decodeIndex(size_t index) const {
+  std::vector<size_t> digits(axes.size());
+  for (size_t a = axes.size(); a-- > 0;) {
+    digits[a] = index % axes[a].size();
+    index /= axes[a].size();
+  }
+  return digits;
+}
+
+SweepVariant ParameterSweep::getVariant(size_t index) const {
+  SweepVariant variant;
+  variant.index = index;
+
+  std::vector<size_t> digits = decodeIndex(index);
+  for (size_t a = 0; a < axes.size(); a++) {
+    const SweepAxis &axis = axes[a];
+    switch (axis.parameter) {
+    case SweepAxis::Parameter::FREQUENCY:
+      variant.frequency = axis.values[digits[a]];
+      break;
+    case SweepAxis::Parameter::CONDUCTIVITY:
+      variant.conductivity = axis.values[digits[a]];
+      break;
+    case SweepAxis::Parameter::MATERIAL_EPSILON:
+      variant.materialEpsilon = axis.values[digits[a]];
+      break;
+    case SweepAxis::Parameter::POSITION:
+      variant.positions.emplace_back(axis.nodeName,
+                                     axis.positions[digits[a]]);
+      break;
+    }
+  }
+  return variant;
+}
+
+bool ParameterSweep::run(const SweepSettings &settings,
+                         const RadioSystem &scene, const SceneData &sceneData,
+                         const SceneGeometry &spatialIndex,
+                         const std::string &outputPath) {
+  const auto &sources = scene.getSources();
+  for (const auto &axis : axes) {
+    if (axis.parameter != SweepAxis::Parameter::POSITION)
+      continue;
+    if (std::none_of(sources.begin(), sources.end(),
+                     [&axis](const RadioSource &node) {
+                       return node.name == axis.nodeName;
+                     })) {
+      std::cerr << "Sweep references unknown node: " << axis.nodeName
+                << std::endl;
+      return false;
+    }
+  }
+
+  std::vector<ReceiverMetrics> receivers;
+  bool hasTransmitter = false;
+  for (const auto &node : sources) {
+    if (!node.active)
+      continue;
+    if (node.type == NodeType::RECEIVER) {
+      ReceiverMetrics receiver;
+      receiver.receiverId = node.id;
+      receiver.receiverName = node.name;
+      receivers.push_back(receiver);
+    }
+    hasTransmitter |= node.type == NodeType::TRANSMITTER;
+  }
+  if (receivers.empty() || !hasTransmitter) {
+    std::cerr << "Sweep needs at least one active transmitter and receiver"
+              << std::endl;
+    return false;
+  }
+
+  const size_t variantCount = getVariantCount();
+  if (variantCount == 0) {
+    std::cerr << "Sweep has an axis without values" << std::endl;
+    return false;
+  }
+
+  // One FDTD grid for every variant, placed over every position a node can
+  // take, so the occupancy volume is voxelized once and shared
+  glm::vec3 gridCenter(0.0f);
+  glm::vec3 gridHalfSize = sceneData.fdtdGridHalfSize;
+  int gridSize = 0;
+  std::vector<unsigned char> occupancy;
+  int dftCount = 0;
+  if (settings.runFDTD) {
+    glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+    std::vector<float> frequencies;
+    for (const auto &node : sources) {
+      if (!node.active || node.type == NodeType::RELAY)
+        continue;
+      minPos = glm::min(minPos, node.position);
+      maxPos = glm::max(maxPos, node.position);
+      if (node.type == NodeType::TRANSMITTER &&
+          std::find(frequencies.begin(), frequencies.end(), node.frequency) ==
+              frequencies.end()) {
+        frequencies.push_back(node.frequency);
+      }
+    }
+    bool sweepsFrequency = false;
+    for (const auto &axis : axes) {
+      sweepsFrequency |= axis.parameter == SweepAxis::Parameter::FREQUENCY;
+      for (const auto &position : axis.positions) {
+        minPos = glm::min(minPos, position);
+        maxPos = glm::max(maxPos, position);
+      }
+    }
+    dftCount = sweepsFrequency ? 1 : std::min<int>(frequencies.size(), 2);
+
+    gridCenter = (minPos + maxPos) * 0.5f;
+    gridSize = settings.gridSize > 0
+                   ? settings.gridSize
+                   : gridSizeForSpacing(gridHalfSize, sceneData.voxelSpacing);
+    glm::vec3 extent = (maxPos - minPos) * 0.5f;
+    if (extent.x > gridHalfSize.x || extent.y > gridHalfSize.y ||
+        extent.z > gridHalfSize.z) {
+      std::cerr << "Warning: candidate positions span more than the FDTD "
+                   "grid; nodes outside it are clamped to the boundary"
+                << std::endl;
+    }
+
+    occupancy = CPUFDTDSolver::voxelize(gridSize, gridCenter, gridHalfSize,
+                                        spatialIndex, 0.0f);
+  }
+
+  // Worker pool, bounded by the memory each worker's solver needs
+  int hardwareThreads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  int workers = settings.workers > 0 ? settings.workers : hardwareThreads;
+  size_t solverBytes = 0;
+  if (settings.runFDTD) {
+    solverBytes = CPUFDTDSolver::estimateMemory(
+        gridSize, dftCount, static_cast<int>(receivers.size()),
+        settings.steps);
+    size_t budget = settings.memoryLimitMB * 1024 * 1024;
+    budget = budget > occupancy.size() ? budget - occupancy.size() : 0;
+    int memoryWorkers = static_cast<int>(
+        std::min<size_t>(std::max<size_t>(budget / solverBytes, 1), 1 << 16));
+    if (memoryWorkers < workers) {
+      std::cout << "Memory limit of " << settings.memoryLimitMB
+                << " MB allows " << memoryWorkers << " workers" << std::endl;
+      workers = memoryWorkers;
+    }
+  }
+  workers = static_cast<int>(
+      std::min<size_t>(static_cast<size_t>(workers), variantCount));
+  // Split the cores between workers so nested OpenMP loops don't
+  // oversubscribe
+  int threadsPerWorker = std::max(1, hardwareThreads / workers);
+
+  std::cout << "Sweep: " << variantCount << " variants on " << workers
+            << " workers, " << threadsPerWorker << " threads each";
+  if (solverBytes > 0)
+    std::cout << ", ~" << solverBytes / (1024 * 1024) << " MB per solver";
+  std::cout << std::endl;
+
+  const BoundingBox &bounds = spatialIndex.getBounds();
+  std::vector<std::vector<ReceiverMetrics>> results(variantCount);
+  std::atomic<size_t> nextVariant(0);
+  std::atomic<size_t> completed(0);
+  std::mutex logMutex;
+  auto start = std::chrono::steady_clock::now();
+
+  auto worker = [&]() {
+#ifdef _OPENMP
+    omp_set_num_threads(threadsPerWorker);
+#endif
+    // Per-worker state, reused across variants
+    RadioSystem radioSystem = scene;
+    ImageMethodSolver linkSolver;
+    CPUFDTDSolver solver;
+    if (settings.runRays) {
+      radioSystem.setCoverageArea(bounds.min, bounds.max,
+                                  settings.coverageCellSize);
+    }
+    if (settings.runFDTD) {
+      solver.setVoxelSpacing(sceneData.voxelSpacing);
+      solver.initialize(gridSize);
+    }
+
+    for (size_t index = nextVariant++; index < variantCount;
+         index = nextVariant++) {
+      TRACE_SCOPE("Sweep variant");
+      SweepVariant variant = getVariant(index);
+      applyVariant(variant, scene, radioSystem);
+
+      std::vector<ReceiverMetrics> metrics = receivers;
+      if (settings.runRays) {
+        evaluateRays(radioSystem, linkSolver, spatialIndex, metrics);
+      }
+      if (settings.runFDTD) {
+        float materialEpsilon = std::isnan(variant.materialEpsilon)
+                                    ? settings.materialEpsilon
+                                    : variant.materialEpsilon;
+        float conductivity = std::isnan(variant.conductivity)
+                                 ? sceneData.conductivity
+                                 : variant.conductivity;
+        evaluateFDTD(settings, radioSystem, occupancy, materialEpsilon,
+                     conductivity, gridCenter, gridHalfSize, solver, metrics);
+      }
+      results[index] = std::move(metrics);
+
+      size_t done = ++completed;
+      std::lock_guard<std::mutex> lock(logMutex);
+      std::cout << "Variant " << index + 1 << " done (" << done << "/"
+                << variantCount << ")" << std::endl;
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (int w = 1; w < workers; w++)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &thread : pool)
+    thread.join();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << "Sweep finished in " << seconds << " s ("
+            << seconds / variantCount << " s per variant)" << std::endl;
+
+  return writeTable(outputPath, settings, results);
+}
+
+bool ParameterSweep::writeTable(
+    const std::string &path, const SweepSettings &settings,
+    const std::vector<std::vector<ReceiverMetrics>> &results) const {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+
+  file << "variant";
+  for (const auto &axis : axes) {
+    switch (axis.parameter) {
+    case SweepAxis::Parameter::FREQUENCY:
+      file << ",frequency_hz";
+      break;
+    case SweepAxis::Parameter::CONDUCTIVITY:
+      file << ",conductivity";
+      break;
+    case SweepAxis::Parameter::MATERIAL_EPSILON:
+      file << ",material_epsilon";
+      break;
+    case SweepAxis::Parameter::POSITION:
+      file << "," << axis.nodeName << "_x," << axis.nodeName << "_y,"
+           << axis.nodeName << "_z";
+      break;
+    }
+  }
+  file << ",receiver_id,receiver_name";
+  if (settings.runRays) {
+    file << ",coverage,best_transmitter_id,line_of_sight,paths,best_loss_db,"
+            "total_gain_db";
+  }
+  if (settings.runFDTD) {
+    file << ",fdtd_rssi_db,dft0_frequency_hz,dft0_amplitude_db,"
+            "dft1_frequency_hz,dft1_amplitude_db";
+  }
+  file << "\n";
+
+  for (size_t index = 0; index < results.size(); index++) {
+    // Swept values, shared by every receiver row of the variant
+    std::ostringstream prefix;
+    prefix << index;
+    std::vector<size_t> digits = decodeIndex(index);
+    for (size_t a = 0; a < axes.size(); a++) {
+      const SweepAxis &axis = axes[a];
+      if (axis.parameter == SweepAxis::Parameter::POSITION) {
+        const glm::vec3 &p = axis.positions[digits[a]];
+        prefix << "," << formatMetric(p.x) << "," << formatMetric(p.y) << ","
+               << formatMetric(p.z);
+      } else {
+        prefix << "," << formatMetric(axis.values[digits[a]]);
+      }
+    }
+
+    for (const auto &receiver : results[index]) {
+      file << prefix.str() << "," << receiver.receiverId << ","
+           << receiver.receiverName;
+      if (settings.runRays) {
+        file << "," << formatMetric(receiver.coverage) << ","
+             << receiver.bestTransmitterId << ","
+             << (receiver.lineOfSight ? 1 : 0) << "," << receiver.paths << ","
+             << formatMetric(receiver.bestLossDb) << ","
+             << formatMetric(receiver.totalGainDb);
+      }
+      if (settings.runFDTD) {
+        file << "," << formatMetric(receiver.rssiDb);
+        for (int f = 0; f < 2; f++) {
+          file << "," << formatMetric(receiver.dftFrequency[f]) << ","
+               << formatMetric(receiver.dftAmplitudeDb[f]);
+        }
+      }
+      file << "\n";
+    }
+  }
+
+  std::cout << "Sweep table written to " << path << std::endl;
+  return true;
+}
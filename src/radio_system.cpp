@@ -1,11 +1,73 @@
 #include "radio_system.h"
-#include "spatial_index.h"
+#include "scene_geometry.h"
+#include "trace.h"
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
 #include <glm/gtc/constants.hpp>
 
+namespace {
+
+using TubeFace = std::array<int, 3>;
+
+// Unit icosahedron subdivided `level` times; faces index into `dirs`
+void buildIcosphere(int level, std::vector<glm::vec3> &dirs,
+                    std::vector<TubeFace> &faces) {
+  const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+  dirs = {{-1, t, 0}, {1, t, 0},  {-1, -t, 0}, {1, -t, 0},
+          {0, -1, t}, {0, 1, t},  {0, -1, -t}, {0, 1, -t},
+          {t, 0, -1}, {t, 0, 1},  {-t, 0, -1}, {-t, 0, 1}};
+  for (auto &d : dirs)
+    d = glm::normalize(d);
+
+  faces = {{0, 11, 5}, {0, 5, 1},  {0, 1, 7},   {0, 7, 10}, {0, 10, 11},
+           {1, 5, 9},  {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+           {3, 9, 4},  {3, 4, 2},  {3, 2, 6},   {3, 6, 8},  {3, 8, 9},
+           {4, 9, 5},  {2, 4, 11}, {6, 2, 10},  {8, 6, 7},  {9, 8, 1}};
+
+  for (int l = 0; l < level; l++) {
+    std::unordered_map<uint64_t, int> midpoints;
+    auto midpoint = [&](int a, int b) {
+      uint64_t key = (uint64_t(std::min(a, b)) << 32) | uint32_t(std::max(a, b));
+      auto it = midpoints.find(key);
+      if (it != midpoints.end())
+        return it->second;
+      dirs.push_back(glm::normalize(dirs[a] + dirs[b]));
+      int idx = static_cast<int>(dirs.size()) - 1;
+      midpoints.emplace(key, idx);
+      return idx;
+    };
+
+    std::vector<TubeFace> refined;
+    refined.reserve(faces.size() * 4);
+    for (const auto &f : faces) {
+      int ab = midpoint(f[0], f[1]);
+      int bc = midpoint(f[1], f[2]);
+      int ca = midpoint(f[2], f[0]);
+      refined.push_back({f[0], ab, ca});
+      refined.push_back({f[1], bc, ab});
+      refined.push_back({f[2], ca, bc});
+      refined.push_back({ab, bc, ca});
+    }
+    faces.swap(refined);
+  }
+}
+
+float tubeSolidAngle(const glm::vec3 &a, const glm::vec3 &b,
+                     const glm::vec3 &c) {
+  // Spherical excess (Van Oosterom & Strackee)
+  float numer = glm::dot(a, glm::cross(b, c));
+  float denom = 1.0f + glm::dot(a, b) + glm::dot(b, c) + glm::dot(c, a);
+  return 2.0f * std::abs(std::atan2(numer, denom));
+}
+
+} // namespace
+
 RadioSystem::RadioSystem()
-    : nextNodeId(1), raysPerSource(64), maxBounces(2), maxDistance(2000.0f) {}
+    : cachedSpatialIndex(nullptr), cachedGeneration(0), nextNodeId(1),
+      raysPerSource(64), maxBounces(2), maxDistance(2000.0f),
+      maxRefinementDepth(2) {}
 
 RadioSystem::~RadioSystem() {}
 
@@ -32,6 +94,8 @@ void RadioSystem::removeSourceByIndex(int index) {
 void RadioSystem::clearAllSources() {
   sources.clear();
   signalRays.clear();
+  propagationCache.clear();
+  std::fill(coverage.values.begin(), coverage.values.end(), 0.0f);
 }
 
 RadioSource *RadioSystem::getSourceById(int id) {
@@ -52,7 +116,65 @@ RadioSource *RadioSystem::getSourceByIndex(int index) {
 
 void RadioSystem::update(float deltaTime) {}
 
-float RadioSystem::calculatePathLoss(float distance, float frequency) {
+void RadioSystem::invalidateSource(int id) {
+  auto it = propagationCache.find(id);
+  if (it != propagationCache.end()) {
+    it->second.dirty = true;
+  }
+}
+
+void RadioSystem::invalidateAll() {
+  for (auto &entry : propagationCache) {
+    entry.second.dirty = true;
+  }
+}
+
+void RadioSystem::setRaysPerSource(int count) {
+  if (count != raysPerSource) {
+    raysPerSource = count;
+    invalidateAll();
+  }
+}
+
+void RadioSystem::setMaxBounces(int count) {
+  if (count != maxBounces) {
+    maxBounces = count;
+    invalidateAll();
+  }
+}
+
+void RadioSystem::setMaxDistance(float dist) {
+  if (dist != maxDistance) {
+    maxDistance = dist;
+    invalidateAll();
+  }
+}
+
+void RadioSystem::setMaxRefinementDepth(int depth) {
+  if (depth != maxRefinementDepth) {
+    maxRefinementDepth = depth;
+    invalidateAll();
+  }
+}
+
+void RadioSystem::setCoverageArea(const glm::vec3 &min, const glm::vec3 &max,
+                                  float cellSize) {
+  coverage.origin = min;
+  coverage.cellSize = cellSize;
+  coverage.width = std::max(1, static_cast<int>(std::ceil((max.x - min.x) /
+                                                          cellSize)));
+  coverage.height = std::max(1, static_cast<int>(std::ceil((max.z - min.z) /
+                                                           cellSize)));
+  coverage.values.assign(coverage.width * coverage.height, 0.0f);
+
+  // Cached contributions use the old raster layout
+  for (auto &entry : propagationCache) {
+    entry.second.coverage.clear();
+    entry.second.dirty = true;
+  }
+}
+
+float RadioSystem::calculatePathLoss(float distance, float frequency) const {
   if (distance < 1.0f)
     distance = 1.0f;
 
@@ -65,82 +187,285 @@ float RadioSystem::calculatePathLoss(float distance, float frequency) {
   return expf(-loss);
 }
 
-float RadioSystem::calculateReflectionLoss(const glm::vec3 &normal) {
+float RadioSystem::calculateReflectionLoss(const glm::vec3 &normal) const {
   return 0.3f;
 }
 
-void RadioSystem::computeSignalPropagation(const SpatialIndex *spatialIndex) {
-  signalRays.clear();
+void RadioSystem::computeSignalPropagation(const SceneGeometry *spatialIndex) {
+  TRACE_SCOPE("RadioSystem::computeSignalPropagation");
 
-  if (!spatialIndex)
+  if (!spatialIndex) {
+    signalRays.clear();
     return;
+  }
+
+  if (spatialIndex != cachedSpatialIndex ||
+      spatialIndex->getGeneration() != cachedGeneration) {
+    cachedSpatialIndex = spatialIndex;
+    cachedGeneration = spatialIndex->getGeneration();
+    invalidateAll();
+  }
+
+  if (!coverage.isValid()) {
+    const BoundingBox &bounds = spatialIndex->getBounds();
+    glm::vec3 extent = bounds.max - bounds.min;
+    float cellSize = std::max(1.0f, std::max(extent.x, extent.z) / 256.0f);
+    setCoverageArea(bounds.min, bounds.max, cellSize);
+  }
+
+  bool changed = false;
+
+  // Remove contributions of sources that were deleted or deactivated
+  for (auto it = propagationCache.begin(); it != propagationCache.end();) {
+    const RadioSource *source = getSourceById(it->first);
+    if (!source || !source->active) {
+      applyContribution(it->second.coverage, -1.0f);
+      it = propagationCache.erase(it);
+      changed = true;
+    } else {
+      ++it;
+    }
+  }
 
   for (const auto &source : sources) {
     if (!source.active)
       continue;
 
-    for (int i = 0; i < raysPerSource; i++) {
-      float theta = 2.0f * glm::pi<float>() * (i / (float)raysPerSource);
-      float phi = glm::pi<float>() * (0.5f + 0.4f * sin(theta * 3.0f));
-
-      glm::vec3 direction(sin(phi) * cos(theta), cos(phi),
-                          sin(phi) * sin(theta));
-
-      SignalRay ray;
-      ray.origin = source.position;
-      ray.direction = glm::normalize(direction);
-      ray.strength = 1.0f;
-      ray.bounces = 0;
-      ray.color = source.color;
-      ray.points.push_back(source.position);
-
-      glm::vec3 currentPos = source.position;
-      glm::vec3 currentDir = ray.direction;
-      float currentStrength = 1.0f;
-
-      for (int bounce = 0; bounce <= maxBounces; bounce++) {
-        Ray testRay;
-        testRay.origin = currentPos;
-        testRay.direction = currentDir;
-        testRay.tMin = 0.1f;
-        testRay.tMax = maxDistance;
-
-        RayHit hit = spatialIndex->intersect(testRay);
-
-        if (hit.hit && hit.distance < maxDistance) {
-          glm::vec3 hitPoint = hit.point;
-          ray.points.push_back(hitPoint);
-
-          float distanceLoss =
-              calculatePathLoss(hit.distance, source.frequency);
-          currentStrength *= distanceLoss;
-
-          if (bounce < maxBounces && currentStrength > 0.01f) {
-            float reflectionLoss = calculateReflectionLoss(hit.normal);
-            currentStrength *= reflectionLoss;
-
-            glm::vec3 reflected = glm::reflect(currentDir, hit.normal);
-            currentDir = reflected;
-            currentPos = hitPoint + hit.normal * 0.1f;
-          } else {
-            break;
-          }
-        } else {
-          glm::vec3 endPoint = currentPos + currentDir * maxDistance;
-          ray.points.push_back(endPoint);
-
-          float distanceLoss = calculatePathLoss(maxDistance, source.frequency);
-          currentStrength *= distanceLoss;
-          break;
-        }
+    SourcePropagation &entry = propagationCache[source.id];
+    bool stale = entry.dirty || entry.position != source.position ||
+                 entry.frequency != source.frequency ||
+                 entry.type != source.type;
+    if (!stale)
+      continue;
+
+    applyContribution(entry.coverage, -1.0f);
+    traceSource(source, spatialIndex, entry);
+    applyContribution(entry.coverage, 1.0f);
+    changed = true;
+  }
+
+  if (changed) {
+    signalRays.clear();
+    for (const auto &source : sources) {
+      auto it = propagationCache.find(source.id);
+      if (it != propagationCache.end()) {
+        signalRays.insert(signalRays.end(), it->second.rays.begin(),
+                          it->second.rays.end());
       }
+    }
+  }
+}
+
+RadioSystem::LaunchSample
+RadioSystem::traceRay(const RadioSource &source, const glm::vec3 &direction,
+                      const SceneGeometry *spatialIndex) const {
+  LaunchSample sample;
+  SignalRay &ray = sample.ray;
+  ray.origin = source.position;
+  ray.direction = direction;
+  ray.strength = 1.0f;
+  ray.bounces = 0;
+  ray.color = source.color;
+  ray.points.push_back(source.position);
+
+  glm::vec3 currentPos = source.position;
+  glm::vec3 currentDir = ray.direction;
+  float currentStrength = 1.0f;
+
+  for (int bounce = 0; bounce <= maxBounces; bounce++) {
+    Ray testRay;
+    testRay.origin = currentPos;
+    testRay.direction = currentDir;
+    testRay.tMin = 0.1f;
+    testRay.tMax = maxDistance;
 
-      ray.strength = currentStrength;
-      ray.bounces = ray.points.size() - 1;
+    RayHit hit = spatialIndex->intersect(testRay);
 
-      if (ray.points.size() > 1) {
-        signalRays.push_back(ray);
+    if (hit.hit && hit.distance < maxDistance) {
+      glm::vec3 hitPoint = hit.point;
+      ray.points.push_back(hitPoint);
+
+      if (bounce == 0) {
+        sample.hit = true;
+        sample.range = hit.distance;
+        sample.point = hitPoint;
+        sample.normal = hit.normal;
+      }
+
+      float distanceLoss = calculatePathLoss(hit.distance, source.frequency);
+      currentStrength *= distanceLoss;
+
+      if (bounce < maxBounces && currentStrength > 0.01f) {
+        float reflectionLoss = calculateReflectionLoss(hit.normal);
+        currentStrength *= reflectionLoss;
+
+        glm::vec3 reflected = glm::reflect(currentDir, hit.normal);
+        currentDir = reflected;
+        currentPos = hitPoint + hit.normal * 0.1f;
+      } else {
+        break;
       }
+    } else {
+      glm::vec3 endPoint = currentPos + currentDir * maxDistance;
+      ray.points.push_back(endPoint);
+
+      float distanceLoss = calculatePathLoss(maxDistance, source.frequency);
+      currentStrength *= distanceLoss;
+      break;
     }
   }
+
+  ray.strength = currentStrength;
+  ray.bounces = ray.points.size() - 1;
+  return sample;
+}
+
+bool RadioSystem::tubeDiverges(const LaunchSample &a, const LaunchSample &b) {
+  if (a.hit != b.hit)
+    return true;
+  if (!a.hit)
+    return false;
+
+  // Differently oriented facets, or parallel ones at different depths (e.g.
+  // a facade in front of another); a single plane seen obliquely is coherent
+  if (glm::dot(a.normal, b.normal) < 0.95f)
+    return true;
+  float nearRange = std::max(std::min(a.range, b.range), 1.0f);
+  return std::abs(glm::dot(a.normal, b.point - a.point)) > 0.05f * nearRange;
+}
+
+void RadioSystem::traceSource(const RadioSource &source,
+                              const SceneGeometry *spatialIndex,
+                              SourcePropagation &result) {
+  result.position = source.position;
+  result.frequency = source.frequency;
+  result.type = source.type;
+  result.dirty = false;
+
+  // Base launch: the densest icosphere that fits in raysPerSource
+  // (12, 42, 162, 642, ... directions), all with equal solid angle
+  int baseLevel = 0;
+  while (10 * (1 << (2 * (baseLevel + 1))) + 2 <= raysPerSource)
+    baseLevel++;
+
+  std::vector<glm::vec3> dirs;
+  std::vector<TubeFace> faces;
+  buildIcosphere(baseLevel, dirs, faces);
+  const size_t baseRayCount = dirs.size();
+
+  std::vector<LaunchSample> samples(dirs.size());
+  auto traceRange = [&](size_t begin) {
+    samples.resize(dirs.size());
+#pragma omp parallel for schedule(dynamic, 8)
+    for (long i = static_cast<long>(begin); i < static_cast<long>(dirs.size());
+         i++) {
+      samples[i] = traceRay(source, dirs[i], spatialIndex);
+    }
+  };
+  traceRange(0);
+
+  // Adaptive refinement: split tubes whose corner rays land on different
+  // surfaces, leave coherent tubes at the base density
+  const size_t rayBudget = std::max<size_t>(baseRayCount, 4 * raysPerSource);
+  std::vector<TubeFace> leaves;
+  std::unordered_map<uint64_t, int> midpoints;
+  for (int depth = 0; depth < maxRefinementDepth && !faces.empty(); depth++) {
+    size_t firstNew = dirs.size();
+    std::vector<TubeFace> split;
+
+    auto midpoint = [&](int a, int b) {
+      uint64_t key = (uint64_t(std::min(a, b)) << 32) | uint32_t(std::max(a, b));
+      auto it = midpoints.find(key);
+      if (it != midpoints.end())
+        return it->second;
+      dirs.push_back(glm::normalize(dirs[a] + dirs[b]));
+      int idx = static_cast<int>(dirs.size()) - 1;
+      midpoints.emplace(key, idx);
+      return idx;
+    };
+
+    for (const auto &f : faces) {
+      bool withinBudget = dirs.size() + 3 <= rayBudget;
+      if (!withinBudget ||
+          (!tubeDiverges(samples[f[0]], samples[f[1]]) &&
+           !tubeDiverges(samples[f[1]], samples[f[2]]) &&
+           !tubeDiverges(samples[f[2]], samples[f[0]]))) {
+        leaves.push_back(f);
+        continue;
+      }
+      int ab = midpoint(f[0], f[1]);
+      int bc = midpoint(f[1], f[2]);
+      int ca = midpoint(f[2], f[0]);
+      split.push_back({f[0], ab, ca});
+      split.push_back({f[1], bc, ab});
+      split.push_back({f[2], ca, bc});
+      split.push_back({ab, bc, ca});
+    }
+
+    traceRange(firstNew);
+    faces.swap(split);
+  }
+  leaves.insert(leaves.end(), faces.begin(), faces.end());
+
+  // Each ray carries a third of the solid angle of every tube it spans
+  std::vector<float> solidAngle(dirs.size(), 0.0f);
+  for (const auto &f : leaves) {
+    float omega = tubeSolidAngle(dirs[f[0]], dirs[f[1]], dirs[f[2]]) / 3.0f;
+    for (int k = 0; k < 3; k++)
+      solidAngle[f[k]] += omega;
+  }
+  const float baseSolidAngle =
+      4.0f * glm::pi<float>() / static_cast<float>(baseRayCount);
+
+  result.rays.clear();
+  result.coverage.assign(coverage.values.size(), 0.0f);
+  for (size_t i = 0; i < samples.size(); i++) {
+    SignalRay &ray = samples[i].ray;
+    ray.weight = solidAngle[i] / baseSolidAngle;
+    if (ray.points.size() > 1 && ray.weight > 0.0f) {
+      depositCoverage(ray, source.frequency, result.coverage);
+      result.rays.push_back(std::move(ray));
+    }
+  }
+}
+
+void RadioSystem::depositCoverage(const SignalRay &ray, float frequency,
+                                  std::vector<float> &target) const {
+  if (!coverage.isValid())
+    return;
+
+  // Walk each segment at cell resolution, attenuating from the segment start
+  float segmentStrength = 1.0f;
+  for (size_t s = 0; s + 1 < ray.points.size(); s++) {
+    glm::vec3 a = ray.points[s];
+    glm::vec3 b = ray.points[s + 1];
+    float length = glm::distance(a, b);
+    int samples = std::max(1, static_cast<int>(length / coverage.cellSize));
+
+    int lastCell = -1;
+    for (int k = 0; k <= samples; k++) {
+      float d = length * (k / (float)samples);
+      int cell = coverage.cellIndex(a + (b - a) * (k / (float)samples));
+      if (cell < 0 || cell == lastCell)
+        continue;
+      target[cell] +=
+          ray.weight * segmentStrength * calculatePathLoss(d, frequency);
+      lastCell = cell;
+    }
+
+    segmentStrength *= calculatePathLoss(length, frequency);
+    if (s + 2 < ray.points.size())
+      segmentStrength *= calculateReflectionLoss(glm::vec3(0.0f));
+  }
+}
+
+void RadioSystem::applyContribution(const std::vector<float> &contribution,
+                                    float sign) {
+  if (contribution.size() != coverage.values.size())
+    return;
+
+  for (size_t i = 0; i < contribution.size(); i++) {
+    coverage.values[i] = std::max(0.0f, coverage.values[i] +
+                                            sign * contribution[i]);
+  }
 }
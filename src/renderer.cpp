@@ -1,13 +1,98 @@
 #include "renderer.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <vector>
 
+namespace {
+
+// The cull shader reads both as arrays of plain 32-bit scalars
+static_assert(sizeof(MeshCluster) == 8 * sizeof(float),
+              "MeshCluster layout must match cull_clusters.comp");
+static_assert(sizeof(LodLevel) == 3 * sizeof(float),
+              "LodLevel layout must match cull_clusters.comp");
+
+// glMultiDrawElementsIndirect command
+struct DrawElementsCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// Planes of the frustum of a clip-space transform, in the space it
+// transforms from, with normals pointing inwards
+void extractFrustumPlanes(const glm::mat4 &m, glm::vec4 planes[6]) {
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; i++)
+    rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+  for (int i = 0; i < 3; i++) {
+    planes[2 * i] = rows[3] + rows[i];
+    planes[2 * i + 1] = rows[3] - rows[i];
+  }
+}
+
+bool outsideFrustum(const glm::vec4 planes[6], const glm::vec3 &boundsMin,
+                    const glm::vec3 &boundsMax) {
+  for (int i = 0; i < 6; i++) {
+    const glm::vec4 &plane = planes[i];
+    // Corner furthest along the plane normal
+    glm::vec3 corner(plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+                     plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+                     plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+      return true;
+  }
+  return false;
+}
+
+// Depth blits need matching depth and stencil formats, so the window's depth
+// buffer must be the same DEPTH24_STENCIL8 as the Hi-Z depth texture
+bool windowDepthMatchesTexture() {
+  GLint depthBits = 0, stencilBits = 0, depthType = GL_NONE;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH,
+                                        GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE,
+                                        &depthBits);
+  glGetFramebufferAttachmentParameteriv(
+      GL_FRAMEBUFFER, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE,
+      &depthType);
+  glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_STENCIL,
+                                        GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE,
+                                        &stencilBits);
+  return depthBits == 24 && stencilBits == 8 &&
+         depthType == GL_UNSIGNED_NORMALIZED;
+}
+
+// Copies [offset, offset + bytes) of `first` followed by `second` into the
+// buffer bound to `target`
+void uploadSlice(GLenum target, size_t offset, size_t bytes,
+                 const char *first, size_t firstBytes, const char *second) {
+  if (offset < firstBytes) {
+    size_t count = std::min(bytes, firstBytes - offset);
+    glBufferSubData(target, offset, count, first + offset);
+    offset += count;
+    bytes -= count;
+  }
+  if (bytes > 0)
+    glBufferSubData(target, offset, bytes, second + (offset - firstBytes));
+}
+
+} // namespace
+
 Renderer::Renderer()
-    : shaderProgram(0), VAO(0), VBO(0), EBO(0), indexCount(0) {}
+    : shaderProgram(0), drawnTriangles(0), fullTriangles(0),
+      visibleClusters(0), totalClusters(0), cullProgram(0), hiZProgram(0),
+      occlusionSupported(false), depthCopySupported(true),
+      depthResolved(false), depthTexture(0), depthFBO(0), hiZTexture(0),
+      hiZWidth(0), hiZHeight(0), hiZLevels(0), hiZValid(false),
+      hiZMVP(1.0f), statsBuffer(0), statsFence(0), gpuVisibleClusters(0),
+      gpuDrawnTriangles(0) {}
 
 Renderer::~Renderer() { cleanup(); }
 
@@ -48,10 +133,54 @@ bool Renderer::initialize(int width, int height) {
     std::cerr << "Failed to create shader program" << std::endl;
     return false;
   }
-
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glGenBuffers(1, &EBO);
+  sceneUniforms.model = glGetUniformLocation(shaderProgram, "model");
+  sceneUniforms.view = glGetUniformLocation(shaderProgram, "view");
+  sceneUniforms.projection = glGetUniformLocation(shaderProgram, "projection");
+  sceneUniforms.lightPos = glGetUniformLocation(shaderProgram, "lightPos");
+  sceneUniforms.lightColor = glGetUniformLocation(shaderProgram, "lightColor");
+  sceneUniforms.viewPos = glGetUniformLocation(shaderProgram, "viewPos");
+  sceneUniforms.enableFog = glGetUniformLocation(shaderProgram, "enableFog");
+  sceneUniforms.fogDensity = glGetUniformLocation(shaderProgram, "fogDensity");
+  sceneUniforms.fogColor = glGetUniformLocation(shaderProgram, "fogColor");
+
+  cullProgram = createComputeProgram("shaders/cull_clusters.comp");
+  hiZProgram = createComputeProgram("shaders/hiz_downsample.comp");
+  occlusionSupported = hiZProgram != 0;
+  if (hiZProgram) {
+    hiZSourceLevelLoc = glGetUniformLocation(hiZProgram, "sourceLevel");
+    glUseProgram(hiZProgram);
+    glUniform1i(glGetUniformLocation(hiZProgram, "source"), 0);
+  }
+  if (cullProgram) {
+    cullUniforms.frustumPlanes =
+        glGetUniformLocation(cullProgram, "frustumPlanes");
+    cullUniforms.cameraPos = glGetUniformLocation(cullProgram, "cameraPos");
+    cullUniforms.enableLod = glGetUniformLocation(cullProgram, "enableLod");
+    cullUniforms.lodScale = glGetUniformLocation(cullProgram, "lodScale");
+    cullUniforms.useOcclusion =
+        glGetUniformLocation(cullProgram, "useOcclusion");
+    cullUniforms.hiZLevels = glGetUniformLocation(cullProgram, "hiZLevels");
+    cullUniforms.viewportSize =
+        glGetUniformLocation(cullProgram, "viewportSize");
+    cullUniforms.previousMVP =
+        glGetUniformLocation(cullProgram, "previousMVP");
+    cullUniforms.recordStats = glGetUniformLocation(cullProgram, "recordStats");
+    cullUniforms.clusterCount =
+        glGetUniformLocation(cullProgram, "clusterCount");
+    glUseProgram(cullProgram);
+    glUniform1i(glGetUniformLocation(cullProgram, "hiZ"), 0);
+
+    glGenBuffers(1, &statsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), nullptr,
+                 GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+  glUseProgram(0);
+  if (!cullProgram) {
+    std::cerr << "Cluster culling shaders unavailable, culling on the CPU"
+              << std::endl;
+  }
 
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_MULTISAMPLE); // Enable MSAA
@@ -65,57 +194,413 @@ void Renderer::render(const glm::mat4 &view, const glm::mat4 &projection,
                       const glm::mat4 &model) {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  if (indexCount == 0)
+  drawnTriangles = 0;
+  fullTriangles = 0;
+  visibleClusters = 0;
+  totalClusters = 0;
+  depthResolved = false;
+  readCullStats();
+  if (meshes.empty())
     return;
 
   glUseProgram(shaderProgram);
 
-  GLint modelLoc = glGetUniformLocation(shaderProgram, "model");
-  GLint viewLoc = glGetUniformLocation(shaderProgram, "view");
-  GLint projLoc = glGetUniformLocation(shaderProgram, "projection");
-  GLint lightPosLoc = glGetUniformLocation(shaderProgram, "lightPos");
-  GLint lightColorLoc = glGetUniformLocation(shaderProgram, "lightColor");
-  GLint viewPosLoc = glGetUniformLocation(shaderProgram, "viewPos");
-
-  glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
-  glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
-  glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection[0][0]);
+  glUniformMatrix4fv(sceneUniforms.model, 1, GL_FALSE, &model[0][0]);
+  glUniformMatrix4fv(sceneUniforms.view, 1, GL_FALSE, &view[0][0]);
+  glUniformMatrix4fv(sceneUniforms.projection, 1, GL_FALSE,
+                     &projection[0][0]);
 
-  glUniform3f(lightPosLoc, 1000.0f, 2000.0f, 1000.0f);
-  glUniform3f(lightColorLoc, 1.0f, 1.0f, 0.9f);
+  glUniform3f(sceneUniforms.lightPos, 1000.0f, 2000.0f, 1000.0f);
+  glUniform3f(sceneUniforms.lightColor, 1.0f, 1.0f, 0.9f);
 
   glm::mat4 invView = glm::inverse(view);
   glm::vec3 cameraPos = glm::vec3(invView[3]);
-  glUniform3f(viewPosLoc, cameraPos.x, cameraPos.y, cameraPos.z);
+  glUniform3f(sceneUniforms.viewPos, cameraPos.x, cameraPos.y, cameraPos.z);
 
   // Visual settings uniforms
-  GLint enableFogLoc = glGetUniformLocation(shaderProgram, "enableFog");
-  GLint fogDensityLoc = glGetUniformLocation(shaderProgram, "fogDensity");
-  GLint fogColorLoc = glGetUniformLocation(shaderProgram, "fogColor");
-
-  glUniform1i(enableFogLoc, visualSettings.enableFog ? 1 : 0);
-  glUniform1f(fogDensityLoc, visualSettings.fogDensity);
-  glUniform3f(fogColorLoc, visualSettings.fogColor.x, visualSettings.fogColor.y, visualSettings.fogColor.z);
+  glUniform1i(sceneUniforms.enableFog, visualSettings.enableFog ? 1 : 0);
+  glUniform1f(sceneUniforms.fogDensity, visualSettings.fogDensity);
+  glUniform3f(sceneUniforms.fogColor, visualSettings.fogColor.x,
+              visualSettings.fogColor.y, visualSettings.fogColor.z);
+
+  // Pixels covered by one world unit at unit distance
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  const float pixelsPerUnit = projection[1][1] * viewport[3] * 0.5f;
+
+  // Clusters are culled in model space
+  const glm::mat4 mvp = projection * view * model;
+  const glm::vec3 modelCameraPos =
+      glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.0f));
+  glm::vec4 planes[6];
+  extractFrustumPlanes(mvp, planes);
+
+  const bool gpuCulling = visualSettings.enableCulling && cullProgram != 0;
+  if (gpuCulling) {
+    cullClusters(planes, modelCameraPos,
+                 pixelsPerUnit / visualSettings.lodPixelError, viewport[2],
+                 viewport[3]);
+    glUseProgram(shaderProgram);
+  }
 
-  glBindVertexArray(VAO);
-  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indexCount),
-                 GL_UNSIGNED_INT, 0);
+  for (const auto &entry : meshes) {
+    const Mesh &mesh = entry.second;
+    glBindVertexArray(mesh.VAO);
+    fullTriangles += mesh.indexCount / 3;
+    totalClusters += mesh.clusters.size();
+
+    if (mesh.clusters.empty() ||
+        (!visualSettings.enableLod && !visualSettings.enableCulling)) {
+      glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indexCount),
+                     GL_UNSIGNED_INT, 0);
+      drawnTriangles += mesh.indexCount / 3;
+      visibleClusters += mesh.clusters.size();
+      continue;
+    }
+
+    if (gpuCulling) {
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mesh.commandBuffer);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                  static_cast<GLsizei>(mesh.clusters.size()),
+                                  0);
+      continue;
+    }
+
+    // Per cluster in view, the coarsest level whose error projects small
+    // enough from the nearest point of its bounds
+    drawCounts.clear();
+    drawOffsets.clear();
+    for (const auto &cluster : mesh.clusters) {
+      if (visualSettings.enableCulling &&
+          outsideFrustum(planes, cluster.boundsMin, cluster.boundsMax))
+        continue;
+
+      glm::vec3 nearest =
+          glm::clamp(modelCameraPos, cluster.boundsMin, cluster.boundsMax);
+      float distance = std::max(glm::length(nearest - modelCameraPos), 1.0f);
+      unsigned int level = 0;
+      for (unsigned int l = cluster.levelCount - 1;
+           visualSettings.enableLod && l > 0; l--) {
+        float error = mesh.levels[cluster.firstLevel + l].error;
+        if (error * pixelsPerUnit / distance <= visualSettings.lodPixelError) {
+          level = l;
+          break;
+        }
+      }
+
+      const LodLevel &chosen = mesh.levels[cluster.firstLevel + level];
+      if (chosen.indexCount == 0)
+        continue;
+      drawCounts.push_back(static_cast<GLsizei>(chosen.indexCount));
+      drawOffsets.push_back(reinterpret_cast<const void *>(
+          size_t(chosen.firstIndex) * sizeof(unsigned int)));
+      drawnTriangles += chosen.indexCount / 3;
+      visibleClusters++;
+    }
+    glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT,
+                        drawOffsets.data(),
+                        static_cast<GLsizei>(drawCounts.size()));
+  }
   glBindVertexArray(0);
+
+  if (gpuCulling) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    drawnTriangles += gpuDrawnTriangles;
+    visibleClusters += gpuVisibleClusters;
+    // The depth just drawn becomes next frame's occluders
+    if (occlusionSupported)
+      updateHiZ(mvp);
+  } else {
+    hiZValid = false;
+  }
+}
+
+void Renderer::cullClusters(const glm::vec4 planes[6],
+                            const glm::vec3 &cameraPos, float lodScale,
+                            int width, int height) {
+  glUseProgram(cullProgram);
+  glUniform4fv(cullUniforms.frustumPlanes, 6, &planes[0][0]);
+  glUniform3f(cullUniforms.cameraPos, cameraPos.x, cameraPos.y, cameraPos.z);
+  glUniform1i(cullUniforms.enableLod, visualSettings.enableLod ? 1 : 0);
+  glUniform1f(cullUniforms.lodScale, lodScale);
+
+  // A pyramid from before a resize no longer lines up with the screen
+  const bool useOcclusion =
+      hiZValid && hiZWidth == width && hiZHeight == height;
+  glUniform1i(cullUniforms.useOcclusion, useOcclusion ? 1 : 0);
+  if (useOcclusion) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture);
+    glUniform1i(cullUniforms.hiZLevels, hiZLevels);
+    glUniform2i(cullUniforms.viewportSize, hiZWidth, hiZHeight);
+    glUniformMatrix4fv(cullUniforms.previousMVP, 1, GL_FALSE, &hiZMVP[0][0]);
+  }
+
+  // Counting starts over only once the last counts have been read
+  const bool recordStats = statsFence == 0;
+  if (recordStats) {
+    const GLuint zero[2] = {0, 0};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+  glUniform1i(cullUniforms.recordStats, recordStats ? 1 : 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, statsBuffer);
+
+  for (const auto &entry : meshes) {
+    const Mesh &mesh = entry.second;
+    if (!mesh.commandBuffer)
+      continue;
+    const GLuint clusterCount = static_cast<GLuint>(mesh.clusters.size());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mesh.clusterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mesh.levelBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mesh.commandBuffer);
+    glUniform1ui(cullUniforms.clusterCount, clusterCount);
+    glDispatchCompute((clusterCount + 63) / 64, 1, 1);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+  if (recordStats)
+    statsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void Renderer::readCullStats() {
+  if (!statsFence ||
+      glClientWaitSync(statsFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    return;
+  glDeleteSync(statsFence);
+  statsFence = 0;
+
+  GLuint stats[2];
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  gpuVisibleClusters = stats[0];
+  gpuDrawnTriangles = stats[1];
+}
+
+GLuint Renderer::resolveSceneDepth() {
+  if (!depthCopySupported)
+    return 0;
+  if (depthResolved)
+    return depthTexture;
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  const int width = viewport[2], height = viewport[3];
+  if (width < 2 || height < 2)
+    return 0;
+
+  if (!hiZWidth && !windowDepthMatchesTexture()) {
+    std::cerr << "Cannot copy the depth buffer, occlusion culling and "
+                 "volume depth disabled"
+              << std::endl;
+    depthCopySupported = false;
+    return 0;
+  }
+  if (width != hiZWidth || height != hiZHeight)
+    createHiZ(width, height);
+
+  // Resolves the multisampled depth buffer into a plain texture
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  depthResolved = true;
+  return depthTexture;
+}
+
+void Renderer::updateHiZ(const glm::mat4 &mvp) {
+  if (!resolveSceneDepth()) {
+    hiZValid = false;
+    return;
+  }
+
+  const int width = hiZWidth, height = hiZHeight;
+  glUseProgram(hiZProgram);
+  glActiveTexture(GL_TEXTURE0);
+  for (int level = 0; level < hiZLevels; level++) {
+    glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : hiZTexture);
+    glUniform1i(hiZSourceLevelLoc, level == 0 ? 0 : level - 1);
+    glBindImageTexture(0, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY,
+                       GL_R32F);
+    int levelWidth = std::max(1, width >> (level + 1));
+    int levelHeight = std::max(1, height >> (level + 1));
+    glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glUseProgram(0);
+
+  hiZMVP = mvp;
+  hiZValid = true;
+}
+
+void Renderer::createHiZ(int width, int height) {
+  deleteHiZ();
+  hiZWidth = width;
+  hiZHeight = height;
+  // Level 0 is half the viewport, down to a single texel
+  for (int size = std::max(width, height) >> 1; size >= 1; size >>= 1)
+    hiZLevels++;
+
+  glGenTextures(1, &depthTexture);
+  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0,
+               GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  glGenFramebuffers(1, &depthFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                         GL_TEXTURE_2D, depthTexture, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  glGenTextures(1, &hiZTexture);
+  glBindTexture(GL_TEXTURE_2D, hiZTexture);
+  glTexStorage2D(GL_TEXTURE_2D, hiZLevels, GL_R32F, std::max(1, width >> 1),
+                 std::max(1, height >> 1));
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Renderer::deleteHiZ() {
+  if (depthFBO)
+    glDeleteFramebuffers(1, &depthFBO);
+  if (depthTexture)
+    glDeleteTextures(1, &depthTexture);
+  if (hiZTexture)
+    glDeleteTextures(1, &hiZTexture);
+  depthFBO = depthTexture = hiZTexture = 0;
+  hiZWidth = hiZHeight = hiZLevels = 0;
+  hiZValid = false;
 }
 
 void Renderer::setModelData(const std::vector<float> &vertices,
                             const std::vector<unsigned int> &indices) {
-  indexCount = indices.size();
+  TRACE_SCOPE("Renderer::setModelData");
+  clearMeshes();
+  addMesh(0, vertices, indices);
+}
+
+void Renderer::addMesh(int key, const std::vector<float> &vertices,
+                       const std::vector<unsigned int> &indices) {
+  uploads.erase(key);
+  Mesh &mesh = createMesh(key, vertices.size() * sizeof(float), vertices.data(),
+                          indices.size() * sizeof(unsigned int),
+                          indices.data());
+  mesh.indexCount = indices.size();
+}
+
+void Renderer::queueMesh(int key, std::shared_ptr<const ModelData> data) {
+  // Allocate the full buffers (mesh then LOD data) now so processUploads
+  // only has to copy
+  Mesh &mesh = createMesh(
+      key, (data->vertices.size() + data->lod.vertices.size()) * sizeof(float),
+      nullptr,
+      (data->indices.size() + data->lod.indices.size()) * sizeof(unsigned int),
+      nullptr);
+  mesh.indexCount = 0;
+
+  PendingUpload upload;
+  upload.data = std::move(data);
+  uploads[key] = upload;
+}
+
+bool Renderer::processUploads(size_t byteBudget) {
+  if (uploads.empty())
+    return false;
+  TRACE_SCOPE("Renderer::processUploads");
+
+  // Whole triangles only, so the partial index range is always drawable
+  const size_t triangleBytes = 3 * sizeof(unsigned int);
+  byteBudget = std::max(byteBudget, triangleBytes);
+
+  for (auto it = uploads.begin(); it != uploads.end() && byteBudget > 0;) {
+    PendingUpload &upload = it->second;
+    Mesh &mesh = meshes[it->first];
+    const ModelData &data = *upload.data;
+    const size_t meshVertexBytes = data.vertices.size() * sizeof(float);
+    const size_t meshIndexBytes = data.indices.size() * sizeof(unsigned int);
+    const size_t vertexBytes =
+        meshVertexBytes + data.lod.vertices.size() * sizeof(float);
+    const size_t indexBytes =
+        meshIndexBytes + data.lod.indices.size() * sizeof(unsigned int);
+
+    // Vertices first: any uploaded index may refer to any of them
+    if (upload.vertexBytesDone < vertexBytes) {
+      size_t bytes = std::min(byteBudget, vertexBytes - upload.vertexBytesDone);
+      glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+      uploadSlice(GL_ARRAY_BUFFER, upload.vertexBytesDone, bytes,
+                  reinterpret_cast<const char *>(data.vertices.data()),
+                  meshVertexBytes,
+                  reinterpret_cast<const char *>(data.lod.vertices.data()));
+      upload.vertexBytesDone += bytes;
+      byteBudget -= bytes;
+    }
+
+    if (upload.vertexBytesDone == vertexBytes &&
+        upload.indexBytesDone < indexBytes && byteBudget >= triangleBytes) {
+      size_t bytes = std::min(byteBudget - byteBudget % triangleBytes,
+                              indexBytes - upload.indexBytesDone);
+      // The element buffer binding is VAO state
+      glBindVertexArray(mesh.VAO);
+      uploadSlice(GL_ELEMENT_ARRAY_BUFFER, upload.indexBytesDone, bytes,
+                  reinterpret_cast<const char *>(data.indices.data()),
+                  meshIndexBytes,
+                  reinterpret_cast<const char *>(data.lod.indices.data()));
+      glBindVertexArray(0);
+      upload.indexBytesDone += bytes;
+      byteBudget -= bytes;
+      // Only the full-detail triangles are drawn until everything is there
+      mesh.indexCount = std::min(upload.indexBytesDone, meshIndexBytes) /
+                        sizeof(unsigned int);
+    }
+
+    if (upload.vertexBytesDone == vertexBytes &&
+        upload.indexBytesDone == indexBytes) {
+      mesh.clusters = data.lod.clusters;
+      mesh.levels = data.lod.levels;
+      createClusterBuffers(mesh);
+      it = uploads.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  return !uploads.empty();
+}
+
+Renderer::Mesh &Renderer::createMesh(int key, size_t vertexBytes,
+                                     const void *vertices, size_t indexBytes,
+                                     const void *indices) {
+  Mesh &mesh = meshes[key];
+  if (!mesh.VAO) {
+    glGenVertexArrays(1, &mesh.VAO);
+    glGenBuffers(1, &mesh.VBO);
+    glGenBuffers(1, &mesh.EBO);
+  }
+  // Clusters of a replaced mesh no longer match its buffers
+  deleteClusterBuffers(mesh);
+  mesh.clusters.clear();
+  mesh.levels.clear();
 
-  glBindVertexArray(VAO);
+  glBindVertexArray(mesh.VAO);
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
-               vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-               indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
 
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
   glEnableVertexAttribArray(0);
@@ -124,17 +609,88 @@ void Renderer::setModelData(const std::vector<float> &vertices,
   glEnableVertexAttribArray(1);
 
   glBindVertexArray(0);
+  return mesh;
+}
+
+void Renderer::createClusterBuffers(Mesh &mesh) {
+  if (!cullProgram || mesh.clusters.empty())
+    return;
+
+  glGenBuffers(1, &mesh.clusterBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh.clusterBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,
+               mesh.clusters.size() * sizeof(MeshCluster),
+               mesh.clusters.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(1, &mesh.levelBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh.levelBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, mesh.levels.size() * sizeof(LodLevel),
+               mesh.levels.data(), GL_STATIC_DRAW);
+
+  glGenBuffers(1, &mesh.commandBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh.commandBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,
+               mesh.clusters.size() * sizeof(DrawElementsCommand), nullptr,
+               GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void Renderer::deleteClusterBuffers(Mesh &mesh) {
+  if (mesh.clusterBuffer)
+    glDeleteBuffers(1, &mesh.clusterBuffer);
+  if (mesh.levelBuffer)
+    glDeleteBuffers(1, &mesh.levelBuffer);
+  if (mesh.commandBuffer)
+    glDeleteBuffers(1, &mesh.commandBuffer);
+  mesh.clusterBuffer = mesh.levelBuffer = mesh.commandBuffer = 0;
+}
+
+void Renderer::removeMesh(int key) {
+  uploads.erase(key);
+  // Last frame's depth may hold the removed mesh
+  hiZValid = false;
+  auto it = meshes.find(key);
+  if (it == meshes.end())
+    return;
+  deleteMesh(it->second);
+  meshes.erase(it);
+}
+
+void Renderer::clearMeshes() {
+  uploads.clear();
+  hiZValid = false;
+  for (auto &entry : meshes)
+    deleteMesh(entry.second);
+  meshes.clear();
+}
+
+void Renderer::deleteMesh(Mesh &mesh) {
+  if (mesh.VAO)
+    glDeleteVertexArrays(1, &mesh.VAO);
+  if (mesh.VBO)
+    glDeleteBuffers(1, &mesh.VBO);
+  if (mesh.EBO)
+    glDeleteBuffers(1, &mesh.EBO);
+  deleteClusterBuffers(mesh);
+  mesh = Mesh();
 }
 
 void Renderer::cleanup() {
-  if (VAO)
-    glDeleteVertexArrays(1, &VAO);
-  if (VBO)
-    glDeleteBuffers(1, &VBO);
-  if (EBO)
-    glDeleteBuffers(1, &EBO);
+  clearMeshes();
+  deleteHiZ();
   if (shaderProgram)
     glDeleteProgram(shaderProgram);
+  if (cullProgram)
+    glDeleteProgram(cullProgram);
+  if (hiZProgram)
+    glDeleteProgram(hiZProgram);
+  shaderProgram = cullProgram = hiZProgram = 0;
+  if (statsFence)
+    glDeleteSync(statsFence);
+  statsFence = 0;
+  if (statsBuffer)
+    glDeleteBuffers(1, &statsBuffer);
+  statsBuffer = 0;
 }
 
 GLuint Renderer::compileShader(const std::string &source, GLenum type) {
@@ -156,6 +712,34 @@ GLuint Renderer::compileShader(const std::string &source, GLenum type) {
   return shader;
 }
 
+GLuint Renderer::createComputeProgram(const char *shaderPath) {
+  char *source = loadShaderSource(shaderPath);
+  if (!source)
+    return 0;
+
+  GLuint shader = compileShader(source, GL_COMPUTE_SHADER);
+  delete[] source;
+  if (shader == 0)
+    return 0;
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, shader);
+  glLinkProgram(program);
+
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    char infoLog[512];
+    glGetProgramInfoLog(program, 512, nullptr, infoLog);
+    std::cerr << "Program linking error: " << infoLog << std::endl;
+    glDeleteProgram(program);
+    program = 0;
+  }
+
+  glDeleteShader(shader);
+  return program;
+}
+
 GLuint Renderer::createShaderProgram(const std::string &vertexSource,
                                      const std::string &fragmentSource) {
   GLuint vertexShader = compileShader(vertexSource, GL_VERTEX_SHADER);
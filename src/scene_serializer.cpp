@@ -1,8 +1,9 @@
 #include "scene_serializer.h"
-#include "camera.h"
-#include "node_manager.h"
 #include "radio_system.h"
 
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -30,6 +31,30 @@ glm::vec3 SceneSerializer::parseVec3(const std::string &str) {
   return result;
 }
 
+bool SceneSerializer::parseFloat(const std::string &str, float &result) {
+  char *end = nullptr;
+  errno = 0;
+  float value = std::strtof(str.c_str(), &end);
+  if (str.empty() || *end != '\0' || errno == ERANGE || !std::isfinite(value))
+    return false;
+  result = value;
+  return true;
+}
+
+bool SceneSerializer::parseVec3(const std::string &str, glm::vec3 &result) {
+  std::istringstream iss(str);
+  std::string token;
+  glm::vec3 value;
+  for (int axis = 0; axis < 3; axis++) {
+    if (!std::getline(iss, token, ',') || !parseFloat(token, value[axis]))
+      return false;
+  }
+  if (std::getline(iss, token, ','))
+    return false;
+  result = value;
+  return true;
+}
+
 std::string SceneSerializer::trim(const std::string &str) {
   size_t first = str.find_first_not_of(" \t\r\n");
   if (first == std::string::npos)
@@ -39,7 +64,7 @@ std::string SceneSerializer::trim(const std::string &str) {
 }
 
 bool SceneSerializer::saveScene(const std::string &filepath,
-                                const NodeManager *nodeManager,
+                                const RadioSystem &radioSystem,
                                 const SceneData &sceneData) {
   std::ofstream file(filepath);
   if (!file.is_open()) {
@@ -77,7 +102,7 @@ bool SceneSerializer::saveScene(const std::string &filepath,
        << (sceneData.showGeometryEdges ? "true" : "false") << "\n\n";
 
   // Write nodes
-  const auto &sources = nodeManager->getRadioSystem()->getSources();
+  const auto &sources = radioSystem.getSources();
   file << "[Nodes]\n";
   file << "count=" << sources.size() << "\n\n";
 
@@ -101,7 +126,7 @@ bool SceneSerializer::saveScene(const std::string &filepath,
 }
 
 bool SceneSerializer::loadScene(const std::string &filepath,
-                                NodeManager *nodeManager,
+                                RadioSystem &radioSystem,
                                 SceneData &sceneData) {
   std::ifstream file(filepath);
   if (!file.is_open()) {
@@ -209,13 +234,13 @@ bool SceneSerializer::loadScene(const std::string &filepath,
   file.close();
 
   // Clear existing nodes
-  nodeManager->clearAllNodes();
+  radioSystem.clearAllSources();
 
   // Create nodes from loaded data
   for (const auto &nodeData : tempNodes) {
-    int newId = nodeManager->createNode(nodeData.position, nodeData.frequency,
-                                        nodeData.type);
-    RadioSource *node = nodeManager->getRadioSystem()->getSourceById(newId);
+    int newId = radioSystem.addSource(nodeData.position, nodeData.frequency,
+                                      nodeData.type);
+    RadioSource *node = radioSystem.getSourceById(newId);
     if (node) {
       node->name = nodeData.name;
       node->active = nodeData.active;
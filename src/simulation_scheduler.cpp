@@ -0,0 +1,111 @@
+#include "simulation_scheduler.h"
+
+#include <algorithm>
+
+SimulationScheduler::SimulationScheduler()
+    : targetRate(60.0f), frameBudgetMs(8.0f), owedSteps(0.0), batchSteps(0),
+      budgetLimited(false), currentSlot(0), timing(false), stepCostMs(0.0f),
+      windowSeconds(0.0), windowSteps(0.0), windowCells(0.0),
+      achievedRate(0.0f), megacellsPerSecond(0.0f) {}
+
+SimulationScheduler::~SimulationScheduler() {}
+
+void SimulationScheduler::cleanup() {
+  for (auto &slot : slots) {
+    if (slot.start)
+      glDeleteQueries(1, &slot.start);
+    if (slot.end)
+      glDeleteQueries(1, &slot.end);
+    slot = QuerySlot();
+  }
+  timing = false;
+}
+
+int SimulationScheduler::beginBatch(double elapsedSeconds) {
+  QuerySlot &slot = slots[currentSlot];
+  if (slot.pending)
+    collectSlot(slot);
+
+  windowSeconds += elapsedSeconds;
+
+  // A long frame (loading, a dragged window) owes at most a tenth of a
+  // second of steps
+  double maxOwed = std::max(1.0, targetRate * 0.1);
+  owedSteps = std::min(owedSteps + elapsedSeconds * targetRate, maxOwed);
+  int steps = static_cast<int>(owedSteps);
+
+  // At least one step a frame, even when a single step overruns the budget
+  budgetLimited = false;
+  if (stepCostMs > 0.0f) {
+    int affordable =
+        std::max(1, static_cast<int>(frameBudgetMs / stepCostMs));
+    if (steps > affordable) {
+      steps = affordable;
+      budgetLimited = true;
+    }
+  }
+  owedSteps -= steps;
+  if (budgetLimited)
+    owedSteps = std::min(owedSteps, 1.0);
+
+  batchSteps = steps;
+  timing = steps > 0;
+  if (timing) {
+    if (!slot.start) {
+      glGenQueries(1, &slot.start);
+      glGenQueries(1, &slot.end);
+    }
+    glQueryCounter(slot.start, GL_TIMESTAMP);
+  }
+  return steps;
+}
+
+void SimulationScheduler::endBatch(size_t cellsPerStep) {
+  if (timing) {
+    QuerySlot &slot = slots[currentSlot];
+    glQueryCounter(slot.end, GL_TIMESTAMP);
+    slot.steps = batchSteps;
+    slot.pending = true;
+    currentSlot = (currentSlot + 1) % QUERY_LATENCY;
+    timing = false;
+  }
+
+  windowSteps += batchSteps;
+  windowCells += double(batchSteps) * double(cellsPerStep);
+  if (windowSeconds >= 0.5) {
+    achievedRate = static_cast<float>(windowSteps / windowSeconds);
+    megacellsPerSecond =
+        static_cast<float>(windowCells / windowSeconds / 1.0e6);
+    windowSeconds = windowSteps = windowCells = 0.0;
+  }
+}
+
+void SimulationScheduler::reset() {
+  owedSteps = 0.0;
+  batchSteps = 0;
+  budgetLimited = false;
+  windowSeconds = windowSteps = windowCells = 0.0;
+  achievedRate = megacellsPerSecond = 0.0f;
+}
+
+void SimulationScheduler::collectSlot(QuerySlot &slot) {
+  slot.pending = false;
+
+  // Still in flight a whole ring later: leave this batch unmeasured rather
+  // than wait for it
+  GLint available = 0;
+  glGetQueryObjectiv(slot.end, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available || slot.steps == 0)
+    return;
+
+  GLuint64 startNs = 0, endNs = 0;
+  glGetQueryObjectui64v(slot.start, GL_QUERY_RESULT, &startNs);
+  glGetQueryObjectui64v(slot.end, GL_QUERY_RESULT, &endNs);
+  if (endNs <= startNs)
+    return;
+
+  // Smoothed, so one slow batch does not throttle the next frames
+  float costMs = static_cast<float>((endNs - startNs) / 1.0e6 / slot.steps);
+  stepCostMs =
+      stepCostMs > 0.0f ? stepCostMs * 0.8f + costMs * 0.2f : costMs;
+}
@@ -1,4 +1,5 @@
 #include "spatial_index.h"
+#include "trace.h"
 #include <algorithm>
 #include <fstream>
 #include <iostream>
@@ -6,7 +7,36 @@
 SpatialIndex::SpatialIndex() {}
 SpatialIndex::~SpatialIndex() {}
 
+void SpatialIndex::buildFromMesh(const std::vector<float> &vertices,
+                                 const std::vector<unsigned int> &indices) {
+  std::vector<Triangle> triangles;
+  triangles.reserve(indices.size() / 3);
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    Triangle tri;
+    unsigned int i0 = indices[i];
+    unsigned int i1 = indices[i + 1];
+    unsigned int i2 = indices[i + 2];
+
+    tri.v0 = glm::vec3(vertices[i0 * 6 + 0], vertices[i0 * 6 + 1],
+                       vertices[i0 * 6 + 2]);
+    tri.v1 = glm::vec3(vertices[i1 * 6 + 0], vertices[i1 * 6 + 1],
+                       vertices[i1 * 6 + 2]);
+    tri.v2 = glm::vec3(vertices[i2 * 6 + 0], vertices[i2 * 6 + 1],
+                       vertices[i2 * 6 + 2]);
+
+    glm::vec3 edge1 = tri.v1 - tri.v0;
+    glm::vec3 edge2 = tri.v2 - tri.v0;
+    tri.normal = glm::normalize(glm::cross(edge1, edge2));
+    tri.id = static_cast<unsigned int>(i / 3);
+
+    triangles.push_back(tri);
+  }
+
+  build(triangles);
+}
+
 void SpatialIndex::build(const std::vector<Triangle> &triangles) {
+  TRACE_SCOPE("SpatialIndex::build");
   std::cout << "Building BVH..." << std::endl;
   m_triangles = triangles;
 
@@ -142,6 +172,44 @@ bool SpatialIndex::intersectAnyBVH(const BVHNode *node, const Ray &ray) const {
          intersectAnyBVH(node->right.get(), ray);
 }
 
+void SpatialIndex::queryBox(const BoundingBox &box,
+                            std::vector<unsigned int> &triangleIndices) const {
+  if (!m_root)
+    return;
+  queryBoxBVH(m_root.get(), box, triangleIndices);
+}
+
+void SpatialIndex::queryTriangles(const BoundingBox &box,
+                                  std::vector<Triangle> &triangles) const {
+  std::vector<unsigned int> indices;
+  queryBox(box, indices);
+  triangles.reserve(triangles.size() + indices.size());
+  for (unsigned int idx : indices)
+    triangles.push_back(m_triangles[idx]);
+}
+
+void SpatialIndex::queryBoxBVH(const BVHNode *node, const BoundingBox &box,
+                               std::vector<unsigned int> &triangleIndices) const {
+  if (!node || !node->bounds.overlaps(box))
+    return;
+
+  if (node->isLeaf) {
+    for (unsigned int idx : node->triangleIndices) {
+      const Triangle &tri = m_triangles[idx];
+      BoundingBox triBounds;
+      triBounds.expand(tri.v0);
+      triBounds.expand(tri.v1);
+      triBounds.expand(tri.v2);
+      if (triBounds.overlaps(box))
+        triangleIndices.push_back(idx);
+    }
+    return;
+  }
+
+  queryBoxBVH(node->left.get(), box, triangleIndices);
+  queryBoxBVH(node->right.get(), box, triangleIndices);
+}
+
 bool SpatialIndex::intersectTriangle(const Ray &ray, const Triangle &tri,
                                      float &t, glm::vec3 &hitPoint) const {
   const float EPSILON = 0.0000001f;
@@ -190,6 +258,7 @@ void SpatialIndex::printStats() const {
 }
 
 bool SpatialIndex::saveBVH(const std::string &filename) const {
+  TRACE_SCOPE("SpatialIndex::saveBVH");
   std::ofstream out(filename, std::ios::binary);
   if (!out.is_open()) {
     std::cerr << "Failed to open file for writing: " << filename << std::endl;
@@ -223,6 +292,7 @@ bool SpatialIndex::saveBVH(const std::string &filename) const {
 }
 
 bool SpatialIndex::loadBVH(const std::string &filename) {
+  TRACE_SCOPE("SpatialIndex::loadBVH");
   std::ifstream in(filename, std::ios::binary);
   if (!in.is_open()) {
     std::cerr << "BVH file not found: " << filename << std::endl;
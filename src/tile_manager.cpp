@@ -0,0 +1,296 @@
+#include "tile_manager.h"
+#include "spatial_index.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+bool parseVec3(const std::string &token, glm::vec3 &result) {
+  std::istringstream iss(token);
+  std::string part;
+  float values[3];
+  for (float &value : values) {
+    if (!std::getline(iss, part, ','))
+      return false;
+    try {
+      value = std::stof(part);
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+  result = glm::vec3(values[0], values[1], values[2]);
+  return true;
+}
+
+// Rough resident cost of a tile: its triangles plus BVH leaf indices and
+// nodes, and the vertex/index buffers (with LOD levels) when the mesh is
+// kept for rendering
+size_t estimateBytes(const SpatialIndex &index, const ModelData *mesh) {
+  size_t bytes = index.getTriangles().size() *
+                 (sizeof(Triangle) + 2 * sizeof(unsigned int));
+  if (mesh) {
+    bytes += (mesh->vertices.size() + mesh->lod.vertices.size()) *
+                 sizeof(float) +
+             (mesh->indices.size() + mesh->lod.indices.size()) *
+                 sizeof(unsigned int);
+  }
+  return bytes;
+}
+
+} // namespace
+
+TileManager::TileManager()
+    : memoryBudget(size_t(1024) << 20), residentBytes(0), keepMeshes(false),
+      useCounter(0), generation(0) {}
+
+TileManager::~TileManager() {}
+
+bool TileManager::loadManifest(const std::string &path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for reading: " << path << std::endl;
+    return false;
+  }
+
+  std::filesystem::path baseDir = std::filesystem::path(path).parent_path();
+  std::vector<TileInfo> parsed;
+  BoundingBox bounds;
+
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    size_t comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream iss(line);
+    std::string keyword;
+    if (!(iss >> keyword))
+      continue;
+
+    if (keyword != "tile") {
+      std::cerr << path << ":" << lineNumber << ": unknown manifest entry '"
+                << keyword << "'" << std::endl;
+      return false;
+    }
+
+    std::string objPath, minToken, maxToken, extra;
+    TileInfo tile;
+    if (!(iss >> objPath >> minToken >> maxToken) || (iss >> extra) ||
+        !parseVec3(minToken, tile.bounds.min) ||
+        !parseVec3(maxToken, tile.bounds.max)) {
+      std::cerr << path << ":" << lineNumber << ": expected 'tile <file.obj> "
+                << "<min x,y,z> <max x,y,z>'" << std::endl;
+      return false;
+    }
+
+    tile.objPath = (baseDir / objPath).string();
+    bounds.expand(tile.bounds);
+    parsed.push_back(tile);
+  }
+
+  if (parsed.empty()) {
+    std::cerr << "Tile manifest lists no tiles: " << path << std::endl;
+    return false;
+  }
+
+  while (!resident.empty())
+    evictTile(resident.size() - 1);
+  loadedMeshes.clear();
+  evictedTiles.clear();
+
+  tiles = std::move(parsed);
+  datasetBounds = bounds;
+  residentBounds = BoundingBox();
+  generation++;
+
+  std::cout << "Loaded tile manifest with " << tiles.size() << " tiles"
+            << std::endl;
+  return true;
+}
+
+bool TileManager::update(const std::vector<BoundingBox> &regions) {
+  useCounter++;
+  bool changed = false;
+
+  std::vector<bool> wanted(tiles.size(), false);
+  for (size_t t = 0; t < tiles.size(); t++) {
+    for (const auto &region : regions) {
+      if (tiles[t].bounds.overlaps(region)) {
+        wanted[t] = true;
+        break;
+      }
+    }
+  }
+
+  for (size_t t = 0; t < tiles.size(); t++) {
+    if (!wanted[t])
+      continue;
+    int index = findResident(static_cast<int>(t));
+    if (index >= 0) {
+      resident[index].lastUsed = useCounter;
+    } else if (loadTile(static_cast<int>(t))) {
+      changed = true;
+    }
+  }
+
+  // Least recently used first; tiles still in a region are never evicted,
+  // even if that leaves the set over budget
+  if (residentBytes > memoryBudget) {
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < resident.size(); i++) {
+      if (!wanted[resident[i].tile])
+        candidates.push_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+      return resident[a].lastUsed < resident[b].lastUsed;
+    });
+
+    std::vector<size_t> evict;
+    size_t bytes = residentBytes;
+    for (size_t i : candidates) {
+      if (bytes <= memoryBudget)
+        break;
+      bytes -= resident[i].bytes;
+      evict.push_back(i);
+    }
+    // Erase from the back so the remaining indices stay valid
+    std::sort(evict.rbegin(), evict.rend());
+    for (size_t i : evict)
+      evictTile(i);
+    changed = changed || !evict.empty();
+  }
+
+  if (changed) {
+    residentBounds = BoundingBox();
+    for (const auto &tile : resident)
+      residentBounds.expand(tile.index->getBounds());
+    generation++;
+  }
+  return changed;
+}
+
+std::vector<std::pair<int, ModelData>> TileManager::takeLoadedMeshes() {
+  std::vector<std::pair<int, ModelData>> meshes;
+  meshes.swap(loadedMeshes);
+  return meshes;
+}
+
+std::vector<int> TileManager::takeEvictedTiles() {
+  std::vector<int> evicted;
+  evicted.swap(evictedTiles);
+  return evicted;
+}
+
+int TileManager::findResident(int tile) const {
+  for (size_t i = 0; i < resident.size(); i++) {
+    if (resident[i].tile == tile)
+      return static_cast<int>(i);
+  }
+  return -1;
+}
+
+bool TileManager::loadTile(int tile) {
+  TRACE_SCOPE("TileManager::loadTile");
+  const TileInfo &info = tiles[tile];
+  const std::string bvhPath =
+      std::filesystem::path(info.objPath).replace_extension(".bvh").string();
+
+  auto index = std::make_unique<SpatialIndex>();
+  ModelData mesh;
+  // Without a renderer the BVH cache alone is enough
+  bool bvhLoaded = !keepMeshes && index->loadBVH(bvhPath);
+  if (!bvhLoaded) {
+    mesh = ModelLoader::loadOBJCached(info.objPath);
+    if (!mesh.loaded) {
+      std::cerr << "Failed to load tile: " << info.objPath << std::endl;
+      return false;
+    }
+    if (!index->loadBVH(bvhPath)) {
+      // The BVH is built from full-precision positions, never the cache's
+      ModelData full;
+      if (mesh.quantized)
+        full = ModelLoader::loadOBJ(info.objPath);
+      const ModelData &source = mesh.quantized ? full : mesh;
+      if (!source.loaded) {
+        std::cerr << "Failed to load tile: " << info.objPath << std::endl;
+        return false;
+      }
+      index->buildFromMesh(source.vertices, source.indices);
+      index->saveBVH(bvhPath);
+    }
+  }
+
+  ResidentTile entry;
+  entry.tile = tile;
+  entry.bytes = estimateBytes(*index, keepMeshes ? &mesh : nullptr);
+  entry.lastUsed = useCounter;
+  entry.index = std::move(index);
+  residentBytes += entry.bytes;
+  resident.push_back(std::move(entry));
+
+  if (keepMeshes)
+    loadedMeshes.emplace_back(tile, std::move(mesh));
+  return true;
+}
+
+void TileManager::evictTile(size_t residentIndex) {
+  ResidentTile &entry = resident[residentIndex];
+  residentBytes -= entry.bytes;
+
+  // A tile loaded and evicted before anyone collected its mesh never
+  // reached the renderer
+  auto pending = std::find_if(
+      loadedMeshes.begin(), loadedMeshes.end(),
+      [&](const auto &loaded) { return loaded.first == entry.tile; });
+  if (pending != loadedMeshes.end())
+    loadedMeshes.erase(pending);
+  else
+    evictedTiles.push_back(entry.tile);
+
+  resident.erase(resident.begin() + residentIndex);
+}
+
+RayHit TileManager::intersect(const Ray &ray) const {
+  RayHit closestHit;
+  Ray tileRay = ray;
+  for (const auto &tile : resident) {
+    if (!tile.index->getBounds().intersect(tileRay.origin, tileRay.direction,
+                                           tileRay.tMin, tileRay.tMax))
+      continue;
+    RayHit hit = tile.index->intersect(tileRay);
+    if (hit.hit && hit.distance < closestHit.distance) {
+      closestHit = hit;
+      tileRay.tMax = hit.distance;
+    }
+  }
+  return closestHit;
+}
+
+bool TileManager::intersectAny(const Ray &ray) const {
+  for (const auto &tile : resident) {
+    if (tile.index->getBounds().intersect(ray.origin, ray.direction, ray.tMin,
+                                          ray.tMax) &&
+        tile.index->intersectAny(ray))
+      return true;
+  }
+  return false;
+}
+
+void TileManager::queryTriangles(const BoundingBox &box,
+                                 std::vector<Triangle> &triangles) const {
+  for (const auto &tile : resident) {
+    if (tile.index->getBounds().overlaps(box))
+      tile.index->queryTriangles(box, triangles);
+  }
+}
+
+const BoundingBox &TileManager::getBounds() const {
+  return resident.empty() ? datasetBounds : residentBounds;
+}
@@ -0,0 +1,155 @@
+#include "trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+  const char *name;
+  uint64_t startNs;
+  uint64_t endNs;
+};
+
+// Single-producer block list: the owning thread fills events and then
+// publishes them through `count`/`next`, so write() can read concurrently
+struct TraceBlock {
+  static constexpr size_t CAPACITY = 4096;
+  TraceEvent events[CAPACITY];
+  std::atomic<size_t> count{0};
+  std::atomic<TraceBlock *> next{nullptr};
+};
+
+struct ThreadBuffer {
+  int tid = 0;
+  std::string name;
+  TraceBlock head;
+  TraceBlock *tail = &head;
+  std::vector<std::unique_ptr<TraceBlock>> blocks; // Owns everything but head
+};
+
+// Buffers outlive their threads so events from finished workers still get
+// written
+struct TraceRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+TraceRegistry &registry() {
+  static TraceRegistry instance;
+  return instance;
+}
+
+ThreadBuffer &threadBuffer() {
+  thread_local ThreadBuffer *buffer = nullptr;
+  if (!buffer) {
+    TraceRegistry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.buffers.push_back(std::make_unique<ThreadBuffer>());
+    buffer = reg.buffers.back().get();
+    buffer->tid = static_cast<int>(reg.buffers.size());
+    buffer->name = "Thread " + std::to_string(buffer->tid);
+  }
+  return *buffer;
+}
+
+void append(ThreadBuffer &buffer, const char *name, uint64_t startNs,
+            uint64_t endNs) {
+  TraceBlock *block = buffer.tail;
+  size_t count = block->count.load(std::memory_order_relaxed);
+  if (count == TraceBlock::CAPACITY) {
+    buffer.blocks.push_back(std::make_unique<TraceBlock>());
+    TraceBlock *fresh = buffer.blocks.back().get();
+    block->next.store(fresh, std::memory_order_release);
+    buffer.tail = block = fresh;
+    count = 0;
+  }
+  block->events[count] = {name, startNs, endNs};
+  block->count.store(count + 1, std::memory_order_release);
+}
+
+} // namespace
+
+void Tracer::setThreadName(const std::string &name) {
+  ThreadBuffer &buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(registry().mutex);
+  buffer.name = name;
+}
+
+uint64_t Tracer::nowNs() {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+void Tracer::record(const char *name, uint64_t startNs, uint64_t endNs) {
+  append(threadBuffer(), name, startNs, endNs);
+}
+
+int Tracer::addTrack(const std::string &name) {
+  TraceRegistry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  reg.buffers.push_back(std::make_unique<ThreadBuffer>());
+  ThreadBuffer &buffer = *reg.buffers.back();
+  buffer.tid = static_cast<int>(reg.buffers.size());
+  buffer.name = name;
+  return buffer.tid;
+}
+
+void Tracer::record(int track, const char *name, uint64_t startNs,
+                    uint64_t endNs) {
+  ThreadBuffer *buffer;
+  {
+    // The registry may grow concurrently; the buffer itself never moves
+    TraceRegistry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    buffer = reg.buffers[track - 1].get();
+  }
+  append(*buffer, name, startNs, endNs);
+}
+
+bool Tracer::write(const std::string &path) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file for writing: " << path << std::endl;
+    return false;
+  }
+
+  TraceRegistry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+
+  size_t eventCount = 0;
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  const char *separator = "\n";
+  for (const auto &buffer : reg.buffers) {
+    file << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", "
+         << "\"pid\": 1, \"tid\": " << buffer->tid
+         << ", \"args\": {\"name\": \"" << buffer->name << "\"}}";
+    separator = ",\n";
+
+    for (const TraceBlock *block = &buffer->head; block;
+         block = block->next.load(std::memory_order_acquire)) {
+      size_t count = block->count.load(std::memory_order_acquire);
+      for (size_t i = 0; i < count; i++) {
+        const TraceEvent &event = block->events[i];
+        file << ",\n{\"name\": \"" << event.name
+             << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+             << ", \"ts\": " << event.startNs / 1000.0
+             << ", \"dur\": " << (event.endNs - event.startNs) / 1000.0 << "}";
+      }
+      eventCount += count;
+    }
+  }
+  file << "\n]}\n";
+
+  std::cout << "Trace with " << eventCount << " events written to " << path
+            << std::endl;
+  return file.good();
+}
@@ -1,14 +1,23 @@
 #include "ui_manager.h"
+#include "async_readback.h"
 #include "camera.h"
 #include "fdtd_solver.h"
+#include "field_recorder.h"
+#include "gpu_profiler.h"
+#include "image_method_solver.h"
 #include "node_manager.h"
+#include "renderer.h"
 #include "scene_serializer.h"
+#include "simulation_scheduler.h"
 #include "volume_renderer.h"
 
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
 #include <iostream>
 
 UIManager::UIManager() {}
@@ -117,6 +126,25 @@ void UIManager::renderVisualSettingsPanel(void *rendererPtr) {
     }
   }
 
+  if (ImGui::CollapsingHeader("Level of Detail")) {
+    ImGui::Checkbox("Enable LOD", &visualSettings.enableLod);
+    if (visualSettings.enableLod) {
+      ImGui::Text("Max Screen Error (px):");
+      ImGui::SliderFloat("##LodPixelError", &visualSettings.lodPixelError,
+                         0.25f, 8.0f, "%.2f");
+    }
+
+    ImGui::Checkbox("Frustum/Occlusion Culling", &visualSettings.enableCulling);
+
+    const Renderer *renderer = static_cast<const Renderer *>(rendererPtr);
+    if (renderer) {
+      ImGui::Text("Triangles: %zu of %zu", renderer->getDrawnTriangleCount(),
+                  renderer->getFullTriangleCount());
+      ImGui::Text("Clusters: %zu of %zu", renderer->getVisibleClusterCount(),
+                  renderer->getClusterCount());
+    }
+  }
+
   if (ImGui::CollapsingHeader("Anti-Aliasing")) {
     ImGui::TextWrapped("MSAA 4x: Enabled");
     ImGui::Spacing();
@@ -161,7 +189,8 @@ void UIManager::setMouseLookMode(bool enabled) {
 
 void UIManager::renderPerformanceWindow(float fps, float deltaTime) {
   ImGui::SetNextWindowPos(ImVec2(10, 420), ImGuiCond_FirstUseEver);
-  ImGui::SetNextWindowSize(ImVec2(350, 150), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowSize(ImVec2(350, profiler ? 480 : 150),
+                           ImGuiCond_FirstUseEver);
 
   ImGui::Begin("Performance", &state.showPerformanceWindow);
 
@@ -181,9 +210,105 @@ void UIManager::renderPerformanceWindow(float fps, float deltaTime) {
   ImGui::PlotLines("FPS", fpsHistory, FPS_SAMPLE_COUNT, fpsHistoryIndex, NULL,
                    0.0f, 120.0f, ImVec2(0, 80));
 
+  if (profiler && ImGui::CollapsingHeader("Frame Breakdown",
+                                          ImGuiTreeNodeFlags_DefaultOpen)) {
+    renderFrameBreakdown();
+  }
+
   ImGui::End();
 }
 
+void UIManager::renderFrameBreakdown() {
+  static const ImU32 passColors[] = {
+      IM_COL32(230, 97, 80, 255),  IM_COL32(80, 160, 230, 255),
+      IM_COL32(120, 200, 90, 255), IM_COL32(230, 190, 70, 255),
+      IM_COL32(170, 110, 220, 255), IM_COL32(70, 200, 190, 255),
+      IM_COL32(230, 130, 190, 255), IM_COL32(160, 160, 160, 255)};
+  const int colorCount = sizeof(passColors) / sizeof(passColors[0]);
+
+  bool enabled = profiler->isEnabled();
+  if (ImGui::Checkbox("Profile Frames", &enabled)) {
+    profiler->setEnabled(enabled);
+  }
+
+  const auto &history = profiler->getHistory();
+  if (!enabled || history.empty()) {
+    ImGui::TextDisabled("No timings yet");
+    return;
+  }
+
+  const auto &passes = profiler->getGpuPassNames();
+  const auto &stages = profiler->getCpuStageNames();
+  std::vector<float> gpuAverage(passes.size(), 0.0f);
+  std::vector<float> cpuAverage(stages.size(), 0.0f);
+  float cpuFrameAverage = 0.0f;
+  float scaleMs = 1.0f;
+  for (const auto &record : history) {
+    float total = 0.0f;
+    for (size_t i = 0; i < record.gpuMs.size(); i++) {
+      gpuAverage[i] += record.gpuMs[i] / history.size();
+      total += record.gpuMs[i];
+    }
+    for (size_t i = 0; i < record.cpuMs.size(); i++) {
+      cpuAverage[i] += record.cpuMs[i] / history.size();
+    }
+    cpuFrameAverage += record.cpuFrameMs / history.size();
+    scaleMs = std::max(scaleMs, total);
+  }
+
+  // Stacked GPU time per frame, newest frame on the right
+  ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImVec2 size(ImGui::GetContentRegionAvail().x, 100.0f);
+  ImDrawList *drawList = ImGui::GetWindowDrawList();
+  drawList->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y),
+                          IM_COL32(25, 25, 30, 255));
+  float barWidth = size.x / GpuProfiler::HISTORY_FRAMES;
+  for (size_t f = 0; f < history.size(); f++) {
+    float x = origin.x + size.x - (history.size() - f) * barWidth;
+    float y = origin.y + size.y;
+    const auto &gpuMs = history[f].gpuMs;
+    for (size_t i = 0; i < gpuMs.size(); i++) {
+      float height = gpuMs[i] / scaleMs * size.y;
+      if (height <= 0.0f)
+        continue;
+      drawList->AddRectFilled(ImVec2(x, y - height), ImVec2(x + barWidth, y),
+                              passColors[i % colorCount]);
+      y -= height;
+    }
+  }
+  ImGui::Dummy(size);
+  ImGui::TextDisabled("Scale: %.2f ms", scaleMs);
+
+  float gpuTotal = 0.0f;
+  for (size_t i = 0; i < passes.size(); i++) {
+    ImGui::PushID(static_cast<int>(i));
+    ImVec4 swatch = ImGui::ColorConvertU32ToFloat4(passColors[i % colorCount]);
+    ImGui::ColorButton("##PassColor", swatch, ImGuiColorEditFlags_NoTooltip,
+                       ImVec2(10, 10));
+    ImGui::PopID();
+    ImGui::SameLine();
+    ImGui::Text("%-18s %7.3f ms", passes[i].c_str(), gpuAverage[i]);
+    gpuTotal += gpuAverage[i];
+  }
+  ImGui::Text("GPU total: %.3f ms", gpuTotal);
+
+  ImGui::Separator();
+  ImGui::Text("CPU frame: %.3f ms", cpuFrameAverage);
+  for (size_t i = 0; i < stages.size(); i++) {
+    float fraction = cpuFrameAverage > 0.0f ? cpuAverage[i] / cpuFrameAverage
+                                            : 0.0f;
+    char label[64];
+    snprintf(label, sizeof(label), "%s %.3f ms", stages[i].c_str(),
+             cpuAverage[i]);
+    ImGui::ProgressBar(fraction, ImVec2(-1, 0), label);
+  }
+
+  if (profiler->getDroppedFrames() > 0) {
+    ImGui::TextDisabled("%d frames dropped (results not ready)",
+                        profiler->getDroppedFrames());
+  }
+}
+
 void UIManager::renderAboutWindow() {
   ImGui::SetNextWindowPos(ImVec2(400, 100), ImGuiCond_FirstUseEver);
   ImGui::SetNextWindowSize(ImVec2(500, 300), ImGuiCond_FirstUseEver);
@@ -339,6 +464,11 @@ void UIManager::renderNodePanel(NodeManager *nodeManager,
     ImGui::ColorEdit3("Color", &selectedNode->color.x);
 
     ImGui::PopItemWidth();
+
+    if (selectedNode->type == NodeType::RECEIVER) {
+      renderLinkInfo(*selectedNode);
+      renderProbeInfo(*selectedNode);
+    }
   }
 
   // Scene Save/Load section
@@ -356,7 +486,8 @@ void UIManager::renderNodePanel(NodeManager *nodeManager,
     if (ImGui::Button("Save")) {
       if (sceneDataPtr) {
         SceneData *sceneData = static_cast<SceneData *>(sceneDataPtr);
-        if (SceneSerializer::saveScene(saveFilePath, nodeManager, *sceneData)) {
+        if (SceneSerializer::saveScene(
+                saveFilePath, *nodeManager->getRadioSystem(), *sceneData)) {
           ImGui::OpenPopup("SaveSuccess");
         }
       }
@@ -369,7 +500,10 @@ void UIManager::renderNodePanel(NodeManager *nodeManager,
     if (ImGui::Button("Load")) {
       if (sceneDataPtr) {
         SceneData *sceneData = static_cast<SceneData *>(sceneDataPtr);
-        if (SceneSerializer::loadScene(loadFilePath, nodeManager, *sceneData)) {
+        // Loading replaces every node, so drop the selection first
+        nodeManager->deselectAll();
+        if (SceneSerializer::loadScene(
+                loadFilePath, *nodeManager->getRadioSystem(), *sceneData)) {
           sceneJustLoaded = true;
           ImGui::OpenPopup("LoadSuccess");
         }
@@ -403,8 +537,73 @@ void UIManager::renderNodePanel(NodeManager *nodeManager,
   ImGui::End();
 }
 
+void UIManager::renderLinkInfo(const RadioSource &receiver) {
+  if (!linkSolver)
+    return;
+
+  ImGui::Spacing();
+  ImGui::Separator();
+  ImGui::Text("Links (image method, %d bounces):",
+              linkSolver->getMaxBounces());
+
+  bool anyLink = false;
+  for (const auto &link : linkSolver->getLinks()) {
+    if (link.receiverId != receiver.id)
+      continue;
+    anyLink = true;
+
+    ImGui::PushID(link.transmitterId);
+    if (link.paths.empty()) {
+      ImGui::BulletText("Tx %d: no path", link.transmitterId);
+    } else if (ImGui::TreeNode("link", "Tx %d: %d paths, best %.1f dB%s",
+                               link.transmitterId, (int)link.paths.size(),
+                               link.bestLossDb,
+                               link.lineOfSight ? " (LOS)" : "")) {
+      ImGui::Text("Total received: %.1f dB", link.totalGainDb);
+      for (const auto &path : link.paths) {
+        ImGui::BulletText("%d bounce(s): %.1f dB, %.1f ns, AoA %.0f/%.0f deg",
+                          path.bounces, path.lossDb, path.delay * 1e9f,
+                          path.arrivalAzimuth, path.arrivalElevation);
+      }
+      ImGui::TreePop();
+    }
+    ImGui::PopID();
+  }
+
+  if (!anyLink) {
+    ImGui::TextDisabled("No active transmitters");
+  }
+}
+
+void UIManager::renderProbeInfo(const RadioSource &receiver) {
+  if (!probeSolver)
+    return;
+
+  int probe = probeSolver->findProbe(receiver.id);
+  if (probe < 0)
+    return;
+
+  const auto &history = probeSolver->getProbeHistory(probe);
+
+  ImGui::Spacing();
+  ImGui::Separator();
+  ImGui::Text("FDTD probe: RSSI %.1f dB (%d samples)",
+              probeSolver->getProbeRSSI(probe), (int)history.size());
+
+  const size_t plotLength = 256;
+  size_t count = std::min(history.size(), plotLength);
+  if (count > 1) {
+    float trace[plotLength];
+    for (size_t i = 0; i < count; i++) {
+      trace[i] = history[history.size() - count + i].ez;
+    }
+    ImGui::PlotLines("Ez", trace, static_cast<int>(count), 0, NULL, FLT_MAX,
+                     FLT_MAX, ImVec2(0, 60));
+  }
+}
+
 void UIManager::renderFDTDPanel(bool &fdtdEnabled, bool &fdtdPaused,
-                                int &simulationSpeed, float &emissionStrength,
+                                float &emissionStrength,
                                 bool &continuousEmission, glm::vec3 &gridCenter,
                                 glm::vec3 &gridHalfSize, bool &autoCenterGrid,
                                 void *fdtdSolverPtr, void *volumeRendererPtr) {
@@ -422,8 +621,26 @@ void UIManager::renderFDTDPanel(bool &fdtdEnabled, bool &fdtdPaused,
       ImGui::Checkbox("Paused", &fdtdPaused);
 
       ImGui::Spacing();
-      ImGui::Text("Simulation Speed:");
-      ImGui::SliderInt("##Speed", &simulationSpeed, 1, 10, "%dx");
+      if (simulationScheduler) {
+        ImGui::Text("Simulation Speed:");
+        float rate = simulationScheduler->getTargetRate();
+        if (ImGui::SliderFloat("Steps/s", &rate, 10.0f, 5000.0f, "%.0f",
+                               ImGuiSliderFlags_Logarithmic)) {
+          simulationScheduler->setTargetRate(rate);
+        }
+        float budget = simulationScheduler->getFrameBudget();
+        if (ImGui::SliderFloat("GPU Budget", &budget, 1.0f, 33.0f,
+                               "%.0f ms/frame")) {
+          simulationScheduler->setFrameBudget(budget);
+        }
+        ImGui::Text("Achieved: %.0f steps/s, %.1f Mcells/s",
+                    simulationScheduler->getAchievedRate(),
+                    simulationScheduler->getMegacellsPerSecond());
+        ImGui::Text("Step cost: %.3f ms",
+                    simulationScheduler->getStepCostMs());
+        if (simulationScheduler->isBudgetLimited())
+          ImGui::TextDisabled("Limited by the GPU budget");
+      }
 
       if (ImGui::Button("Reset Simulation")) {
         // Reset will be handled by caller
@@ -432,6 +649,77 @@ void UIManager::renderFDTDPanel(bool &fdtdEnabled, bool &fdtdPaused,
           // This is handled in main.cpp
         }
       }
+      FDTDSolver *solver = static_cast<FDTDSolver *>(fdtdSolverPtr);
+      if (solver) {
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Text("Steady-State Detection:");
+
+        int interval = solver->getConvergenceInterval();
+        float tolerance = solver->getConvergenceTolerance();
+        bool changed = ImGui::InputInt("Check Every (steps)", &interval, 64);
+        changed |= ImGui::InputFloat("Tolerance", &tolerance, 0.0f, 0.0f,
+                                     "%.1e");
+        if (changed) {
+          solver->setConvergenceCheck(std::max(0, interval),
+                                      std::max(tolerance, 1e-7f));
+        }
+
+        bool stopOnConvergence = solver->getStopOnConvergence();
+        if (ImGui::Checkbox("Stop When Converged", &stopOnConvergence)) {
+          solver->setStopOnConvergence(stopOnConvergence);
+        }
+
+        const ConvergenceStatus &status = solver->getConvergenceStatus();
+        if (status.converged) {
+          ImGui::TextColored(ImVec4(0.3f, 1.0f, 0.3f, 1.0f),
+                             "Converged at step %d", status.step);
+          if (solver->isHalted()) {
+            ImGui::SameLine();
+            if (ImGui::Button("Resume")) {
+              solver->resetConvergence();
+            }
+          }
+        } else if (interval > 0) {
+          ImGui::Text("Energy delta: %.2e  DFT delta: %.2e",
+                      status.energyDelta, status.dftDelta);
+        }
+
+        if (fieldRecorder) {
+          ImGui::Spacing();
+          ImGui::Separator();
+          ImGui::Text("Recording:");
+
+          static char recordPath[256] = "fdtd_ez.hfr";
+          int recordInterval = fieldRecorder->getInterval();
+          if (ImGui::InputInt("Every (steps)##Record", &recordInterval)) {
+            fieldRecorder->setInterval(recordInterval);
+          }
+          if (fieldRecorder->isRecording()) {
+            size_t written = fieldRecorder->getBytesWritten();
+            size_t raw = fieldRecorder->getRawBytes();
+            ImGui::Text("%zu frames, %.1f MB (%.1fx smaller)",
+                        fieldRecorder->getFramesWritten(),
+                        written / (1024.0 * 1024.0),
+                        written > 0 ? double(raw) / written : 0.0);
+            size_t lost = fieldReadback ? fieldReadback->getLostCount() : 0;
+            if (fieldRecorder->getFramesDropped() > 0 || lost > 0) {
+              ImGui::TextDisabled("%zu frames dropped, %zu readbacks lost",
+                                  fieldRecorder->getFramesDropped(), lost);
+            }
+            if (ImGui::Button("Stop Recording")) {
+              fieldRecorder->stop();
+            }
+          } else {
+            ImGui::InputText("##RecordPath", recordPath, sizeof(recordPath));
+            ImGui::SameLine();
+            if (ImGui::Button("Record Ez")) {
+              fieldRecorder->start(recordPath,
+                                   glm::ivec3(solver->getGridSize()));
+            }
+          }
+        }
+      }
     }
   }
 
@@ -519,6 +807,69 @@ void UIManager::renderFDTDPanel(bool &fdtdEnabled, bool &fdtdPaused,
       ImGui::TextWrapped(
           "Wave field intensity visualization with customizable colors");
 
+      ImGui::Spacing();
+      ImGui::Separator();
+      ImGui::Text("Field Display:");
+
+      const char *displayModes[] = {"Instantaneous Ez", "DFT Amplitude",
+                                    "DFT Phase"};
+      int displayMode = static_cast<int>(volRenderer->getDisplayMode());
+      if (ImGui::Combo("##FieldDisplay", &displayMode, displayModes, 3)) {
+        volRenderer->setDisplayMode(
+            static_cast<FieldDisplayMode>(displayMode));
+      }
+
+      FDTDSolver *solver = static_cast<FDTDSolver *>(fdtdSolverPtr);
+      if (solver &&
+          volRenderer->getDisplayMode() != FieldDisplayMode::INSTANTANEOUS) {
+        int frequencyCount = solver->getDFTFrequencyCount();
+        if (frequencyCount == 0) {
+          ImGui::TextDisabled("No active transmitters to accumulate");
+        } else {
+          int dftIndex = std::min(volRenderer->getDFTIndex(),
+                                  frequencyCount - 1);
+          for (int i = 0; i < frequencyCount; i++) {
+            char label[32];
+            snprintf(label, sizeof(label), "%.1f MHz",
+                     solver->getDFTFrequency(i) / 1e6f);
+            if (ImGui::RadioButton(label, dftIndex == i))
+              dftIndex = i;
+            if (i + 1 < frequencyCount)
+              ImGui::SameLine();
+          }
+          volRenderer->setDFTIndex(dftIndex);
+          ImGui::Text("Accumulated steps: %d", solver->getDFTSampleCount());
+        }
+
+        // Restrict accumulation to a horizontal slice to save memory
+        glm::ivec3 regionMin = solver->getDFTRegionMin();
+        glm::ivec3 regionSize = solver->getDFTRegionSize();
+        bool slice = regionSize.y == 1;
+        if (ImGui::Checkbox("Horizontal Slice Only", &slice)) {
+          int gridSize = solver->getGridSize();
+          if (slice) {
+            solver->setDFTRegion(glm::ivec3(0, gridSize / 2, 0),
+                                 glm::ivec3(0, 1, 0));
+          } else {
+            solver->setDFTRegion(glm::ivec3(0), glm::ivec3(0));
+          }
+        }
+        if (slice) {
+          int sliceY = regionMin.y;
+          if (ImGui::SliderInt("Slice Y", &sliceY, 0,
+                               solver->getGridSize() - 1)) {
+            solver->setDFTRegion(glm::ivec3(0, sliceY, 0),
+                                 glm::ivec3(0, 1, 0));
+          }
+        }
+
+        if (ImGui::Button("Restart Accumulation")) {
+          solver->resetDFT();
+        }
+        ImGui::TextWrapped("Restart once the field has settled to drop the "
+                           "start-up transient from the map.");
+      }
+
       ImGui::Spacing();
       ImGui::Separator();
       ImGui::Text("Waveform Gradient Colors:");
@@ -554,6 +905,23 @@ void UIManager::renderFDTDPanel(bool &fdtdEnabled, bool &fdtdPaused,
         volRenderer->setShowEmissionSource(showEmission);
       }
 
+      bool skipEmpty = volRenderer->getEmptySpaceSkipping();
+      if (ImGui::Checkbox("Skip Empty Space", &skipEmpty)) {
+        volRenderer->setEmptySpaceSkipping(skipEmpty);
+      }
+
+      const char *resolutions[] = {"Full", "Half", "Quarter"};
+      float scale = volRenderer->getResolutionScale();
+      int resolution = scale > 0.75f ? 0 : (scale > 0.375f ? 1 : 2);
+      if (ImGui::Combo("Volume Resolution", &resolution, resolutions, 3)) {
+        volRenderer->setResolutionScale(1.0f / float(1 << resolution));
+      }
+
+      bool temporal = volRenderer->getTemporalAccumulation();
+      if (ImGui::Checkbox("Temporal Accumulation", &temporal)) {
+        volRenderer->setTemporalAccumulation(temporal);
+      }
+
       ImGui::Spacing();
       ImGui::TextWrapped("Yellow markers: Emission sources");
       ImGui::TextWrapped("Green outlines: Geometry edges (debug)");
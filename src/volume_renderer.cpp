@@ -1,13 +1,40 @@
 #include "volume_renderer.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
+namespace {
+
+GLuint createTargetTexture(GLenum format, GLenum filter, int width,
+                           int height) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
+
+} // namespace
+
 VolumeRenderer::VolumeRenderer()
-    : vao(0), vbo(0), shaderProgram(0), intensityScale(20.0f), stepCount(200),
+    : vao(0), vbo(0), shaderProgram(0), temporalProgram(0),
+      upsampleProgram(0), intensityScale(20.0f), stepCount(200),
       showEmissionSource(true), showGeometryEdges(false),
+      displayMode(FieldDisplayMode::INSTANTANEOUS), dftIndex(0), dftTexture(0),
+      dftRegionMin(0), dftRegionSize(0), dftNormalization(0.0f),
+      brickTexture(0), brickSize(8), emptySpaceSkipping(true),
+      sceneDepthTexture(0), resolutionScale(1.0f), temporalAccumulation(false),
+      marchFBO(0), marchColor(0), marchDepth(0), historyFBO{0, 0},
+      historyColor{0, 0}, targetWidth(0), targetHeight(0), historyIndex(0),
+      historyValid(false), previousViewProj(1.0f), frameIndex(0),
       gradientColorLow(0.0f, 0.0f, 0.5f),   // Dark blue
       gradientColorHigh(1.0f, 0.0f, 0.0f) { // Red
 }
@@ -121,65 +148,341 @@ bool VolumeRenderer::initialize() {
     return false;
   }
 
+  uniforms.invView = glGetUniformLocation(shaderProgram, "invView");
+  uniforms.invProj = glGetUniformLocation(shaderProgram, "invProj");
+  uniforms.gridCenter = glGetUniformLocation(shaderProgram, "gridCenter");
+  uniforms.gridHalfSize = glGetUniformLocation(shaderProgram, "gridHalfSize");
+  uniforms.gridSize = glGetUniformLocation(shaderProgram, "gridSize");
+  uniforms.intensityScale =
+      glGetUniformLocation(shaderProgram, "intensityScale");
+  uniforms.stepCount = glGetUniformLocation(shaderProgram, "stepCount");
+  uniforms.showEmissionSource =
+      glGetUniformLocation(shaderProgram, "showEmissionSource");
+  uniforms.showGeometryEdges =
+      glGetUniformLocation(shaderProgram, "showGeometryEdges");
+  uniforms.gradientColorLow =
+      glGetUniformLocation(shaderProgram, "gradientColorLow");
+  uniforms.gradientColorHigh =
+      glGetUniformLocation(shaderProgram, "gradientColorHigh");
+  uniforms.displayMode = glGetUniformLocation(shaderProgram, "displayMode");
+  uniforms.dftRegionMin = glGetUniformLocation(shaderProgram, "dftRegionMin");
+  uniforms.dftRegionMax = glGetUniformLocation(shaderProgram, "dftRegionMax");
+  uniforms.dftScale = glGetUniformLocation(shaderProgram, "dftScale");
+  uniforms.useBricks = glGetUniformLocation(shaderProgram, "useBricks");
+  uniforms.brickSize = glGetUniformLocation(shaderProgram, "brickSize");
+  uniforms.brickWeights = glGetUniformLocation(shaderProgram, "brickWeights");
+  uniforms.useSceneDepth = glGetUniformLocation(shaderProgram, "useSceneDepth");
+  uniforms.fullResScale = glGetUniformLocation(shaderProgram, "fullResScale");
+  uniforms.jitterRays = glGetUniformLocation(shaderProgram, "jitterRays");
+  uniforms.jitterOffset = glGetUniformLocation(shaderProgram, "jitterOffset");
+
+  glUseProgram(shaderProgram);
+  glUniform1i(glGetUniformLocation(shaderProgram, "volumeTexture"), 0);
+  glUniform1i(glGetUniformLocation(shaderProgram, "edgeMaskTexture"), 1);
+  glUniform1i(glGetUniformLocation(shaderProgram, "emissionTexture"), 2);
+  glUniform1i(glGetUniformLocation(shaderProgram, "dftTexture"), 3);
+  glUniform1i(glGetUniformLocation(shaderProgram, "brickTexture"), 4);
+  glUniform1i(glGetUniformLocation(shaderProgram, "sceneDepth"), 5);
+
+  // Without these the volume is always marched at full resolution
+  temporalProgram = createShaderProgram("shaders/volume.vert",
+                                        "shaders/volume_temporal.frag");
+  upsampleProgram = createShaderProgram("shaders/volume.vert",
+                                        "shaders/volume_upsample.frag");
+  if (temporalProgram && upsampleProgram) {
+    temporalUniforms.invView = glGetUniformLocation(temporalProgram, "invView");
+    temporalUniforms.invProj = glGetUniformLocation(temporalProgram, "invProj");
+    temporalUniforms.previousViewProj =
+        glGetUniformLocation(temporalProgram, "previousViewProj");
+    temporalUniforms.historyValid =
+        glGetUniformLocation(temporalProgram, "historyValid");
+    glUseProgram(temporalProgram);
+    glUniform1i(glGetUniformLocation(temporalProgram, "currentColor"), 0);
+    glUniform1i(glGetUniformLocation(temporalProgram, "currentDepth"), 1);
+    glUniform1i(glGetUniformLocation(temporalProgram, "historyColor"), 2);
+
+    upsampleUniforms.useSceneDepth =
+        glGetUniformLocation(upsampleProgram, "useSceneDepth");
+    upsampleUniforms.fullResScale =
+        glGetUniformLocation(upsampleProgram, "fullResScale");
+    upsampleUniforms.depthParams =
+        glGetUniformLocation(upsampleProgram, "depthParams");
+    glUseProgram(upsampleProgram);
+    glUniform1i(glGetUniformLocation(upsampleProgram, "volumeColor"), 0);
+    glUniform1i(glGetUniformLocation(upsampleProgram, "sceneDepth"), 1);
+  } else {
+    std::cerr << "Reduced-resolution volume rendering unavailable"
+              << std::endl;
+    if (temporalProgram)
+      glDeleteProgram(temporalProgram);
+    if (upsampleProgram)
+      glDeleteProgram(upsampleProgram);
+    temporalProgram = upsampleProgram = 0;
+  }
+  glUseProgram(0);
+
   std::cout << "Volume Renderer initialized" << std::endl;
   return true;
 }
 
-void VolumeRenderer::render(GLuint fieldTexture, GLuint epsilonTexture,
+void VolumeRenderer::render(GLuint fieldTexture, GLuint edgeMaskTexture,
                             GLuint emissionTexture, const glm::mat4 &view,
                             const glm::mat4 &projection,
                             const glm::vec3 &gridCenter,
                             const glm::vec3 &gridHalfSize, int gridSize) {
+  // Rays end at the scene surface in the shader, so the quad itself is not
+  // depth tested
+  const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+  glDisable(GL_DEPTH_TEST);
+
   glUseProgram(shaderProgram);
 
   // Set matrices
   glm::mat4 invView = glm::inverse(view);
   glm::mat4 invProj = glm::inverse(projection);
 
-  glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "invView"), 1,
-                     GL_FALSE, &invView[0][0]);
-  glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "invProj"), 1,
-                     GL_FALSE, &invProj[0][0]);
+  glUniformMatrix4fv(uniforms.invView, 1, GL_FALSE, &invView[0][0]);
+  glUniformMatrix4fv(uniforms.invProj, 1, GL_FALSE, &invProj[0][0]);
 
   // Set grid parameters
-  glUniform3f(glGetUniformLocation(shaderProgram, "gridCenter"), gridCenter.x,
-              gridCenter.y, gridCenter.z);
-  glUniform3f(glGetUniformLocation(shaderProgram, "gridHalfSize"),
-              gridHalfSize.x, gridHalfSize.y, gridHalfSize.z);
-  glUniform1i(glGetUniformLocation(shaderProgram, "gridSize"), gridSize);
+  glUniform3f(uniforms.gridCenter, gridCenter.x, gridCenter.y, gridCenter.z);
+  glUniform3f(uniforms.gridHalfSize, gridHalfSize.x, gridHalfSize.y,
+              gridHalfSize.z);
+  glUniform1i(uniforms.gridSize, gridSize);
 
   // Set visualization parameters
-  glUniform1f(glGetUniformLocation(shaderProgram, "intensityScale"),
-              intensityScale);
-  glUniform1i(glGetUniformLocation(shaderProgram, "stepCount"), stepCount);
-  glUniform1i(glGetUniformLocation(shaderProgram, "showEmissionSource"),
-              showEmissionSource);
-  glUniform1i(glGetUniformLocation(shaderProgram, "showGeometryEdges"),
-              showGeometryEdges);
+  glUniform1f(uniforms.intensityScale, intensityScale);
+  glUniform1i(uniforms.stepCount, stepCount);
+  glUniform1i(uniforms.showEmissionSource, showEmissionSource);
+  glUniform1i(uniforms.showGeometryEdges, showGeometryEdges);
 
   // Set gradient colors
-  glUniform3f(glGetUniformLocation(shaderProgram, "gradientColorLow"),
-              gradientColorLow.x, gradientColorLow.y, gradientColorLow.z);
-  glUniform3f(glGetUniformLocation(shaderProgram, "gradientColorHigh"),
-              gradientColorHigh.x, gradientColorHigh.y, gradientColorHigh.z);
+  glUniform3f(uniforms.gradientColorLow, gradientColorLow.x,
+              gradientColorLow.y, gradientColorLow.z);
+  glUniform3f(uniforms.gradientColorHigh, gradientColorHigh.x,
+              gradientColorHigh.y, gradientColorHigh.z);
 
   // Bind textures
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_3D, fieldTexture);
-  glUniform1i(glGetUniformLocation(shaderProgram, "volumeTexture"), 0);
 
   glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_3D, epsilonTexture);
-  glUniform1i(glGetUniformLocation(shaderProgram, "epsilonTexture"), 1);
+  glBindTexture(GL_TEXTURE_3D, edgeMaskTexture);
 
   glActiveTexture(GL_TEXTURE2);
   glBindTexture(GL_TEXTURE_3D, emissionTexture);
-  glUniform1i(glGetUniformLocation(shaderProgram, "emissionTexture"), 2);
 
-  // Draw quad
+  // Frequency-domain field, falls back to Ez until accumulators exist
+  int mode = dftTexture ? static_cast<int>(displayMode) : 0;
+  glUniform1i(uniforms.displayMode, mode);
+  if (mode != 0) {
+    glm::vec3 regionMin = glm::vec3(dftRegionMin) / float(gridSize);
+    glm::vec3 regionMax =
+        glm::vec3(dftRegionMin + dftRegionSize) / float(gridSize);
+    glUniform3f(uniforms.dftRegionMin, regionMin.x, regionMin.y, regionMin.z);
+    glUniform3f(uniforms.dftRegionMax, regionMax.x, regionMax.y, regionMax.z);
+    glUniform1f(uniforms.dftScale, dftNormalization);
+
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_3D, dftTexture);
+  }
+
+  // The brick channel holding what is displayed: |Ez| or the raw |DFT| of
+  // the shown accumulator
+  bool useBricks = emptySpaceSkipping && brickTexture != 0;
+  glUniform1i(uniforms.useBricks, useBricks);
+  if (useBricks) {
+    glm::vec3 weights(0.0f);
+    if (mode == 0)
+      weights.x = 1.0f;
+    else if (dftIndex == 0)
+      weights.y = dftNormalization;
+    else
+      weights.z = dftNormalization;
+    glUniform1i(uniforms.brickSize, brickSize);
+    glUniform3f(uniforms.brickWeights, weights.x, weights.y, weights.z);
+
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_3D, brickTexture);
+  }
+
+  glUniform1i(uniforms.useSceneDepth, sceneDepthTexture != 0);
+  if (sceneDepthTexture) {
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+  }
+  glActiveTexture(GL_TEXTURE0);
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  const bool offscreen = temporalProgram && upsampleProgram &&
+                         (resolutionScale < 1.0f || temporalAccumulation);
+  if (!offscreen || !drawOffscreen(view, projection, viewport)) {
+    glUniform2f(uniforms.fullResScale, 1.0f, 1.0f);
+    glUniform1i(uniforms.jitterRays, 0);
+
+    // Draw quad
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+    historyValid = false;
+  }
+
+  if (depthTest)
+    glEnable(GL_DEPTH_TEST);
+}
+
+bool VolumeRenderer::drawOffscreen(const glm::mat4 &view,
+                                   const glm::mat4 &projection,
+                                   const GLint viewport[4]) {
+  const float scale = std::clamp(resolutionScale, 0.125f, 1.0f);
+  const int width = std::max(1, static_cast<int>(viewport[2] * scale + 0.5f));
+  const int height =
+      std::max(1, static_cast<int>(viewport[3] * scale + 0.5f));
+  if ((width != targetWidth || height != targetHeight) &&
+      !createTargets(width, height))
+    return false;
+  const glm::vec2 fullResScale(float(viewport[2]) / width,
+                               float(viewport[3]) / height);
+
+  // March with the state render() set up, into the reduced target
+  glUniform2f(uniforms.fullResScale, fullResScale.x, fullResScale.y);
+  glUniform1i(uniforms.jitterRays, temporalAccumulation);
+  // Golden-ratio steps spread consecutive frames' offsets evenly
+  frameIndex++;
+  glUniform1f(uniforms.jitterOffset,
+              static_cast<float>(std::fmod(frameIndex * 0.6180339887, 1.0)));
+
+  const GLboolean blend = glIsEnabled(GL_BLEND);
+  glDisable(GL_BLEND);
+  glBindFramebuffer(GL_FRAMEBUFFER, marchFBO);
+  glViewport(0, 0, width, height);
+  const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  glClearBufferfv(GL_COLOR, 0, zero);
+  glClearBufferfv(GL_COLOR, 1, zero);
   glBindVertexArray(vao);
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  GLuint result = marchColor;
+  if (temporalAccumulation) {
+    const int next = 1 - historyIndex;
+    glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[next]);
+    glUseProgram(temporalProgram);
+
+    glm::mat4 invView = glm::inverse(view);
+    glm::mat4 invProj = glm::inverse(projection);
+    glUniformMatrix4fv(temporalUniforms.invView, 1, GL_FALSE, &invView[0][0]);
+    glUniformMatrix4fv(temporalUniforms.invProj, 1, GL_FALSE, &invProj[0][0]);
+    glUniformMatrix4fv(temporalUniforms.previousViewProj, 1, GL_FALSE,
+                       &previousViewProj[0][0]);
+    glUniform1i(temporalUniforms.historyValid, historyValid);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, marchColor);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, marchDepth);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, historyColor[historyIndex]);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    historyIndex = next;
+    result = historyColor[next];
+  }
+  historyValid = temporalAccumulation;
+  previousViewProj = projection * view;
+
+  // Back on the window, blended as a full-resolution march would be
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  if (blend)
+    glEnable(GL_BLEND);
+
+  glUseProgram(upsampleProgram);
+  glUniform1i(upsampleUniforms.useSceneDepth, sceneDepthTexture != 0);
+  glUniform2f(upsampleUniforms.fullResScale, fullResScale.x, fullResScale.y);
+  glUniform2f(upsampleUniforms.depthParams, projection[2][2],
+              projection[3][2]);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, result);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+  glActiveTexture(GL_TEXTURE0);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
   glBindVertexArray(0);
+  return true;
+}
+
+bool VolumeRenderer::createTargets(int width, int height) {
+  deleteTargets();
+
+  marchColor = createTargetTexture(GL_RGBA16F, GL_NEAREST, width, height);
+  marchDepth = createTargetTexture(GL_R32F, GL_NEAREST, width, height);
+  glGenFramebuffers(1, &marchFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, marchFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         marchColor, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         marchDepth, 0);
+  const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, drawBuffers);
+  bool complete =
+      glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+  // Reprojected history is sampled between texels
+  for (int i = 0; i < 2; i++) {
+    historyColor[i] = createTargetTexture(GL_RGBA16F, GL_LINEAR, width, height);
+    glGenFramebuffers(1, &historyFBO[i]);
+    glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           historyColor[i], 0);
+    complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+                               GL_FRAMEBUFFER_COMPLETE;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (!complete) {
+    std::cerr << "Volume render targets incomplete, marching at full "
+                 "resolution"
+              << std::endl;
+    deleteTargets();
+    glDeleteProgram(temporalProgram);
+    glDeleteProgram(upsampleProgram);
+    temporalProgram = upsampleProgram = 0;
+    return false;
+  }
+
+  targetWidth = width;
+  targetHeight = height;
+  return true;
+}
+
+void VolumeRenderer::deleteTargets() {
+  if (marchFBO)
+    glDeleteFramebuffers(1, &marchFBO);
+  if (marchColor)
+    glDeleteTextures(1, &marchColor);
+  if (marchDepth)
+    glDeleteTextures(1, &marchDepth);
+  for (int i = 0; i < 2; i++) {
+    if (historyFBO[i])
+      glDeleteFramebuffers(1, &historyFBO[i]);
+    if (historyColor[i])
+      glDeleteTextures(1, &historyColor[i]);
+    historyFBO[i] = historyColor[i] = 0;
+  }
+  marchFBO = marchColor = marchDepth = 0;
+  targetWidth = targetHeight = 0;
+  historyValid = false;
+}
+
+void VolumeRenderer::setDFTField(GLuint texture, const glm::ivec3 &regionMin,
+                                 const glm::ivec3 &regionSize,
+                                 float normalization) {
+  dftTexture = texture;
+  dftRegionMin = regionMin;
+  dftRegionSize = regionSize;
+  dftNormalization = normalization;
 }
 
 void VolumeRenderer::cleanup() {
@@ -189,4 +492,10 @@ void VolumeRenderer::cleanup() {
     glDeleteBuffers(1, &vbo);
   if (shaderProgram)
     glDeleteProgram(shaderProgram);
+  if (temporalProgram)
+    glDeleteProgram(temporalProgram);
+  if (upsampleProgram)
+    glDeleteProgram(upsampleProgram);
+  temporalProgram = upsampleProgram = 0;
+  deleteTargets();
 }